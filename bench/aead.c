@@ -0,0 +1,305 @@
+/*
+ * Benchmark of the fused AEAD HC-128 + Poly1305 (hc128_aead.c).
+ * Poly1305 is checked with the vector of RFC 8439, the construction with a
+ * known answer, the round trip, the tag check and the batch with the
+ * single calls. Then cycles/byte of the fused pass are compared with
+ * encrypt-then-MAC in two passes: hc128_crypt() over the whole record,
+ * Poly1305 over the whole ciphertext. -c runs only the checks.
+ * Example: ./bench/aead
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "../hc128.h"
+#include "../hc128_aead.h"
+
+#define BATCH		64
+#define BATCH_LEN	64
+
+static const uint8_t poly_key[32] = {
+	0x85, 0xd6, 0xbe, 0x78, 0x57, 0x55, 0x6d, 0x33, 0x7f, 0x44, 0x52, 0xfe, 0x42, 0xd5, 0x06, 0xa8,
+	0x01, 0x03, 0x80, 0x8a, 0xfb, 0x0d, 0xb2, 0xfd, 0x4a, 0xbf, 0xf6, 0xaf, 0x41, 0x49, 0xf5, 0x1b
+};
+
+static const uint8_t poly_tag[16] = {
+	0xa8, 0x06, 0x1d, 0xc1, 0x30, 0x51, 0x36, 0xc6, 0xc2, 0x2b, 0x8b, 0xaf, 0x0c, 0x01, 0x27, 0xa9
+};
+
+// Tag of kat_check(): key 0..15, iv 0x80..0x8f, aad "header", 100 bytes i * 7
+static const uint8_t kat_tag[16] = {
+	0xf6, 0xd0, 0x1a, 0xa1, 0xa6, 0x6a, 0xec, 0xb7, 0x81, 0x69, 0x9a, 0xc8, 0x69, 0x62, 0x61, 0x81
+};
+
+// Time stamp: TSC cycles where available, nanoseconds otherwise
+#if defined(__x86_64__) || defined(__i386__)
+#define UNIT	"cycles/byte"
+
+static uint64_t
+stamp(void)
+{
+	return __rdtsc();
+}
+#else
+#define UNIT	"ns/byte"
+
+static uint64_t
+stamp(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+
+static void *
+xmalloc(size_t size)
+{
+	void *p = malloc(size);
+
+	if(!p) {
+		printf("malloc error!\n");
+		exit(1);
+	}
+
+	return p;
+}
+
+static void
+print_hex(const char *name, const uint8_t *p, int len)
+{
+	int i;
+
+	printf("%s", name);
+	for(i = 0; i < len; i++)
+		printf("%02x", p[i]);
+	printf("\n");
+}
+
+static int
+poly1305_check(void)
+{
+	const char *msg = "Cryptographic Forum Research Group";
+	struct hc128_poly1305 st;
+	uint8_t mac[16];
+	size_t i;
+
+	// Byte by byte, so the partial blocks are used too
+	hc128_poly1305_init(&st, poly_key);
+	for(i = 0; i < strlen(msg); i++)
+		hc128_poly1305_update(&st, (const uint8_t *)msg + i, 1);
+	hc128_poly1305_finish(&st, mac);
+
+	return memcmp(mac, poly_tag, 16) ? -1 : 0;
+}
+
+static int
+kat_check(void)
+{
+	uint8_t key[16], iv[16], in[100], out[100], back[100], tag[16];
+	const char *aad = "header";
+	int i;
+
+	for(i = 0; i < 16; i++) {
+		key[i] = i;
+		iv[i] = 0x80 + i;
+	}
+
+	for(i = 0; i < 100; i++)
+		in[i] = i * 7;
+
+	hc128_aead_seal(key, iv, (const uint8_t *)aad, strlen(aad), in, sizeof(in), out, tag);
+
+	if(memcmp(tag, kat_tag, 16)) {
+		print_hex("tag = ", tag, 16);
+		return -1;
+	}
+
+	if(hc128_aead_open(key, iv, (const uint8_t *)aad, strlen(aad), out, sizeof(out), back, tag) ||
+	   memcmp(in, back, sizeof(in)))
+		return -1;
+
+	// Any changed bit of the ciphertext, aad or tag must be rejected
+	out[50] ^= 0x04;
+	if(!hc128_aead_open(key, iv, (const uint8_t *)aad, strlen(aad), out, sizeof(out), back, tag))
+		return -1;
+	out[50] ^= 0x04;
+
+	if(!hc128_aead_open(key, iv, (const uint8_t *)"headeR", strlen(aad), out, sizeof(out), back, tag))
+		return -1;
+
+	tag[15] ^= 0x80;
+	if(!hc128_aead_open(key, iv, (const uint8_t *)aad, strlen(aad), out, sizeof(out), back, tag))
+		return -1;
+
+	return 0;
+}
+
+// The batch must give the tags and ciphertexts of the single calls
+static int
+batch_check(void)
+{
+	struct hc128_aead_record rec[BATCH];
+	uint8_t key[16], iv[BATCH][16], in[BATCH][BATCH_LEN + 30], out[BATCH][BATCH_LEN + 30];
+	uint8_t one[BATCH_LEN + 30], tag[BATCH][16], one_tag[16];
+	int i;
+
+	memset(key, 'k', sizeof(key));
+
+	for(i = 0; i < BATCH; i++) {
+		memset(iv[i], i, 16);
+		memset(in[i], i * 3, sizeof(in[i]));
+
+		rec[i].iv = iv[i];
+		rec[i].aad = in[i];
+		rec[i].aadlen = i % 20;
+		rec[i].in = in[i];
+		rec[i].len = BATCH_LEN + i % 30;
+		rec[i].out = out[i];
+		rec[i].tag = tag[i];
+	}
+
+	if(hc128_aead_seal_batch(key, rec, BATCH))
+		return -1;
+
+	for(i = 0; i < BATCH; i++) {
+		hc128_aead_seal(key, iv[i], rec[i].aad, rec[i].aadlen, in[i], rec[i].len, one, one_tag);
+
+		if(memcmp(one, out[i], rec[i].len) || memcmp(one_tag, tag[i], 16))
+			return -1;
+
+		rec[i].in = out[i];
+		rec[i].out = out[i];
+	}
+
+	tag[7][0] ^= 1;
+
+	if(!hc128_aead_open_batch(key, rec, BATCH))
+		return -1;
+
+	for(i = 0; i < BATCH; i++) {
+		if(rec[i].status != ((i == 7) ? -1 : 0))
+			return -1;
+
+		if((i != 7) && memcmp(out[i], in[i], rec[i].len))
+			return -1;
+	}
+
+	return 0;
+}
+
+// Encrypt-then-MAC in two passes
+static void
+seal_two_pass(const uint8_t *key, const uint8_t *iv, const uint8_t *in, size_t len, uint8_t *out, uint8_t *tag)
+{
+	static const uint8_t zero[16];
+	struct hc128_context ctx;
+	struct hc128_poly1305 st;
+	uint8_t block[64], lengths[16];
+	int i;
+
+	hc128_set_key_and_iv(&ctx, key, 16, iv, 16);
+	hc128_keystream(&ctx, block, sizeof(block));
+	hc128_crypt(&ctx, in, len, out);
+
+	hc128_poly1305_init(&st, block);
+	hc128_poly1305_update(&st, out, len);
+	if(len & 15)
+		hc128_poly1305_update(&st, zero, 16 - (len & 15));
+
+	memset(lengths, 0, 8);
+	for(i = 0; i < 8; i++)
+		lengths[8 + i] = (uint8_t)((uint64_t)len >> (8 * i));
+	hc128_poly1305_update(&st, lengths, sizeof(lengths));
+	hc128_poly1305_finish(&st, tag);
+}
+
+int
+main(int argc, char *argv[])
+{
+	static const size_t sizes[] = { 64, 576, 1500, 16384, 1 << 20, 16 << 20 };
+	uint8_t key[16], iv[16], tag[16], tag2[16];
+	uint8_t *in, *out;
+	size_t k, iters, max = 16 << 20;
+	int s, r;
+
+	if(poly1305_check()) {
+		printf("Poly1305 test vector failed!\n");
+		return 1;
+	}
+
+	if(kat_check()) {
+		printf("AEAD known answer failed!\n");
+		return 1;
+	}
+
+	if(batch_check()) {
+		printf("AEAD batch mismatch!\n");
+		return 1;
+	}
+
+	printf("aead check: ok\n");
+
+	if((argc > 1) && !strcmp(argv[1], "-c"))
+		return 0;
+
+	printf("\n");
+
+	memset(key, 'k', sizeof(key));
+	memset(iv, 'i', sizeof(iv));
+
+	in = xmalloc(max);
+	out = xmalloc(max);
+	memset(in, 'q', max);
+
+	seal_two_pass(key, iv, in, 1500, out, tag2);
+	hc128_aead_seal(key, iv, NULL, 0, in, 1500, out, tag);
+	if(memcmp(tag, tag2, 16)) {
+		printf("Two pass tag mismatch!\n");
+		return 1;
+	}
+
+	printf("%10s %14s %14s %10s\n", "size", "fused", "two pass", "speedup");
+
+	for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		uint64_t t, t_fused = UINT64_MAX, t_two = UINT64_MAX;
+		double bytes;
+
+		iters = (64UL << 20) / sizes[s];
+
+		// Best of the repetitions, the machine may be shared
+		for(r = 0; r < 5; r++) {
+			t = stamp();
+			for(k = 0; k < iters; k++)
+				hc128_aead_seal(key, iv, NULL, 0, in, sizes[s], out, tag);
+			t = stamp() - t;
+			if(t < t_fused)
+				t_fused = t;
+
+			t = stamp();
+			for(k = 0; k < iters; k++)
+				seal_two_pass(key, iv, in, sizes[s], out, tag);
+			t = stamp() - t;
+			if(t < t_two)
+				t_two = t;
+		}
+
+		bytes = (double)iters * sizes[s];
+
+		printf("%10zu %14.2f %14.2f %10.2f   %s\n", sizes[s], t_fused / bytes, t_two / bytes,
+		       (double)t_two / t_fused, UNIT);
+	}
+
+	free(in);
+	free(out);
+
+	return 0;
+}
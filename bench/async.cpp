@@ -0,0 +1,227 @@
+/*
+ * Benchmark of the coroutine API hc128_async.hpp in an echo workload.
+ * Every session coroutine encrypts a message on the client stream,
+ * decrypts and re-encrypts it on the server streams and decrypts the
+ * echo on the client. The same coroutines with the blocking calls of
+ * hc128::stream are the baseline.
+ * Example: ./bench/async 4
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <latch>
+#include <memory>
+#include <vector>
+
+#include "../hc128_async.hpp"
+
+#define SESSIONS	64
+#define MESSAGES	200
+#define SMALL		256
+#define LARGE		65536
+
+static double
+now()
+{
+	using namespace std::chrono;
+
+	return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Coroutine without a result, started at once
+struct detached {
+	struct promise_type {
+		detached get_return_object() { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+	};
+};
+
+struct session {
+	std::vector<std::uint8_t> msg, wire, plain;
+	std::unique_ptr<hc128::async_stream> client_tx, server_rx, server_tx, client_rx;
+	std::unique_ptr<hc128::stream> b_client_tx, b_server_rx, b_server_tx, b_client_rx;
+};
+
+static std::atomic<long> errors;
+
+// Size of the message k: mix - percent of the large messages
+static std::size_t
+message_size(int k, int mix)
+{
+	return (k % 100 < mix) ? LARGE : SMALL;
+}
+
+static detached
+echo_async(session &s, int mix, std::latch &done)
+{
+	for(int k = 0; k < MESSAGES; k++) {
+		std::size_t n = message_size(k, mix);
+		std::span<const std::uint8_t> msg(s.msg.data(), n);
+		std::span<std::uint8_t> wire(s.wire.data(), n), plain(s.plain.data(), n);
+
+		co_await hc128::encrypt_async(*s.client_tx, msg, wire);
+		co_await hc128::decrypt_async(*s.server_rx, wire, plain);
+		co_await hc128::encrypt_async(*s.server_tx, plain, wire);
+		co_await hc128::decrypt_async(*s.client_rx, wire, plain);
+
+		if(std::memcmp(s.msg.data(), s.plain.data(), n))
+			errors++;
+	}
+
+	done.count_down();
+}
+
+static detached
+echo_blocking(session &s, int mix, std::latch &done)
+{
+	for(int k = 0; k < MESSAGES; k++) {
+		std::size_t n = message_size(k, mix);
+
+		s.b_client_tx->crypt(s.msg.data(), s.wire.data(), n);
+		s.b_server_rx->crypt(s.wire.data(), s.plain.data(), n);
+		s.b_server_tx->crypt(s.plain.data(), s.wire.data(), n);
+		s.b_client_rx->crypt(s.wire.data(), s.plain.data(), n);
+
+		if(std::memcmp(s.msg.data(), s.plain.data(), n))
+			errors++;
+	}
+
+	done.count_down();
+	co_return;
+}
+
+// Cancelled operation must leave the stream position unchanged
+static detached
+check_cancel(hc128::executor &pool, bool &ok, std::latch &done)
+{
+	std::uint8_t key[16] = { 1 }, iv[16] = { 2 }, in[8192] = {}, a[8192], b[8192];
+	hc128::async_stream s(pool, key, 16, iv, 16);
+	hc128::stream ref(key, 16, iv, 16);
+	std::stop_source stop;
+
+	stop.request_stop();
+
+	hc128::status st1 = co_await hc128::encrypt_async(s, in, a, stop.get_token());
+	hc128::status st2 = co_await hc128::encrypt_async(s, std::span<const std::uint8_t>(in, 100), std::span<std::uint8_t>(a, 100), stop.get_token());
+	hc128::status st3 = co_await hc128::encrypt_async(s, in, a);
+
+	ref.keystream(b, sizeof(b));
+	ok = (st1 == hc128::status::cancelled) && (st2 == hc128::status::cancelled) &&
+	     (st3 == hc128::status::ok) && !std::memcmp(a, b, sizeof(b));
+
+	done.count_down();
+}
+
+int
+main(int argc, char *argv[])
+{
+	static const int mixes[] = { 0, 10, 100 };
+	unsigned threads = (argc > 1) ? std::atoi(argv[1]) : std::thread::hardware_concurrency();
+	std::uint8_t key[16], iv[16];
+	std::vector<session> sessions(SESSIONS);
+	hc128::executor pool(threads);
+	bool ok = false;
+
+	{
+		std::latch done(1);
+		check_cancel(pool, ok, done);
+		done.wait();
+	}
+
+	if(!ok) {
+		std::printf("Cancellation check failed!\n");
+		return 1;
+	}
+
+	// An output shorter than the input is refused, not truncated
+	try {
+		std::uint8_t in[64] = {}, out[32];
+		hc128::async_stream s(pool, in, 16, in, 16);
+
+		(void)hc128::encrypt_async(s, in, out);
+		ok = false;
+	} catch(const std::length_error &) {
+	}
+
+	if(!ok) {
+		std::printf("Short output check failed!\n");
+		return 1;
+	}
+
+	std::memset(key, 'k', sizeof(key));
+
+	for(int i = 0; i < SESSIONS; i++) {
+		session &s = sessions[i];
+
+		s.msg.resize(LARGE);
+		s.wire.resize(LARGE);
+		s.plain.resize(LARGE);
+
+		for(std::size_t j = 0; j < LARGE; j++)
+			s.msg[j] = std::uint8_t(i + j);
+	}
+
+	std::printf("workers = %u sessions = %d messages = %d small = %d large = %d\n\n",
+		    threads, SESSIONS, MESSAGES, SMALL, LARGE);
+	std::printf("%8s %16s %16s %10s\n", "large %", "blocking msg/s", "async msg/s", "speedup");
+
+	for(int mix : mixes) {
+		double t, t_blocking, t_async;
+
+		for(int i = 0; i < SESSIONS; i++) {
+			session &s = sessions[i];
+
+			std::memset(iv, i, sizeof(iv));
+
+			s.client_tx = std::make_unique<hc128::async_stream>(pool, key, 16, iv, 16);
+			s.server_rx = std::make_unique<hc128::async_stream>(pool, key, 16, iv, 16);
+			iv[15] ^= 0x80;
+			s.server_tx = std::make_unique<hc128::async_stream>(pool, key, 16, iv, 16);
+			s.client_rx = std::make_unique<hc128::async_stream>(pool, key, 16, iv, 16);
+
+			s.b_client_tx = std::make_unique<hc128::stream>(key, 16, iv, 16);
+			s.b_server_rx = std::make_unique<hc128::stream>(key, 16, iv, 16);
+			s.b_server_tx = std::make_unique<hc128::stream>(key, 16, iv, 16);
+			s.b_client_rx = std::make_unique<hc128::stream>(key, 16, iv, 16);
+		}
+
+		{
+			std::latch done(SESSIONS);
+
+			t = now();
+			for(auto &s : sessions)
+				echo_blocking(s, mix, done);
+			done.wait();
+			t_blocking = now() - t;
+		}
+
+		{
+			std::latch done(SESSIONS);
+
+			t = now();
+			for(auto &s : sessions)
+				echo_async(s, mix, done);
+			done.wait();
+			t_async = now() - t;
+		}
+
+		const double msgs = double(SESSIONS) * MESSAGES;
+
+		std::printf("%8d %16.0f %16.0f %10.2f\n", mix, msgs / t_blocking, msgs / t_async, t_blocking / t_async);
+	}
+
+	if(errors) {
+		std::printf("Echo mismatch: %ld messages!\n", errors.load());
+		return 1;
+	}
+
+	return 0;
+}
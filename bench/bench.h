@@ -0,0 +1,64 @@
+/*
+ * Helpers shared by the benchmarks: the monotonic clock in nanoseconds
+ * and the latency histogram with 16 linear buckets per power of two.
+*/
+
+#ifndef HC128_BENCH_H
+#define HC128_BENCH_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define HIST_BUCKETS	1024
+
+static inline uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Bucket of the value v
+static inline int
+hist_bucket(uint64_t v)
+{
+	int e;
+
+	if(v < 16)
+		return v;
+
+	e = 63 - __builtin_clzll(v);
+
+	return (e - 3) * 16 + ((v >> (e - 4)) & 15);
+}
+
+// Lowest value of the bucket i
+static inline uint64_t
+hist_value(int i)
+{
+	if(i < 16)
+		return i;
+
+	return (uint64_t)(16 + i % 16) << (i / 16 - 1);
+}
+
+// Value below which the share p of the total count lies
+static inline uint64_t
+hist_percentile(const uint64_t *hist, uint64_t total, double p)
+{
+	uint64_t sum = 0, want = total * p;
+	int i;
+
+	for(i = 0; i < HIST_BUCKETS; i++) {
+		sum += hist[i];
+		if(sum > want)
+			return hist_value(i);
+	}
+
+	return 0;
+}
+
+#endif
@@ -0,0 +1,141 @@
+/*
+ * Benchmark of the scatter/gather crypt hc128_cryptv().
+ * Messages are chains of 5..20 fragments (header, payload slices, trailer).
+ * Compared with the linearization: gather into a buffer, hc128_crypt(),
+ * scatter back into the output fragments.
+ * Example: ./bench/cryptv
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/uio.h>
+
+#include "../hc128.h"
+
+#define MAX_FRAGS	20
+#define MAX_MSG		65536
+
+static uint8_t msg_in[MAX_MSG];
+static uint8_t msg_out[MAX_MSG];
+static uint8_t linear[MAX_MSG];
+static uint8_t linear_out[MAX_MSG];
+static uint8_t check[MAX_MSG];
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Split the message into nfrags fragments: 14-byte header, slices, 16-byte trailer
+static void
+make_chain(uint8_t *base, size_t len, int nfrags, struct iovec *iov)
+{
+	size_t offset, slice;
+	int i;
+
+	iov[0].iov_base = base;
+	iov[0].iov_len = 14;
+	offset = 14;
+
+	slice = (len - 14 - 16) / (nfrags - 2);
+
+	for(i = 1; i < nfrags - 1; i++) {
+		// Odd slice lengths, so the fragments are not block aligned
+		iov[i].iov_base = base + offset;
+		iov[i].iov_len = (i == nfrags - 2) ? (len - 16 - offset) : (slice + (i & 1) * 3 - 1);
+		offset += iov[i].iov_len;
+	}
+
+	iov[nfrags - 1].iov_base = base + offset;
+	iov[nfrags - 1].iov_len = 16;
+}
+
+// Linearization: gather, crypt, scatter
+static void
+crypt_linear(struct hc128_context *ctx, const struct iovec *in, struct iovec *out, int n)
+{
+	size_t offset = 0;
+	int i;
+
+	for(i = 0; i < n; i++) {
+		memcpy(linear + offset, in[i].iov_base, in[i].iov_len);
+		offset += in[i].iov_len;
+	}
+
+	hc128_crypt(ctx, linear, offset, linear_out);
+
+	for(i = 0, offset = 0; i < n; i++) {
+		memcpy(out[i].iov_base, linear_out + offset, out[i].iov_len);
+		offset += out[i].iov_len;
+	}
+}
+
+int
+main(void)
+{
+	static const size_t sizes[] = { 576, 1500, 16384, 65536 };
+	static const int frags[] = { 5, 10, 20 };
+	struct iovec in[MAX_FRAGS], out[MAX_FRAGS];
+	struct hc128_context ctx1, ctx2;
+	uint8_t key[16], iv[16];
+	double t, t_linear, t_vector;
+	long iters, k;
+	unsigned int i, j;
+
+	memset(key, 'k', sizeof(key));
+	memset(iv, 'i', sizeof(iv));
+
+	for(i = 0; i < MAX_MSG; i++)
+		msg_in[i] = (uint8_t)(i * 31 + 7);
+
+	printf("%8s %6s %14s %14s %8s\n", "size", "frags", "linear GB/s", "cryptv GB/s", "speedup");
+
+	for(i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		for(j = 0; j < sizeof(frags) / sizeof(frags[0]); j++) {
+			make_chain(msg_in, sizes[i], frags[j], in);
+			make_chain(msg_out, sizes[i], frags[j], out);
+
+			// Both ways must produce the same continuous keystream
+			hc128_set_key_and_iv(&ctx1, key, 16, iv, 16);
+			hc128_set_key_and_iv(&ctx2, key, 16, iv, 16);
+
+			for(k = 0; k < 3; k++) {
+				crypt_linear(&ctx1, in, out, frags[j]);
+				memcpy(check, msg_out, sizes[i]);
+				hc128_cryptv(&ctx2, in, frags[j], out, frags[j]);
+
+				if(memcmp(check, msg_out, sizes[i])) {
+					printf("Mismatch: size = %zu frags = %d\n", sizes[i], frags[j]);
+					return 1;
+				}
+			}
+
+			iters = (256L << 20) / sizes[i];
+
+			t = now();
+			for(k = 0; k < iters; k++)
+				crypt_linear(&ctx1, in, out, frags[j]);
+			t_linear = now() - t;
+
+			t = now();
+			for(k = 0; k < iters; k++)
+				hc128_cryptv(&ctx2, in, frags[j], out, frags[j]);
+			t_vector = now() - t;
+
+			printf("%8zu %6d %14.3f %14.3f %8.2f\n", sizes[i], frags[j],
+			       iters * sizes[i] / t_linear / 1e9,
+			       iters * sizes[i] / t_vector / 1e9,
+			       t_linear / t_vector);
+		}
+	}
+
+	return 0;
+}
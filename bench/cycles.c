@@ -0,0 +1,927 @@
+/*
+ * ECRYPT-style speed suite: hc128.c kernels, the C++ engine hc128::stream
+ * (through the shim cycles_stream.cpp) and the ECRYPT reference
+ * hc128_sources/hc-128.c, built with the same flags and measured under the
+ * same conditions (pinned CPU, warmup, repetitions, median and MAD).
+ * Tests:
+ * stream - long stream, a 4 KB buffer crypted again and again, cycles/byte
+ * 40, 576, 1500 - packets, IV setup and crypt of every packet, cycles/byte
+ * keysetup, ivsetup - cycles per call; hc128.c has no key schedule of its
+ * own, its ivsetup is hc128_set_key_and_iv(), the ivsetup of hc128::stream
+ * is the construction of a new stream
+ * The ticks are rdtsc on x86, nanoseconds of CLOCK_MONOTONIC elsewhere.
+ * The hardware counters (perf_event_open) of the repetitions are printed per
+ * byte and per call: cycles, instructions, L1D misses, branch misses and, on
+ * Intel, store forwarding blocks and memory ordering machine clears.
+ * Counters the kernel or the CPU do not give are left out.
+ * -j file writes the results as JSON, -b file compares them with such a
+ * baseline (-b can be repeated for several runs of the baseline): a median
+ * above the baseline by more than the tolerance (-t percent) and by more
+ * than NOISE_K sigmas (1.4826 MAD) in the run and in -a rechecks of the
+ * cell is a regression, the exit code is then 2.
+ * Every repetition is followed by a fixed piece of work (keystream of the
+ * reference on its own context); the median of its ticks over the run
+ * follows the core clock, the baseline is scaled by the calibration of both
+ * runs before the comparison.
+ * Example: ./bench/cycles -c 0 -r 31 -w 5 -j now.json -b base1.json -b base2.json
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#include <cpuid.h>
+#define TICKS_UNIT	"cycles"
+#else
+#define TICKS_UNIT	"ns"
+#endif
+
+#include "../hc128.h"
+#include "../hc128_sources/ecrypt-sync.h"
+
+#define STREAM_BYTES	4096
+#define STREAM_ITERS	64
+#define CALL_ITERS	64
+#define MAX_REPS	1000
+#define NOISE_K		3
+#define MAX_BASELINES	16
+#define CALIB_BYTES	16384
+
+enum {
+	T_STREAM,
+	T_40,
+	T_576,
+	T_1500,
+	T_KEYSETUP,
+	T_IVSETUP,
+	TESTS
+};
+
+enum {
+	C_CYCLES,
+	C_INSTRUCTIONS,
+	C_L1D_MISSES,
+	C_BRANCH_MISSES,
+	C_STORE_FORWARD,
+	C_MEMORY_ORDERING,
+	COUNTERS
+};
+
+static const char *test_name[TESTS] = { "stream", "40", "576", "1500", "keysetup", "ivsetup" };
+static const uint32_t test_len[TESTS] = { STREAM_BYTES, 40, 576, 1500, 0, 0 };
+static const char *counter_name[COUNTERS] = { "cycles", "instr", "L1D miss", "br miss", "st-fwd blk", "mo clear" };
+static const char *counter_key[COUNTERS] = {
+	"cycles", "instructions", "l1d_misses", "branch_misses", "store_forward_blocks", "memory_ordering_clears"
+};
+
+/*
+ * Kernel under test, NULL for the tests it has no meaning for
+ * stream - crypt of the next len bytes of the stream
+ * packet - new IV and crypt of len bytes
+*/
+struct kernel {
+	const char *name;
+	void (*stream)(uint8_t *buf, uint32_t len);
+	void (*packet)(const uint8_t *iv, uint8_t *buf, uint32_t len);
+	void (*keysetup)(void);
+	void (*ivsetup)(const uint8_t *iv);
+};
+
+/*
+ * Median and median absolute deviation of the samples
+ * calib - median ticks per byte of the calibration work
+ * counter - per byte or per call over all the repetitions, < 0 if not counted
+*/
+struct result {
+	double median;
+	double mad;
+	double calib;
+	double counter[COUNTERS];
+};
+
+/*
+ * Counter group, the first open counter is the leader
+ * fd - descriptor of the counter, -1 if it is not available
+ * slot - place of the counter in the group read
+*/
+struct counters {
+	int leader;
+	int n;
+	int fd[COUNTERS];
+	int slot[COUNTERS];
+};
+
+static const uint8_t key[16] = "cycles key 16 b!";
+static const uint8_t iv0[16] = "cycles iv 16 b!!";
+
+static struct hc128_context ctx;
+static ECRYPT_ctx ectx;
+
+// hc128::stream of cycles_stream.cpp
+void cycles_stream_setup(const uint8_t *key, const uint8_t *iv);
+void cycles_stream_crypt(uint8_t *buf, uint32_t len);
+
+static uint8_t buf[STREAM_BYTES];
+
+static struct counters pmu = { .leader = -1 };
+
+static ECRYPT_ctx calib_ctx;
+static uint8_t calib_buf[CALIB_BYTES];
+
+static inline uint64_t
+ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	uint64_t t;
+
+	_mm_lfence();
+	t = __rdtsc();
+	_mm_lfence();
+
+	return t;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static int
+counter_open(struct perf_event_attr *attr, int group)
+{
+	return syscall(__NR_perf_event_open, attr, 0, -1, group, 0);
+}
+
+// Intel raw events of the store forwarding blocks and memory ordering clears
+static int
+is_intel(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned int a, b, c, d;
+
+	if(!__get_cpuid(0, &a, &b, &c, &d))
+		return 0;
+
+	return (b == 0x756e6547) && (d == 0x49656e69) && (c == 0x6c65746e);
+#else
+	return 0;
+#endif
+}
+
+/*
+ * Open the counters of this thread, user space only.
+ * Return value: number of the counters, 0 if none (errno tells why)
+*/
+static int
+counters_open(struct counters *c)
+{
+	static const uint32_t type[COUNTERS] = {
+		PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+		PERF_TYPE_HARDWARE, PERF_TYPE_RAW, PERF_TYPE_RAW
+	};
+	static const uint64_t config[COUNTERS] = {
+		PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+		PERF_COUNT_HW_BRANCH_MISSES,
+		0x0203,		// LD_BLOCKS.STORE_FORWARD
+		0x02c3		// MACHINE_CLEARS.MEMORY_ORDERING
+	};
+	struct perf_event_attr attr;
+	int i, err = 0, intel = is_intel();
+
+	c->leader = -1;
+	c->n = 0;
+
+	for(i = 0; i < COUNTERS; i++) {
+		c->fd[i] = -1;
+
+		if((type[i] == PERF_TYPE_RAW) && !intel)
+			continue;
+
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = type[i];
+		attr.config = config[i];
+		attr.disabled = (c->leader < 0);
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+		if((c->fd[i] = counter_open(&attr, c->leader)) < 0) {
+			if(!err)
+				err = errno;
+			continue;
+		}
+
+		if(c->leader < 0)
+			c->leader = c->fd[i];
+
+		c->slot[i] = c->n++;
+	}
+
+	errno = err;
+
+	return c->n;
+}
+
+static void
+counters_close(struct counters *c)
+{
+	int i;
+
+	for(i = 0; i < COUNTERS; i++)
+		if(c->fd[i] >= 0)
+			close(c->fd[i]);
+
+	c->leader = -1;
+	c->n = 0;
+}
+
+static inline void
+counters_ioctl(const struct counters *c, unsigned long request)
+{
+	if(c->leader >= 0)
+		ioctl(c->leader, request, PERF_IOC_FLAG_GROUP);
+}
+
+// Counts scaled for the multiplexing, divided by units; -1 if not counted
+static void
+counters_read(const struct counters *c, double units, double *out)
+{
+	uint64_t v[3 + COUNTERS];
+	double scale = 0;
+	int i;
+
+	for(i = 0; i < COUNTERS; i++)
+		out[i] = -1;
+
+	if((c->leader < 0) || (read(c->leader, v, sizeof(v)) < (ssize_t)((3 + c->n) * sizeof(v[0]))) || !v[2])
+		return;
+
+	scale = (double)v[1] / v[2];
+
+	for(i = 0; i < COUNTERS; i++)
+		if(c->fd[i] >= 0)
+			out[i] = v[3 + c->slot[i]] * scale / units;
+}
+
+// Fixed work: keystream of the ECRYPT reference on its own context
+static void
+calib_work(void)
+{
+	ECRYPT_keystream_bytes(&calib_ctx, calib_buf, CALIB_BYTES);
+}
+
+static void
+hc128_setup(const uint8_t *iv)
+{
+	hc128_set_key_and_iv(&ctx, key, 16, iv, 16);
+}
+
+static void
+crypt_stream(uint8_t *b, uint32_t len)
+{
+	hc128_crypt(&ctx, b, len, b);
+}
+
+static void
+crypt_packet(const uint8_t *iv, uint8_t *b, uint32_t len)
+{
+	hc128_set_key_and_iv(&ctx, key, 16, iv, 16);
+	hc128_crypt(&ctx, b, len, b);
+}
+
+static void
+bulk_stream(uint8_t *b, uint32_t len)
+{
+	hc128_crypt_bulk(&ctx, b, len, b);
+}
+
+static void
+bulk_packet(const uint8_t *iv, uint8_t *b, uint32_t len)
+{
+	hc128_set_key_and_iv(&ctx, key, 16, iv, 16);
+	hc128_crypt_bulk(&ctx, b, len, b);
+}
+
+static void
+cryptv_stream(uint8_t *b, uint32_t len)
+{
+	struct iovec v = { b, len };
+
+	hc128_cryptv(&ctx, &v, 1, &v, 1);
+}
+
+static void
+cryptv_packet(const uint8_t *iv, uint8_t *b, uint32_t len)
+{
+	struct iovec v = { b, len };
+
+	hc128_set_key_and_iv(&ctx, key, 16, iv, 16);
+	hc128_cryptv(&ctx, &v, 1, &v, 1);
+}
+
+static void
+keystream_stream(uint8_t *b, uint32_t len)
+{
+	hc128_keystream(&ctx, b, len);
+}
+
+static void
+keystream_packet(const uint8_t *iv, uint8_t *b, uint32_t len)
+{
+	hc128_set_key_and_iv(&ctx, key, 16, iv, 16);
+	hc128_keystream(&ctx, b, len);
+}
+
+// Whole blocks only, no packets
+static void
+blocks_stream(uint8_t *b, uint32_t len)
+{
+	hc128_keystream_blocks(&ctx, b, len / 64);
+}
+
+static void
+cxx_stream(uint8_t *b, uint32_t len)
+{
+	cycles_stream_crypt(b, len);
+}
+
+static void
+cxx_packet(const uint8_t *iv, uint8_t *b, uint32_t len)
+{
+	cycles_stream_setup(key, iv);
+	cycles_stream_crypt(b, len);
+}
+
+static void
+cxx_ivsetup(const uint8_t *iv)
+{
+	cycles_stream_setup(key, iv);
+}
+
+static void
+ecrypt_stream(uint8_t *b, uint32_t len)
+{
+	ECRYPT_process_bytes(0, &ectx, b, b, len);
+}
+
+static void
+ecrypt_packet(const uint8_t *iv, uint8_t *b, uint32_t len)
+{
+	ECRYPT_ivsetup(&ectx, iv);
+	ECRYPT_process_bytes(0, &ectx, b, b, len);
+}
+
+static void
+ecrypt_keysetup(void)
+{
+	ECRYPT_keysetup(&ectx, key, 128, 128);
+}
+
+static void
+ecrypt_ivsetup(const uint8_t *iv)
+{
+	ECRYPT_ivsetup(&ectx, iv);
+}
+
+static const struct kernel kernels[] = {
+	{ "hc128_crypt", crypt_stream, crypt_packet, NULL, hc128_setup },
+	{ "hc128_crypt_bulk", bulk_stream, bulk_packet, NULL, hc128_setup },
+	{ "hc128_cryptv", cryptv_stream, cryptv_packet, NULL, hc128_setup },
+	{ "hc128_keystream", keystream_stream, keystream_packet, NULL, hc128_setup },
+	{ "hc128_ks_blocks", blocks_stream, NULL, NULL, hc128_setup },
+	{ "hc128::stream", cxx_stream, cxx_packet, NULL, cxx_ivsetup },
+	{ "ecrypt-ref", ecrypt_stream, ecrypt_packet, ecrypt_keysetup, ecrypt_ivsetup },
+};
+
+#define KERNELS	(int)(sizeof(kernels) / sizeof(kernels[0]))
+
+static int
+cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+// The samples are sorted in place
+static void
+median_mad(double *s, int n, struct result *res)
+{
+	int i;
+
+	qsort(s, n, sizeof(s[0]), cmp_double);
+	res->median = (n & 1) ? s[n / 2] : (s[n / 2 - 1] + s[n / 2]) / 2;
+
+	for(i = 0; i < n; i++)
+		s[i] = (s[i] > res->median) ? s[i] - res->median : res->median - s[i];
+
+	qsort(s, n, sizeof(s[0]), cmp_double);
+	res->mad = (n & 1) ? s[n / 2] : (s[n / 2 - 1] + s[n / 2]) / 2;
+}
+
+// Both keys are set, the stream is positioned at the start
+static void
+reset(void)
+{
+	hc128_set_key_and_iv(&ctx, key, 16, iv0, 16);
+	cycles_stream_setup(key, iv0);
+	ECRYPT_keysetup(&ectx, key, 128, 128);
+	ECRYPT_ivsetup(&ectx, iv0);
+	memset(buf, 0, sizeof(buf));
+}
+
+/*
+ * One test of the kernel: warmup samples are dropped, then reps samples
+ * per byte (or per call for the setup tests).
+ * Return value: 0 (if all is well), -1 if the kernel has no such test
+*/
+static int
+measure(const struct kernel *k, int test, int warmup, int reps, struct result *res)
+{
+	static double s[MAX_REPS], cs[MAX_REPS];
+	uint32_t len = test_len[test], iters, i;
+	struct result cal;
+	uint8_t iv[16];
+	uint64_t t;
+	int r;
+
+	if(((test == T_STREAM) && !k->stream) || ((test == T_KEYSETUP) && !k->keysetup) ||
+	   ((test == T_IVSETUP) && !k->ivsetup) || (len && (test != T_STREAM) && !k->packet))
+		return -1;
+
+	reset();
+	memcpy(iv, iv0, 16);
+	counters_ioctl(&pmu, PERF_EVENT_IOC_RESET);
+
+	iters = (test == T_STREAM) ? STREAM_ITERS : CALL_ITERS;
+
+	for(r = -warmup; r < reps; r++) {
+		if(r >= 0)
+			counters_ioctl(&pmu, PERF_EVENT_IOC_ENABLE);
+
+		t = ticks();
+
+		switch(test) {
+		case T_STREAM:
+			for(i = 0; i < iters; i++)
+				k->stream(buf, len);
+			break;
+		case T_KEYSETUP:
+			for(i = 0; i < iters; i++)
+				k->keysetup();
+			break;
+		case T_IVSETUP:
+			for(i = 0; i < iters; i++) {
+				iv[0] = (uint8_t)i;
+				k->ivsetup(iv);
+			}
+			break;
+		default:
+			for(i = 0; i < iters; i++) {
+				iv[0] = (uint8_t)i;
+				k->packet(iv, buf, len);
+			}
+		}
+
+		t = ticks() - t;
+
+		if(r >= 0) {
+			counters_ioctl(&pmu, PERF_EVENT_IOC_DISABLE);
+			s[r] = (double)t / iters / (len ? len : 1);
+
+			t = ticks();
+			calib_work();
+			cs[r] = (double)(ticks() - t) / CALIB_BYTES;
+		}
+	}
+
+	median_mad(s, reps, res);
+	median_mad(cs, reps, &cal);
+	res->calib = cal.median;
+	counters_read(&pmu, (double)reps * iters * (len ? len : 1), res->counter);
+
+	return 0;
+}
+
+// All the kernels give the same bytes as hc128_crypt()
+static int
+check(void)
+{
+	uint8_t ref[1500], out[1500];
+	int i;
+
+	memset(ref, 0, sizeof(ref));
+	crypt_packet(iv0, ref, sizeof(ref));
+
+	for(i = 0; i < KERNELS; i++) {
+		reset();
+		memset(out, 0, sizeof(out));
+
+		if(kernels[i].packet)
+			kernels[i].packet(iv0, out, sizeof(out));
+		else
+			kernels[i].stream(out, sizeof(out) & ~63);
+
+		if(memcmp(out, ref, kernels[i].packet ? sizeof(out) : (sizeof(out) & ~63))) {
+			printf("%s: output mismatch!\n", kernels[i].name);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+// Pin to the CPU, the CPU we run on if cpu < 0
+static int
+pin(int cpu)
+{
+	cpu_set_t set;
+
+	if(cpu < 0)
+		cpu = sched_getcpu();
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+
+	if(sched_setaffinity(0, sizeof(set), &set))
+		return -1;
+
+	return cpu;
+}
+
+static const char *
+test_unit(int test)
+{
+	return test_len[test] ? TICKS_UNIT "/byte" : TICKS_UNIT "/call";
+}
+
+static void
+print_counters(struct result res[][TESTS], int done[][TESTS])
+{
+	int i, t, c;
+
+	printf("\nhardware counters per byte (per call for the setups)\n%-18s %-10s", "", "test");
+	for(c = 0; c < COUNTERS; c++)
+		printf(" %12s", counter_name[c]);
+	printf("\n");
+
+	for(i = 0; i < KERNELS; i++) {
+		for(t = 0; t < TESTS; t++) {
+			if(!done[i][t])
+				continue;
+
+			printf("%-18s %-10s", kernels[i].name, test_name[t]);
+
+			for(c = 0; c < COUNTERS; c++) {
+				if(res[i][t].counter[c] < 0)
+					printf(" %12s", "-");
+				else
+					printf(" %12.4g", res[i][t].counter[c]);
+			}
+
+			printf("\n");
+		}
+	}
+}
+
+/*
+ * Results as JSON, one result object per line.
+ * Return value: 0 (if all is well), -1 if all bad
+*/
+static int
+write_json(const char *path, int cpu, int reps, int warmup, double calib, struct result res[][TESTS], int done[][TESTS])
+{
+	FILE *f = fopen(path, "w");
+	char host[256];
+	const char *sep = "";
+	int i, t, c, n;
+
+	if(!f)
+		return -1;
+
+	if(gethostname(host, sizeof(host)))
+		strcpy(host, "unknown");
+	host[sizeof(host) - 1] = 0;
+
+	fprintf(f, "{\n  \"host\": \"%s\",\n  \"compiler\": \"%s\",\n  \"timer\": \"%s\",\n", host, __VERSION__,
+		TICKS_UNIT);
+	fprintf(f, "  \"cpu\": %d,\n  \"repetitions\": %d,\n  \"warmup\": %d,\n  \"calib\": %.6g,\n  \"results\": [", cpu,
+		reps, warmup, calib);
+
+	for(i = 0; i < KERNELS; i++) {
+		for(t = 0; t < TESTS; t++) {
+			if(!done[i][t])
+				continue;
+
+			fprintf(f, "%s\n    {\"kernel\": \"%s\", \"test\": \"%s\", \"unit\": \"%s\", \"median\": %.6g, \"mad\": %.6g, \"counters\": {",
+				sep, kernels[i].name, test_name[t], test_unit(t), res[i][t].median, res[i][t].mad);
+
+			for(c = 0, n = 0; c < COUNTERS; c++)
+				if(res[i][t].counter[c] >= 0)
+					fprintf(f, "%s\"%s\": %.6g", n++ ? ", " : "", counter_key[c], res[i][t].counter[c]);
+
+			fprintf(f, "}}");
+			sep = ",";
+		}
+	}
+
+	fprintf(f, "\n  ]\n}\n");
+
+	return fclose(f) ? -1 : 0;
+}
+
+static int
+find_result(const char *kernel, const char *test, int *i, int *t)
+{
+	for(*i = 0; *i < KERNELS; (*i)++)
+		if(!strcmp(kernels[*i].name, kernel))
+			break;
+
+	for(*t = 0; *t < TESTS; (*t)++)
+		if(!strcmp(test_name[*t], test))
+			break;
+
+	return ((*i < KERNELS) && (*t < TESTS)) ? 0 : -1;
+}
+
+/*
+ * Range of a cell over the baseline runs, at the core clock of this run
+ * lo, hi - lowest and highest median, mad - largest MAD
+*/
+struct base {
+	int n;
+	double lo;
+	double hi;
+	double mad;
+};
+
+/*
+ * Add one baseline run written by write_json() to the ranges.
+ * Return value: 0 (if all is well), -1 if all bad
+*/
+static int
+load_baseline(const char *path, double calib, struct base b[][TESTS])
+{
+	FILE *f = fopen(path, "r");
+	char line[1024], kernel[64], test[16], unit[32];
+	double median, mad, scale = 0, c;
+	int i, t;
+
+	if(!f)
+		return -1;
+
+	while(fgets(line, sizeof(line), f)) {
+		if((sscanf(line, " \"calib\": %lf", &c) == 1) && (c > 0))
+			scale = calib / c;
+
+		if(sscanf(line, " {\"kernel\": \"%63[^\"]\", \"test\": \"%15[^\"]\", \"unit\": \"%31[^\"]\", \"median\": %lf, \"mad\": %lf",
+			  kernel, test, unit, &median, &mad) != 5)
+			continue;
+
+		if(!scale || find_result(kernel, test, &i, &t) || strcmp(unit, test_unit(t)) || (median <= 0))
+			continue;
+
+		median *= scale;
+		mad *= scale;
+
+		if(!b[i][t].n++) {
+			b[i][t].lo = b[i][t].hi = median;
+			b[i][t].mad = mad;
+			continue;
+		}
+
+		if(median < b[i][t].lo)
+			b[i][t].lo = median;
+		if(median > b[i][t].hi)
+			b[i][t].hi = median;
+		if(mad > b[i][t].mad)
+			b[i][t].mad = mad;
+	}
+
+	fclose(f);
+
+	return scale ? 0 : -1;
+}
+
+// Out of the range by more than the tolerance and the noise
+static int
+out_of_range(double now, double mad, double base, double base_mad, double tol)
+{
+	double d = now - base, noise = NOISE_K * 1.4826;
+
+	noise *= noise * (mad * mad + base_mad * base_mad);
+
+	return (d * d > tol * tol * base * base) && (d * d > noise);
+}
+
+/*
+ * Compare with the baseline runs, print the cells out of their range.
+ * Several runs of the baseline give the spread of the host from run to run:
+ * slower is above the highest median, faster below the lowest one.
+ * A slower cell is measured again up to rechecks times and stays slower only
+ * if it is slower every time, a burst of noise on the host does not fail.
+ * tol - tolerance, fraction of the baseline median
+ * Return value: number of the regressions, -1 if the baseline is not usable
+*/
+static int
+compare(const char **path, int np, double tol, double calib, int rechecks, int warmup, int reps,
+	struct result res[][TESTS], int done[][TESTS])
+{
+	static struct base b[KERNELS][TESTS];
+	struct result again;
+	int i, t, r, n = 0, slower = 0, faster = 0;
+	double now, mad;
+
+	for(i = 0; i < np; i++) {
+		if(load_baseline(path[i], calib, b))
+			return -1;
+	}
+
+	printf("\nbaseline of %d runs (%s...), tolerance %.0f%%, %d sigmas, %d rechecks\n", np, path[0], tol * 100,
+	       NOISE_K, rechecks);
+	printf("%-18s %-10s %12s %12s %12s %8s\n", "", "test", "lowest", "highest", "now", "change");
+
+	for(i = 0; i < KERNELS; i++) {
+		for(t = 0; t < TESTS; t++) {
+			if(!done[i][t] || !b[i][t].n)
+				continue;
+
+			n++;
+			now = res[i][t].median;
+			mad = res[i][t].mad;
+
+			for(r = 0; (r < rechecks) && (now > b[i][t].hi) && out_of_range(now, mad, b[i][t].hi, b[i][t].mad, tol); r++) {
+				measure(&kernels[i], t, warmup, reps, &again);
+				now = again.median;
+				mad = again.mad;
+			}
+
+			if((now > b[i][t].hi) && out_of_range(now, mad, b[i][t].hi, b[i][t].mad, tol)) {
+				printf("%-18s %-10s %12.4g %12.4g %12.4g %+7.1f%% SLOWER\n", kernels[i].name, test_name[t],
+				       b[i][t].lo, b[i][t].hi, now, 100 * (now - b[i][t].hi) / b[i][t].hi);
+				slower++;
+			} else if((now < b[i][t].lo) && out_of_range(now, mad, b[i][t].lo, b[i][t].mad, tol)) {
+				printf("%-18s %-10s %12.4g %12.4g %12.4g %+7.1f%% faster\n", kernels[i].name, test_name[t],
+				       b[i][t].lo, b[i][t].hi, now, 100 * (now - b[i][t].lo) / b[i][t].lo);
+				faster++;
+			}
+		}
+	}
+
+	if(!n)
+		return -1;
+
+	printf("%d compared: %d within the noise, %d slower, %d faster\n", n, n - slower - faster, slower, faster);
+
+	return slower;
+}
+
+// Median of the calibrations of all the tests
+static double
+run_calib(struct result res[][TESTS], int done[][TESTS])
+{
+	static double s[KERNELS * TESTS];
+	struct result r;
+	int i, t, n = 0;
+
+	for(i = 0; i < KERNELS; i++)
+		for(t = 0; t < TESTS; t++)
+			if(done[i][t])
+				s[n++] = res[i][t].calib;
+
+	median_mad(s, n, &r);
+
+	return r.median;
+}
+
+int
+main(int argc, char *argv[])
+{
+	static struct result res[KERNELS][TESTS];
+	static int done[KERNELS][TESTS];
+	int cpu = -1, reps = 31, warmup = 5, rechecks = 2, nb = 0, opt, i, t, slower = 0;
+	double calib;
+	const char *json = NULL, *baseline[MAX_BASELINES];
+	double tol = 0.1;
+	char cell[32];
+
+	while((opt = getopt(argc, argv, "c:r:w:j:b:t:a:")) != -1) {
+		switch(opt) {
+		case 'c':
+			cpu = atoi(optarg);
+			break;
+		case 'r':
+			reps = atoi(optarg);
+			break;
+		case 'w':
+			warmup = atoi(optarg);
+			break;
+		case 'j':
+			json = optarg;
+			break;
+		case 'b':
+			if(nb == MAX_BASELINES) {
+				printf("Too many baselines!\n");
+				return 1;
+			}
+			baseline[nb++] = optarg;
+			break;
+		case 't':
+			tol = atof(optarg) / 100;
+			break;
+		case 'a':
+			rechecks = atoi(optarg);
+			break;
+		default:
+			printf("Usage: %s [-c cpu] [-r repetitions] [-w warmup] [-j json] [-b baseline json]... [-t tolerance %%] [-a rechecks]\n",
+			       argv[0]);
+			return 1;
+		}
+	}
+
+	if((reps < 1) || (reps > MAX_REPS) || (warmup < 0)) {
+		printf("Repetitions 1..%d, warmup >= 0!\n", MAX_REPS);
+		return 1;
+	}
+
+	ECRYPT_init();
+	ECRYPT_keysetup(&calib_ctx, key, 128, 128);
+	ECRYPT_ivsetup(&calib_ctx, iv0);
+
+	if(check())
+		return 1;
+
+	if((cpu = pin(cpu)) < 0) {
+		printf("CPU pinning error!\n");
+		return 1;
+	}
+
+	if(!counters_open(&pmu))
+		printf("hardware counters not available: %s\n", strerror(errno));
+
+	printf("cpu = %d repetitions = %d warmup = %d, median (MAD)\n", cpu, reps, warmup);
+	printf("%-18s", "");
+	for(t = 0; t < TESTS; t++)
+		printf(" %16s", test_name[t]);
+	printf("\n%-18s", "");
+	for(t = 0; t < TESTS; t++)
+		printf(" %16s", test_len[t] ? TICKS_UNIT "/byte" : TICKS_UNIT "/call");
+	printf("\n");
+
+	for(i = 0; i < KERNELS; i++) {
+		printf("%-18s", kernels[i].name);
+
+		for(t = 0; t < TESTS; t++) {
+			done[i][t] = !measure(&kernels[i], t, warmup, reps, &res[i][t]);
+
+			if(!done[i][t])
+				snprintf(cell, sizeof(cell), "-");
+			else if(test_len[t])
+				snprintf(cell, sizeof(cell), "%.2f (%.2f)", res[i][t].median, res[i][t].mad);
+			else
+				snprintf(cell, sizeof(cell), "%.0f (%.0f)", res[i][t].median, res[i][t].mad);
+
+			printf(" %16s", cell);
+			fflush(stdout);
+		}
+
+		printf("\n");
+	}
+
+	if(pmu.n)
+		print_counters(res, done);
+
+	counters_close(&pmu);
+
+	calib = run_calib(res, done);
+	printf("\ncalibration: %.3f %s/byte of the reference keystream\n", calib, TICKS_UNIT);
+
+	if(json && write_json(json, cpu, reps, warmup, calib, res, done)) {
+		printf("JSON write error!\n");
+		return 1;
+	}
+
+	if(nb && ((slower = compare(baseline, nb, tol, calib, rechecks, warmup, reps, res, done)) < 0)) {
+		printf("Baseline read error!\n");
+		return 1;
+	}
+
+	return slower ? 2 : 0;
+}
@@ -0,0 +1,34 @@
+/*
+ * The header-only engine hc128::stream (hc128.hpp) for the speed suite
+ * bench/cycles.c, which is C: one stream behind two C entries. A setup is
+ * the construction of a new stream, as a user of the class does it (the
+ * state is allocated, the old one is wiped and freed).
+*/
+
+#include <cstdint>
+#include <optional>
+
+#include "../hc128.hpp"
+
+extern "C" {
+
+void cycles_stream_setup(const std::uint8_t *key, const std::uint8_t *iv);
+
+void cycles_stream_crypt(std::uint8_t *buf, std::uint32_t len);
+
+}
+
+static std::optional<hc128::stream> s;
+
+void
+cycles_stream_setup(const std::uint8_t *key, const std::uint8_t *iv)
+{
+	s.emplace(key, 16, iv, 16);
+}
+
+// In place, the sink of the other kernels of the suite
+void
+cycles_stream_crypt(std::uint8_t *buf, std::uint32_t len)
+{
+	s->crypt(buf, len);
+}
@@ -0,0 +1,250 @@
+/*
+ * Benchmark of the families of random streams.
+ * First the reproducibility is checked: fixed seeds give the known numbers,
+ * batched and single stream fills agree, and the output does not depend
+ * on the number of threads. Then every thread fills arrays of doubles
+ * for its own streams, for 1, 2, 4 ... threads.
+ * Example: ./bench/family 8
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "../hc128.h"
+#include "../hc128_family.h"
+
+#define STREAMS		64
+#define LEN		(1 << 16)
+#define ROUNDS		8
+
+struct worker {
+	pthread_t tid;
+	const struct hc128_family *family;
+	int first;
+	int count;
+};
+
+// Hash of the output of every stream
+static uint64_t stream_hash[STREAMS];
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Allocates memory
+static void *
+xmalloc(size_t size)
+{
+	void *p = malloc(size);
+
+	if(p == NULL) {
+		printf("Allocates memory error!\n");
+		exit(1);
+	}
+	else
+		return p;
+}
+
+static uint64_t
+hash_doubles(uint64_t h, const double *d, size_t len)
+{
+	uint64_t v;
+	size_t i;
+
+	for(i = 0; i < len; i++) {
+		memcpy(&v, &d[i], sizeof(v));
+		h = (h ^ v) * 0x100000001b3ULL;
+	}
+
+	return h;
+}
+
+// Fill ROUNDS arrays for the streams of the worker
+static void *
+worker_run(void *arg)
+{
+	struct worker *w = arg;
+	struct hc128_context *ctx[STREAMS];
+	double *dst[STREAMS];
+	int i, r;
+
+	for(i = 0; i < w->count; i++) {
+		ctx[i] = xmalloc(sizeof(struct hc128_context));
+		dst[i] = xmalloc(sizeof(double) * LEN);
+		stream_hash[w->first + i] = 0xcbf29ce484222325ULL;
+	}
+
+	hc128_family_streams(w->family, w->first, ctx, w->count);
+
+	for(r = 0; r < ROUNDS; r++) {
+		hc128_fill_double(ctx, w->count, dst, LEN);
+
+		for(i = 0; i < w->count; i++)
+			stream_hash[w->first + i] = hash_doubles(stream_hash[w->first + i], dst[i], LEN);
+	}
+
+	for(i = 0; i < w->count; i++) {
+		free(ctx[i]);
+		free(dst[i]);
+	}
+
+	return NULL;
+}
+
+// STREAMS streams on the threads, return the combined hash of the outputs
+static uint64_t
+run(const struct hc128_family *family, int threads, double *sec)
+{
+	struct worker w[STREAMS];
+	uint64_t h = 0;
+	double t;
+	int i, per;
+
+	per = STREAMS / threads;
+	t = now();
+
+	for(i = 0; i < threads; i++) {
+		w[i].family = family;
+		w[i].first = i * per;
+		w[i].count = per;
+
+		if(pthread_create(&w[i].tid, NULL, worker_run, &w[i])) {
+			printf("Error create thread!\n");
+			exit(1);
+		}
+	}
+
+	for(i = 0; i < threads; i++)
+		pthread_join(w[i].tid, NULL);
+
+	*sec = now() - t;
+
+	for(i = 0; i < STREAMS; i++)
+		h = (h ^ stream_hash[i]) * 0x100000001b3ULL;
+
+	return h;
+}
+
+// Known first numbers of the streams 0 and 1 of the seed 42
+static int
+check_known(void)
+{
+	static const uint64_t known[2][2] = {
+		{ 0xf8a0ea4d60d62d9aULL, 0x9c424dd82fb0f06dULL },
+		{ 0xc6230e07fe94806dULL, 0xa30dfa8e9f3800afULL }
+	};
+	struct hc128_family family;
+	struct hc128_context c, *ctx = &c;
+	uint64_t v[2], *dst = v;
+	int i, bad = 0;
+
+	hc128_family_init(&family, 42);
+
+	for(i = 0; i < 2; i++) {
+		hc128_family_stream(&family, i, &c);
+		hc128_fill_u64(&ctx, 1, &dst, 2);
+
+		printf("seed 42 stream %d: %016llx %016llx\n", i,
+		       (unsigned long long)v[0], (unsigned long long)v[1]);
+
+		if((v[0] != known[i][0]) || (v[1] != known[i][1]))
+			bad = 1;
+	}
+
+	return bad;
+}
+
+// Batched fills must equal the single stream fills with odd lengths
+static int
+check_batched(void)
+{
+	struct hc128_family family;
+	struct hc128_context *ctx[12], single;
+	struct hc128_context *one = &single;
+	uint32_t *a[12], *b;
+	int i, bad = 0;
+
+	hc128_family_init(&family, 7);
+
+	b = xmalloc(sizeof(uint32_t) * 1001);
+
+	for(i = 0; i < 12; i++) {
+		ctx[i] = xmalloc(sizeof(struct hc128_context));
+		a[i] = xmalloc(sizeof(uint32_t) * 1001);
+	}
+
+	hc128_family_streams(&family, 100, ctx, 12);
+	hc128_fill_u32(ctx, 12, a, 3);
+	for(i = 0; i < 12; i++)
+		a[i] += 3;
+	hc128_fill_u32(ctx, 12, a, 998);
+	for(i = 0; i < 12; i++)
+		a[i] -= 3;
+
+	for(i = 0; i < 12; i++) {
+		hc128_family_stream(&family, 100 + i, &single);
+		hc128_fill_u32(&one, 1, &b, 1001);
+
+		if(memcmp(a[i], b, sizeof(uint32_t) * 1001))
+			bad = 1;
+
+		free(ctx[i]);
+		free(a[i]);
+	}
+
+	free(b);
+
+	return bad;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct hc128_family family;
+	uint64_t h, h1 = 0;
+	double sec, sec1 = 0, gb;
+	int threads, max;
+
+	max = (argc > 1) ? atoi(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+	if((max < 1) || (max > STREAMS))
+		max = 1;
+
+	if(check_known() || check_batched()) {
+		printf("Reproducibility check failed!\n");
+		return 1;
+	}
+
+	printf("reproducibility: ok\n\n");
+	printf("%8s %10s %10s %10s\n", "threads", "GB/s", "speedup", "efficiency");
+
+	hc128_family_init(&family, 1);
+	gb = (double)STREAMS * LEN * ROUNDS * sizeof(double) / 1e9;
+
+	for(threads = 1; threads <= max; threads *= 2) {
+		h = run(&family, threads, &sec);
+
+		if(threads == 1) {
+			h1 = h;
+			sec1 = sec;
+		}
+		else if(h != h1) {
+			printf("Output depends on the number of threads!\n");
+			return 1;
+		}
+
+		printf("%8d %10.3f %10.2f %10.2f\n", threads, gb / sec, sec1 / sec, sec1 / sec / threads);
+	}
+
+	return 0;
+}
@@ -0,0 +1,199 @@
+/*
+ * Benchmark of the fan-out crypt hc128_crypt_fanout().
+ * One payload is encrypted for n subscribers, compared with n independent
+ * hc128_crypt() calls. The plaintext traffic of the independent calls is
+ * n * size bytes, of the fan-out size bytes; the saved traffic is printed
+ * with the measured rates. The outputs are checked against hc128_crypt(),
+ * with subscribers at different keystream positions. -c runs only the
+ * check.
+ * Example: ./bench/fanout
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "../hc128.h"
+
+#define MAX_SUBS	256
+#define TOTAL		(256UL << 20)
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *
+xmalloc(size_t size)
+{
+	void *p = malloc(size);
+
+	if(!p) {
+		printf("malloc error!\n");
+		exit(1);
+	}
+
+	return p;
+}
+
+static void
+setup(struct hc128_context *ctx, int n, const uint8_t *key)
+{
+	uint8_t iv[16];
+	int j;
+
+	for(j = 0; j < n; j++) {
+		memset(iv, 0, sizeof(iv));
+		memcpy(iv, &j, sizeof(j));
+		hc128_set_key_and_iv(&ctx[j], key, 16, iv, 16);
+	}
+}
+
+// Fan-out must give the output of hc128_crypt() for every subscriber
+static int
+check(const uint8_t *key)
+{
+	static const uint32_t sizes[] = { 1, 63, 64, 100, 4096, 4097, 10000 };
+	struct hc128_context *a, *b, *pa[37];
+	uint8_t *in, *out[37], *ref, skip[64];
+	int n = 37, j, s, res = 0;
+
+	a = xmalloc(n * sizeof(*a));
+	b = xmalloc(n * sizeof(*b));
+	in = xmalloc(10000);
+	ref = xmalloc(10000);
+
+	for(j = 0; j < 10000; j++)
+		in[j] = j * 31;
+
+	setup(a, n, key);
+	setup(b, n, key);
+
+	for(j = 0; j < n; j++) {
+		pa[j] = &a[j];
+		out[j] = xmalloc(10000);
+
+		// Every third subscriber is not block aligned
+		if(j % 3 == 0) {
+			hc128_keystream(&a[j], skip, j % 64);
+			hc128_keystream(&b[j], skip, j % 64);
+		}
+	}
+
+	for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		hc128_crypt_fanout(pa, n, in, sizes[s], out);
+
+		for(j = 0; j < n; j++) {
+			hc128_crypt(&b[j], in, sizes[s], ref);
+
+			if(memcmp(ref, out[j], sizes[s]))
+				res = -1;
+		}
+	}
+
+	for(j = 0; j < n; j++)
+		free(out[j]);
+
+	free(a);
+	free(b);
+	free(in);
+	free(ref);
+
+	return res;
+}
+
+int
+main(int argc, char *argv[])
+{
+	static const int subs[] = { 1, 4, 16, 64, 256 };
+	static const uint32_t sizes[] = { 1500, 65536, 4 << 20 };
+	struct hc128_context *ctx, *pctx[MAX_SUBS];
+	uint8_t key[16], *in, *out[MAX_SUBS];
+	int s, i, j, r;
+
+	memset(key, 'k', sizeof(key));
+
+	if(check(key)) {
+		printf("Fan-out mismatch with hc128_crypt!\n");
+		return 1;
+	}
+
+	printf("fanout check: ok\n");
+
+	if((argc > 1) && !strcmp(argv[1], "-c"))
+		return 0;
+
+	printf("\n");
+
+	ctx = xmalloc(MAX_SUBS * sizeof(*ctx));
+	setup(ctx, MAX_SUBS, key);
+
+	printf("%8s %5s %14s %14s %10s %16s\n", "size", "subs", "single GB/s", "fanout GB/s", "speedup", "saved read GB/s");
+
+	for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		uint32_t size = sizes[s];
+
+		in = xmalloc(size);
+		memset(in, 'q', size);
+
+		for(i = 0; i < sizeof(subs) / sizeof(subs[0]); i++) {
+			int n = subs[i];
+			size_t iters, k;
+			double t, t_single = 1e9, t_fanout = 1e9, bytes;
+
+			if((size_t)n * size > TOTAL)
+				continue;
+
+			for(j = 0; j < n; j++) {
+				pctx[j] = &ctx[j];
+				out[j] = xmalloc(size);
+			}
+
+			iters = TOTAL / ((size_t)n * size);
+			if(iters > 16384)
+				iters = 16384;
+
+			// Best of the repetitions, the machine may be shared
+			for(r = 0; r < 3; r++) {
+				t = now();
+				for(k = 0; k < iters; k++) {
+					for(j = 0; j < n; j++)
+						hc128_crypt(pctx[j], in, size, out[j]);
+				}
+				t = now() - t;
+				if(t < t_single)
+					t_single = t;
+
+				t = now();
+				for(k = 0; k < iters; k++)
+					hc128_crypt_fanout(pctx, n, in, size, out);
+				t = now() - t;
+				if(t < t_fanout)
+					t_fanout = t;
+			}
+
+			// Bytes of ciphertext, the plaintext reads saved are (n - 1) / n of it
+			bytes = (double)iters * n * size;
+
+			printf("%8u %5d %14.3f %14.3f %10.2f %16.3f\n", size, n,
+			       bytes / t_single / 1e9, bytes / t_fanout / 1e9, t_single / t_fanout,
+			       bytes * (n - 1) / n / t_fanout / 1e9);
+
+			for(j = 0; j < n; j++)
+				free(out[j]);
+		}
+
+		free(in);
+	}
+
+	free(ctx);
+
+	return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ * Benchmark of the keystream generation.
+ * hc128_keystream() and hc128_keystream_blocks() are compared with
+ * the old way: hc128_crypt() of a zero buffer.
+ * Example: ./bench/keystream
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "../hc128.h"
+
+#define TOTAL	(1024UL << 20)
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Allocates memory
+static void *
+xmalloc(size_t size)
+{
+	void *p = malloc(size);
+
+	if(p == NULL) {
+		printf("Allocates memory error!\n");
+		exit(1);
+	}
+	else
+		return p;
+}
+
+int
+main(void)
+{
+	static const uint32_t sizes[] = { 4096, 262144, 16777216 };
+	struct hc128_context ctx1, ctx2, ctx3;
+	uint8_t key[16], iv[16], *zero, *out1, *out2, *out3;
+	double t, t_zero, t_bytes, t_blocks;
+	unsigned long iters, k;
+	unsigned int i;
+
+	memset(key, 'k', sizeof(key));
+	memset(iv, 'i', sizeof(iv));
+
+	zero = xmalloc(sizes[2]);
+	out1 = xmalloc(sizes[2]);
+	out2 = xmalloc(sizes[2]);
+	out3 = xmalloc(sizes[2]);
+	memset(zero, 0, sizes[2]);
+
+	// The three ways must give the same keystream, also with partial calls
+	hc128_set_key_and_iv(&ctx1, key, 16, iv, 16);
+	hc128_set_key_and_iv(&ctx2, key, 16, iv, 16);
+	hc128_crypt(&ctx1, zero, 100, out1);
+	hc128_keystream(&ctx2, out2, 100);
+	hc128_crypt(&ctx1, zero + 100, 4096 - 100, out1 + 100);
+	hc128_keystream_blocks(&ctx2, out2 + 100, 1);
+	hc128_keystream(&ctx2, out2 + 164, 4096 - 164);
+
+	if(memcmp(out1, out2, 4096)) {
+		printf("Keystream mismatch!\n");
+		return 1;
+	}
+
+	printf("%10s %14s %14s %14s\n", "size", "zeros GB/s", "bytes GB/s", "blocks GB/s");
+
+	for(i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		iters = TOTAL / sizes[i];
+
+		hc128_set_key_and_iv(&ctx1, key, 16, iv, 16);
+		hc128_set_key_and_iv(&ctx2, key, 16, iv, 16);
+		hc128_set_key_and_iv(&ctx3, key, 16, iv, 16);
+
+		t = now();
+		for(k = 0; k < iters; k++)
+			hc128_crypt(&ctx1, zero, sizes[i], out1);
+		t_zero = now() - t;
+
+		t = now();
+		for(k = 0; k < iters; k++)
+			hc128_keystream(&ctx2, out2, sizes[i]);
+		t_bytes = now() - t;
+
+		t = now();
+		for(k = 0; k < iters; k++)
+			hc128_keystream_blocks(&ctx3, out3, sizes[i] / 64);
+		t_blocks = now() - t;
+
+		if(memcmp(out1, out2, sizes[i]) || memcmp(out1, out3, sizes[i])) {
+			printf("Keystream mismatch!\n");
+			return 1;
+		}
+
+		printf("%10u %14.3f %14.3f %14.3f\n", sizes[i],
+		       TOTAL / t_zero / 1e9, TOTAL / t_bytes / 1e9, TOTAL / t_blocks / 1e9);
+	}
+
+	free(zero);
+	free(out1);
+	free(out2);
+	free(out3);
+
+	return 0;
+}
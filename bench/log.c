@@ -0,0 +1,304 @@
+/*
+ * Benchmark of the encrypted append-only log hc128_log.c.
+ * Threads append records of the given size, compared with the per-record
+ * path: hc128_crypt() of the record and write() under a mutex.
+ * Durable: every thread waits for its record (group commit with
+ * HC128_LOG_SYNC against fdatasync() after every record write).
+ * Buffered: no waiting and no fdatasync().
+ * Then all records are read back and checked, and the seek to the last
+ * record through the checkpoints is compared with a scan from the head.
+ * -c only reads back a short durable and a longer buffered log.
+ * Example: ./bench/log /tmp 4 128
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "../hc128.h"
+#include "../hc128_log.h"
+
+#define MAX_THREADS	64
+#define MAX_RECORD	4096
+#define CHECKPOINT	(1 << 20)
+
+struct worker {
+	pthread_t thread;
+	uint32_t id;
+	uint32_t records;
+	int durable;
+	int errors;
+};
+
+static const uint8_t key[16] = "log key 16 bytes";
+static const uint8_t iv[16] = "log iv  16 bytes";
+
+static char path[4096];
+static uint32_t rec_size = 128;
+static struct hc128_log *log_writer;
+
+// Per-record path
+static pthread_mutex_t single_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct hc128_context single_ctx;
+static int single_fd;
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Record seq of the thread id: id, seq, then the bytes of the pattern
+static void
+make_record(uint8_t *rec, uint32_t id, uint32_t seq)
+{
+	uint32_t k;
+
+	memcpy(rec, &id, 4);
+	memcpy(rec + 4, &seq, 4);
+
+	for(k = 8; k < rec_size; k++)
+		rec[k] = (uint8_t)(id * 31 + seq * 7 + k);
+}
+
+static int
+check_record(const uint8_t *rec, uint32_t len, uint32_t *id, uint32_t *seq)
+{
+	uint8_t expect[MAX_RECORD];
+
+	if(len != rec_size)
+		return -1;
+
+	memcpy(id, rec, 4);
+	memcpy(seq, rec + 4, 4);
+	make_record(expect, *id, *seq);
+
+	return memcmp(rec, expect, len) ? -1 : 0;
+}
+
+static void *
+log_worker(void *arg)
+{
+	struct worker *w = arg;
+	uint8_t rec[MAX_RECORD];
+	int64_t r;
+	uint32_t i;
+
+	for(i = 0; i < w->records; i++) {
+		make_record(rec, w->id, i);
+
+		r = hc128_log_append(log_writer, rec, rec_size);
+
+		if((r < 0) || (w->durable && hc128_log_sync(log_writer, r)))
+			w->errors++;
+	}
+
+	return NULL;
+}
+
+static void *
+single_worker(void *arg)
+{
+	struct worker *w = arg;
+	uint8_t rec[4 + MAX_RECORD];
+	uint32_t i;
+
+	for(i = 0; i < w->records; i++) {
+		memcpy(rec, &rec_size, 4);
+		make_record(rec + 4, w->id, i);
+
+		pthread_mutex_lock(&single_mutex);
+
+		hc128_crypt(&single_ctx, rec, 4 + rec_size, rec);
+
+		if((write(single_fd, rec, 4 + rec_size) != 4 + rec_size) || (w->durable && fdatasync(single_fd)))
+			w->errors++;
+
+		pthread_mutex_unlock(&single_mutex);
+	}
+
+	return NULL;
+}
+
+// Return value: records per second, -1 if all bad
+static double
+run(int threads, uint32_t records, int durable, int use_log, struct hc128_log_stats *stats)
+{
+	struct worker w[MAX_THREADS];
+	double t;
+	int i, errors = 0;
+
+	if(use_log) {
+		log_writer = hc128_log_open(path, key, iv, CHECKPOINT, durable ? HC128_LOG_SYNC : 0);
+		if(!log_writer)
+			return -1;
+	}
+	else {
+		single_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		if(single_fd < 0)
+			return -1;
+		hc128_set_key_and_iv(&single_ctx, key, 16, iv, 16);
+	}
+
+	t = now();
+
+	for(i = 0; i < threads; i++) {
+		w[i].id = i;
+		w[i].records = records;
+		w[i].durable = durable;
+		w[i].errors = 0;
+		pthread_create(&w[i].thread, NULL, use_log ? log_worker : single_worker, &w[i]);
+	}
+
+	for(i = 0; i < threads; i++) {
+		pthread_join(w[i].thread, NULL);
+		errors += w[i].errors;
+	}
+
+	if(use_log) {
+		hc128_log_stats(log_writer, stats);
+		if(hc128_log_close(log_writer))
+			errors++;
+	}
+	else if(close(single_fd))
+		errors++;
+
+	t = now() - t;
+
+	return errors ? -1 : (double)threads * records / t;
+}
+
+// Every record of every thread once, in order of the thread
+static int
+read_back(int threads, uint32_t records)
+{
+	struct hc128_log_reader *reader;
+	uint32_t next[MAX_THREADS], id, seq, len;
+	uint8_t rec[MAX_RECORD];
+	uint64_t total = 0, last = (uint64_t)threads * records - 1;
+	double t, t_scan, t_seek;
+	int i, res;
+
+	memset(next, 0, sizeof(next));
+
+	if(!(reader = hc128_log_reader_open(path, key)))
+		return -1;
+
+	t = now();
+
+	while((res = hc128_log_next(reader, rec, sizeof(rec), &len)) == 1) {
+		if(check_record(rec, len, &id, &seq) || (id >= threads) || (seq != next[id]))
+			return -1;
+
+		next[id]++;
+		total++;
+	}
+
+	t_scan = now() - t;
+	hc128_log_reader_close(reader);
+
+	if(res || (total != last + 1))
+		return -1;
+
+	for(i = 0; i < threads; i++) {
+		if(next[i] != records)
+			return -1;
+	}
+
+	// The last record: from its checkpoint and from the head
+	if(!(reader = hc128_log_reader_open(path, key)))
+		return -1;
+
+	t = now();
+	if(hc128_log_seek(reader, last) || (hc128_log_next(reader, rec, sizeof(rec), &len) != 1) ||
+	   check_record(rec, len, &id, &seq))
+		return -1;
+	t_seek = now() - t;
+
+	hc128_log_reader_close(reader);
+
+	printf("\nread back: %lu records ok, scan %.1f ms, seek to the last record %.3f ms\n",
+	       (unsigned long)total, t_scan * 1e3, t_seek * 1e3);
+
+	return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct hc128_log_stats stats;
+	int check = (argc > 1) && !strcmp(argv[1], "-c");
+	const char *dir = (argc > 1 + check) ? argv[1 + check] : "/tmp";
+	int threads = (argc > 2 + check) ? atoi(argv[2 + check]) : 4;
+	double r_log, r_single;
+	char idx[4200];
+
+	if(argc > 3 + check)
+		rec_size = atoi(argv[3 + check]);
+
+	if((threads < 1) || (threads > MAX_THREADS) || (rec_size < 8) || (rec_size > MAX_RECORD)) {
+		printf("Usage: %s [-c] [dir] [threads 1..%d] [record size 8..%d]\n", argv[0], MAX_THREADS, MAX_RECORD);
+		return 1;
+	}
+
+	snprintf(path, sizeof(path), "%s/hc128_log_bench.%d", dir, (int)getpid());
+	snprintf(idx, sizeof(idx), "%s.idx", path);
+
+	// The buffered log spans several checkpoints
+	if(check) {
+		if((run(threads, 100, 1, 1, &stats) < 0) || read_back(threads, 100) ||
+		   (run(threads, 20000, 0, 1, &stats) < 0) || read_back(threads, 20000)) {
+			printf("Log check failed!\n");
+			return 1;
+		}
+
+		unlink(path);
+		unlink(idx);
+
+		return 0;
+	}
+
+	printf("threads = %d record = %u bytes\n\n", threads, rec_size);
+	printf("%10s %16s %16s %10s %18s\n", "mode", "log rec/s", "per-record rec/s", "speedup", "records per sync");
+
+	r_single = run(threads, 500, 1, 0, NULL);
+	r_log = run(threads, 5000, 1, 1, &stats);
+
+	if((r_single < 0) || (r_log < 0)) {
+		printf("Log write error!\n");
+		return 1;
+	}
+
+	printf("%10s %16.0f %16.0f %10.2f %18.1f\n", "durable", r_log, r_single, r_log / r_single,
+	       (double)stats.records / stats.syncs);
+
+	r_single = run(threads, 200000, 0, 0, NULL);
+	r_log = run(threads, 200000, 0, 1, &stats);
+
+	if((r_single < 0) || (r_log < 0)) {
+		printf("Log write error!\n");
+		return 1;
+	}
+
+	printf("%10s %16.0f %16.0f %10.2f %18s\n", "buffered", r_log, r_single, r_log / r_single, "-");
+	printf("\ncommits = %lu checkpoints = %lu\n", (unsigned long)stats.commits, (unsigned long)stats.checkpoints);
+
+	if(read_back(threads, 200000)) {
+		printf("Log read back mismatch!\n");
+		return 1;
+	}
+
+	unlink(path);
+	unlink(idx);
+
+	return 0;
+}
@@ -0,0 +1,340 @@
+/*
+ * YCSB-style benchmark of the encrypted page store hc128_pagestore.c.
+ * Pages are chosen by the scrambled zipfian distribution of YCSB
+ * (theta 0.99), an update reads the page, changes it and writes it back.
+ * Workloads: A - 50 % updates, B - 5 % updates, C - reads only.
+ * Every page carries its number and version, which are checked on every
+ * read and after reopening the store.
+ * First a store with a one page cache over a truncated file is checked:
+ * the reads of the cut pages fail, the cache keeps working. -c runs only
+ * the check.
+ * Example: ./bench/pagestore /tmp 16384 2048
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../hc128_pagestore.h"
+
+#define OPS		200000
+#define THETA		0.99
+
+struct workload {
+	const char *name;
+	int update_percent;
+};
+
+static const uint8_t key[16] = "page store key!!";
+
+static uint64_t *versions;
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+// Zipfian generator of YCSB
+static double zipf_zetan, zipf_alpha, zipf_eta;
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *
+xmalloc(size_t size)
+{
+	void *p = malloc(size);
+
+	if(!p) {
+		printf("malloc error!\n");
+		exit(1);
+	}
+
+	return p;
+}
+
+static uint64_t
+rng_next(void)
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+
+	return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static double
+rng_double(void)
+{
+	return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void
+zipf_init(uint64_t n)
+{
+	double zeta2 = 1.0 + pow(0.5, THETA);
+	uint64_t i;
+
+	zipf_zetan = 0;
+	for(i = 1; i <= n; i++)
+		zipf_zetan += 1.0 / pow(i, THETA);
+
+	zipf_alpha = 1.0 / (1.0 - THETA);
+	zipf_eta = (1.0 - pow(2.0 / n, 1.0 - THETA)) / (1.0 - zeta2 / zipf_zetan);
+}
+
+// Rank of the zipfian distribution scattered over the pages (FNV-1a)
+static uint64_t
+zipf_page(uint64_t n)
+{
+	double u = rng_double(), uz = u * zipf_zetan;
+	uint64_t rank, h = 0xcbf29ce484222325ULL;
+	int i;
+
+	if(uz < 1.0)
+		rank = 0;
+	else if(uz < 1.0 + pow(0.5, THETA))
+		rank = 1;
+	else
+		rank = (uint64_t)(n * pow(zipf_eta * u - zipf_eta + 1.0, zipf_alpha));
+
+	for(i = 0; i < 8; i++) {
+		h ^= (rank >> (8 * i)) & 0xff;
+		h *= 0x100000001b3ULL;
+	}
+
+	return h % n;
+}
+
+static void
+make_page(uint8_t *buf, uint64_t page, uint64_t version)
+{
+	uint32_t k;
+
+	memcpy(buf, &page, 8);
+	memcpy(buf + 8, &version, 8);
+
+	for(k = 16; k < HC128_PAGE_SIZE; k++)
+		buf[k] = (uint8_t)(page * 13 + version * 7 + k);
+}
+
+static int
+check_page(const uint8_t *buf, uint64_t page)
+{
+	uint8_t expect[HC128_PAGE_SIZE];
+
+	make_page(expect, page, versions[page]);
+
+	return memcmp(buf, expect, HC128_PAGE_SIZE) ? -1 : 0;
+}
+
+/*
+ * Reads of the pages cut off the file fail and leave the cache intact,
+ * with the single slot of the cache the next miss needs it again
+ * Return value: 0 (if all is well), 1 if all bad
+*/
+static int
+check_short_file(const char *dir)
+{
+	static const uint64_t reads[] = { 0, 2, 3, 1, 2, 0, 5 };
+	static const int fails[] = { 0, 1, 1, 0, 1, 0, 0 };
+	struct hc128_pagestore *ps;
+	uint8_t buf[HC128_PAGE_SIZE], expect[HC128_PAGE_SIZE];
+	char path[4096], meta[4200];
+	uint64_t page;
+	int i, bad = 0;
+
+	snprintf(path, sizeof(path), "%s/hc128_pagestore_short.%d", dir, (int)getpid());
+	snprintf(meta, sizeof(meta), "%s.meta", path);
+
+	if(!(ps = hc128_pagestore_open(path, key, 1))) {
+		printf("Page store open error!\n");
+		return 1;
+	}
+
+	for(page = 0; page < 4; page++) {
+		make_page(buf, page, 1);
+
+		if(hc128_pagestore_write(ps, page, buf)) {
+			printf("Page store write error!\n");
+			return 1;
+		}
+	}
+
+	if(hc128_pagestore_close(ps) || truncate(path, 2 * HC128_PAGE_SIZE + HC128_PAGE_SIZE / 2) ||
+	   !(ps = hc128_pagestore_open(path, key, 1))) {
+		printf("Page store reopen error!\n");
+		return 1;
+	}
+
+	// Page 5 was never written: zero
+	for(i = 0; i < (int)(sizeof(reads) / sizeof(reads[0])); i++) {
+		if(reads[i] < 4)
+			make_page(expect, reads[i], 1);
+		else
+			memset(expect, 0, sizeof(expect));
+
+		if(fails[i] ? !hc128_pagestore_read(ps, reads[i], buf) :
+		    (hc128_pagestore_read(ps, reads[i], buf) || memcmp(buf, expect, HC128_PAGE_SIZE))) {
+			printf("Short file: read %d of page %lu %s!\n", i, (unsigned long)reads[i],
+			       fails[i] ? "did not fail" : "failed");
+			bad = 1;
+		}
+	}
+
+	make_page(expect, 7, 2);
+
+	if(hc128_pagestore_write(ps, 7, expect) || hc128_pagestore_read(ps, 0, buf) ||
+	   hc128_pagestore_read(ps, 7, buf) || memcmp(buf, expect, HC128_PAGE_SIZE)) {
+		printf("Short file: cache broken after the failed reads!\n");
+		bad = 1;
+	}
+
+	hc128_pagestore_close(ps);
+	unlink(path);
+	unlink(meta);
+
+	printf("short file check: %s\n", bad ? "failed" : "ok");
+
+	return bad;
+}
+
+int
+main(int argc, char *argv[])
+{
+	static const struct workload workloads[] = {
+		{ "A", 50 },
+		{ "B", 5 },
+		{ "C", 0 },
+	};
+	struct hc128_pagestore *ps;
+	struct hc128_pagestore_stats st, prev;
+	int check = (argc > 1) && !strcmp(argv[1], "-c");
+	const char *dir = (argc > 1 + check) ? argv[1 + check] : "/tmp";
+	uint64_t pages = (argc > 2 + check) ? strtoull(argv[2 + check], NULL, 10) : 16384;
+	uint32_t cache = (argc > 3 + check) ? atoi(argv[3 + check]) : 2048;
+	uint8_t buf[HC128_PAGE_SIZE];
+	char path[4096], meta[4200];
+	uint64_t page, i, reads;
+	double t;
+	int w;
+
+	if(!pages || !cache) {
+		printf("Usage: %s [-c] [dir] [pages] [cache pages]\n", argv[0]);
+		return 1;
+	}
+
+	if(check_short_file(dir))
+		return 1;
+
+	if(check)
+		return 0;
+
+	snprintf(path, sizeof(path), "%s/hc128_pagestore_bench.%d", dir, (int)getpid());
+	snprintf(meta, sizeof(meta), "%s.meta", path);
+
+	versions = xmalloc(pages * sizeof(uint64_t));
+	zipf_init(pages);
+
+	if(!(ps = hc128_pagestore_open(path, key, cache))) {
+		printf("Page store open error!\n");
+		return 1;
+	}
+
+	// Load phase
+	t = now();
+	for(page = 0; page < pages; page++) {
+		versions[page] = 1;
+		make_page(buf, page, 1);
+
+		if(hc128_pagestore_write(ps, page, buf)) {
+			printf("Page store write error!\n");
+			return 1;
+		}
+	}
+
+	if(hc128_pagestore_flush(ps)) {
+		printf("Page store flush error!\n");
+		return 1;
+	}
+	t = now() - t;
+
+	printf("pages = %lu (%lu MB) cache = %u pages, load %.1f MB/s\n\n", (unsigned long)pages,
+	       (unsigned long)(pages * HC128_PAGE_SIZE >> 20), cache, pages * HC128_PAGE_SIZE / t / 1e6);
+	printf("%8s %12s %12s %10s %18s %14s\n", "workload", "ops/s", "reads/s", "hit ratio", "write-back MB/s", "pages/batch");
+
+	for(w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++) {
+		hc128_pagestore_stats(ps, &prev);
+		reads = 0;
+
+		t = now();
+
+		for(i = 0; i < OPS; i++) {
+			page = zipf_page(pages);
+
+			if(hc128_pagestore_read(ps, page, buf) || check_page(buf, page)) {
+				printf("Page %lu mismatch!\n", (unsigned long)page);
+				return 1;
+			}
+
+			reads++;
+
+			if(rng_next() % 100 < workloads[w].update_percent) {
+				make_page(buf, page, ++versions[page]);
+
+				if(hc128_pagestore_write(ps, page, buf)) {
+					printf("Page store write error!\n");
+					return 1;
+				}
+			}
+		}
+
+		if(hc128_pagestore_flush(ps)) {
+			printf("Page store flush error!\n");
+			return 1;
+		}
+
+		t = now() - t;
+		hc128_pagestore_stats(ps, &st);
+
+		printf("%8s %12.0f %12.0f %10.3f %18.1f %14.1f\n", workloads[w].name, OPS / t, reads / t,
+		       (double)(st.hits - prev.hits) / (st.hits + st.misses - prev.hits - prev.misses),
+		       (st.written > prev.written) ?
+		       (st.written - prev.written) * HC128_PAGE_SIZE / ((st.writeback_ns - prev.writeback_ns) / 1e9) / 1e6 : 0.0,
+		       (st.batches > prev.batches) ? (double)(st.written - prev.written) / (st.batches - prev.batches) : 0.0);
+	}
+
+	if(hc128_pagestore_close(ps)) {
+		printf("Page store close error!\n");
+		return 1;
+	}
+
+	// Everything must survive the reopen
+	if(!(ps = hc128_pagestore_open(path, key, cache))) {
+		printf("Page store open error!\n");
+		return 1;
+	}
+
+	for(page = 0; page < pages; page++) {
+		if(hc128_pagestore_read(ps, page, buf) || check_page(buf, page)) {
+			printf("Page %lu mismatch after reopen!\n", (unsigned long)page);
+			return 1;
+		}
+	}
+
+	hc128_pagestore_close(ps);
+	printf("\nreopen: %lu pages ok\n", (unsigned long)pages);
+
+	unlink(path);
+	unlink(meta);
+	free(versions);
+
+	return 0;
+}
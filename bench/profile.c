@@ -0,0 +1,173 @@
+/*
+ * Report of the profiled build (hc128.c compiled with -DHC128_PROFILE).
+ * Runs the key setups and the crypt of a buffer in calls of the chunk size,
+ * then prints where the time went: the stages of the setup per call and
+ * the split of hc128_crypt() between generation and combine per block.
+ * The cost of one timer read, measured here, is taken off every stage.
+ * The laps of the crypt stages keep the blocks from overlapping in the
+ * pipeline, so its total is above the speed of hc128.o (bench/cycles), the
+ * split between the stages is what the report is for.
+ * Example: ./bench/profile -n 10000 -l 1048576 -b 4096
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TICKS_UNIT	"cycles"
+#else
+#include <time.h>
+#define TICKS_UNIT	"ns"
+#endif
+
+#include "../hc128.h"
+
+#define OVERHEAD_RUNS	10001
+
+static const char *stage_name[HC128_PROFILE_STAGES] = {
+	"expand key/iv", "expand w", "x/y copy", "setup P", "setup Q", "generate", "combine"
+};
+
+static const uint8_t key[16] = "profile key 16b!";
+
+static inline uint64_t
+ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static void *
+xmalloc(size_t size)
+{
+	void *p = malloc(size);
+
+	if(!p) {
+		printf("malloc error!\n");
+		exit(1);
+	}
+
+	return p;
+}
+
+static int
+cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+// Median ticks between two timer reads: the cost of one stage lap
+static uint64_t
+timer_overhead(void)
+{
+	static uint64_t s[OVERHEAD_RUNS];
+	uint64_t t;
+	int i;
+
+	for(i = 0; i < OVERHEAD_RUNS; i++) {
+		t = ticks();
+		s[i] = ticks() - t;
+	}
+
+	qsort(s, OVERHEAD_RUNS, sizeof(s[0]), cmp_u64);
+
+	return s[OVERHEAD_RUNS / 2];
+}
+
+// Stages first..last per unit, share of their sum
+static void
+report(const struct hc128_profile *p, int first, int last, uint64_t units, uint64_t overhead)
+{
+	double v[HC128_PROFILE_STAGES], sum = 0;
+	int i;
+
+	for(i = first; i <= last; i++) {
+		v[i] = (double)p->ticks[i] - (double)p->count[i] * overhead;
+		if(v[i] < 0)
+			v[i] = 0;
+		sum += v[i];
+	}
+
+	for(i = first; i <= last; i++)
+		printf("  %-16s %12.1f %10lu %7.1f%%\n", stage_name[i], v[i] / units, (unsigned long)p->count[i],
+		       sum ? 100 * v[i] / sum : 0);
+
+	printf("  %-16s %12.1f\n", "total", sum / units);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct hc128_context ctx;
+	struct hc128_profile p;
+	uint32_t setups = 10000, len = 1 << 20, chunk = 4096, i, n;
+	uint64_t overhead;
+	uint8_t iv[16], *buf;
+	int opt;
+
+	while((opt = getopt(argc, argv, "n:l:b:")) != -1) {
+		switch(opt) {
+		case 'n':
+			setups = strtoul(optarg, NULL, 10);
+			break;
+		case 'l':
+			len = strtoul(optarg, NULL, 10);
+			break;
+		case 'b':
+			chunk = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			printf("Usage: %s [-n setups] [-l crypt bytes] [-b bytes per call]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if(!setups || (len < 64) || !chunk) {
+		printf("Setups > 0, crypt bytes >= 64, bytes per call > 0!\n");
+		return 1;
+	}
+
+	buf = xmalloc(len);
+	memset(buf, 0, len);
+	memset(iv, 0, sizeof(iv));
+
+	overhead = timer_overhead();
+
+	hc128_profile_reset();
+	for(i = 0; i < setups; i++) {
+		memcpy(iv, &i, sizeof(i));
+		hc128_set_key_and_iv(&ctx, key, 16, iv, 16);
+	}
+	hc128_profile_get(&p);
+
+	printf("timer overhead = %lu %s per stage, taken off\n\n", (unsigned long)overhead, TICKS_UNIT);
+	printf("key setup: %u calls, %s per call\n", setups, TICKS_UNIT);
+	report(&p, HC128_PROFILE_EXPAND_KEY, HC128_PROFILE_SETUP_Q, setups, overhead);
+
+	hc128_profile_reset();
+	for(i = 0; i < len; i += n) {
+		n = (len - i < chunk) ? len - i : chunk;
+		hc128_crypt(&ctx, buf + i, n, buf + i);
+	}
+	hc128_profile_get(&p);
+
+	printf("\nhc128_crypt: %u bytes in calls of %u bytes, %s per 64-byte block\n", len, chunk, TICKS_UNIT);
+	report(&p, HC128_PROFILE_GENERATE, HC128_PROFILE_COMBINE, (len + 63) / 64, overhead);
+
+	free(buf);
+
+	return 0;
+}
@@ -0,0 +1,162 @@
+/*
+ * Benchmark of the rekeying stream hc128_rekey.c.
+ * A stream of packets crosses many epoch boundaries, the latency of every
+ * packet is measured with the inline setup (HC128_REKEY_SYNC) and with the
+ * helper thread. Both outputs must be the same and equal to the epochs
+ * encrypted one by one with hc128_crypt(). -c runs only the comparison,
+ * on fewer packets.
+ * Example: ./bench/rekey 1500 262144
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "../hc128.h"
+#include "../hc128_rekey.h"
+#include "bench.h"
+
+#define PACKETS		200000
+#define CHECK_PACKETS	2000
+
+static const uint8_t key[16] = "rekey key 16 b!!";
+static const uint8_t iv[16] = "rekey iv 16 b!!!";
+
+static uint32_t packets = PACKETS;
+
+static void *
+xmalloc(size_t size)
+{
+	void *p = malloc(size);
+
+	if(!p) {
+		printf("malloc error!\n");
+		exit(1);
+	}
+
+	return p;
+}
+
+static int
+cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+// Reference: every epoch encrypted by its own context
+static void
+reference(const uint8_t *in, size_t len, uint64_t interval, uint8_t *out)
+{
+	struct hc128_context ctx;
+	uint8_t epoch_iv[16];
+	uint64_t e, off, n;
+	int i;
+
+	for(e = 0, off = 0; off < len; e++, off += n) {
+		memcpy(epoch_iv, iv, 16);
+		for(i = 0; i < 8; i++)
+			epoch_iv[i] ^= (uint8_t)(e >> (8 * i));
+
+		n = (len - off < interval) ? len - off : interval;
+
+		hc128_set_key_and_iv(&ctx, key, 16, epoch_iv, 16);
+		hc128_crypt(&ctx, in + off, n, out + off);
+	}
+}
+
+// Encrypt the packets, keep the latencies
+static void
+run(int options, const uint8_t *in, uint32_t packet, uint64_t interval, uint8_t *out, uint64_t *lat,
+    struct hc128_rekey_stats *stats)
+{
+	struct hc128_rekey *rk = hc128_rekey_create(key, iv, interval, options);
+	uint64_t t;
+	size_t i;
+
+	if(!rk) {
+		printf("Rekey stream create error!\n");
+		exit(1);
+	}
+
+	for(i = 0; i < packets; i++) {
+		t = now_ns();
+		hc128_rekey_crypt(rk, in + i * packet, packet, out + i * packet);
+		lat[i] = now_ns() - t;
+	}
+
+	hc128_rekey_stats(rk, stats);
+	hc128_rekey_destroy(rk);
+
+	qsort(lat, packets, sizeof(lat[0]), cmp_u64);
+}
+
+static void
+print_lat(const char *name, const uint64_t *lat, const struct hc128_rekey_stats *stats)
+{
+	printf("%-12s %10.2f %10.2f %10.2f %10.2f %10lu %8lu\n", name, lat[packets / 2] / 1e3,
+	       lat[packets * 99 / 100] / 1e3, lat[packets * 999 / 1000] / 1e3, lat[packets - 1] / 1e3,
+	       (unsigned long)stats->rekeys, (unsigned long)stats->waits);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int check = (argc > 1) && !strcmp(argv[1], "-c");
+	uint32_t packet = (argc > 1 + check) ? atoi(argv[1 + check]) : 1500;
+	uint64_t interval = (argc > 2 + check) ? strtoull(argv[2 + check], NULL, 10) : 262144;
+	struct hc128_rekey_stats st_sync, st_bg;
+	uint8_t *in, *out_sync, *out_bg, *out_ref;
+	uint64_t *lat_sync, *lat_bg;
+	size_t len, i;
+
+	if(!packet || !interval) {
+		printf("Usage: %s [-c] [packet bytes] [rekey interval bytes]\n", argv[0]);
+		return 1;
+	}
+
+	if(check)
+		packets = CHECK_PACKETS;
+
+	len = (size_t)packet * packets;
+	in = xmalloc(len);
+	out_sync = xmalloc(len);
+	out_bg = xmalloc(len);
+	out_ref = xmalloc(len);
+	lat_sync = xmalloc(packets * sizeof(uint64_t));
+	lat_bg = xmalloc(packets * sizeof(uint64_t));
+
+	for(i = 0; i < len; i++)
+		in[i] = (uint8_t)(i * 7);
+
+	run(HC128_REKEY_SYNC, in, packet, interval, out_sync, lat_sync, &st_sync);
+	run(0, in, packet, interval, out_bg, lat_bg, &st_bg);
+	reference(in, len, interval, out_ref);
+
+	if(memcmp(out_sync, out_ref, len) || memcmp(out_bg, out_ref, len)) {
+		printf("Rekeyed stream mismatch!\n");
+		return 1;
+	}
+
+	printf("packets = %u x %u bytes, rekey every %lu bytes, outputs identical\n\n", packets, packet,
+	       (unsigned long)interval);
+
+	if(!check) {
+		printf("%-12s %10s %10s %10s %10s %10s %8s\n", "mode", "p50 us", "p99 us", "p99.9 us", "max us", "rekeys", "waits");
+
+		print_lat("inline", lat_sync, &st_sync);
+		print_lat("background", lat_bg, &st_bg);
+	}
+
+	free(in);
+	free(out_sync);
+	free(out_bg);
+	free(out_ref);
+	free(lat_sync);
+	free(lat_bg);
+
+	return 0;
+}
@@ -0,0 +1,731 @@
+/*
+ * Encrypted echo relay on epoll and its loopback load generator in one binary.
+ * Server: one shard thread per core, each with its own listening socket
+ * (SO_REUSEPORT) and epoll set. A connection starts with the 16-byte iv of
+ * the client, the relay keeps two contexts per connection: rx (key, iv)
+ * decrypts the client data, tx (key, iv with the top bit of the last byte
+ * flipped) encrypts the echo. The connections come from a per-shard pool,
+ * the data is decrypted and encrypted in place in the shard buffer as it
+ * arrives, bytes the socket does not take are kept for EPOLLOUT.
+ * Client: threads open the connections, then every connection sends a
+ * message, waits for the whole echo, checks it and sends the next one.
+ * Report: connections/sec, messages/sec, p50/p99 round trip latency and
+ * the share of the server CPU time in key setup and in encryption.
+ * Options: -c connections, -m message size, -s shards, -l client threads,
+ * -t seconds of the message phase.
+ * Example: ./bench/relay -c 5000 -m 1024 -t 5
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "../hc128.h"
+#include "bench.h"
+
+#define MAX_MSG		65536
+#define BUFLEN		65536
+#define POOL_SLAB	64
+#define EVENTS		256
+#define SOURCE_ADDRS	16
+#define ACCEPT_BACKOFF	(10 * 1000000ULL)
+
+// Connection of the relay
+struct relay_conn {
+	int fd;
+	uint32_t ivlen;
+	uint8_t iv[16];
+	struct hc128_context rx;
+	struct hc128_context tx;
+	uint8_t *pending;
+	uint32_t pending_len;
+	uint32_t pending_off;
+	struct relay_conn *next;
+};
+
+struct shard {
+	pthread_t thread;
+	int id;
+	int listen_fd;
+	int epoll_fd;
+	uint64_t accept_resume;
+	struct relay_conn *free;
+	uint8_t buf[BUFLEN];
+	uint64_t setup_ns;
+	uint64_t crypt_ns;
+	uint64_t cpu_ns;
+	uint64_t bytes;
+};
+
+// Connection of the load generator
+struct client_conn {
+	int fd;
+	uint32_t id;
+	struct hc128_context tx;
+	struct hc128_context rx;
+	uint8_t *pending;
+	uint32_t pending_len;
+	uint32_t pending_off;
+	uint32_t received;
+	uint64_t sent_at;
+};
+
+struct client {
+	pthread_t thread;
+	int id;
+	int epoll_fd;
+	int first;
+	int count;
+	struct client_conn *conns;
+	uint8_t buf[BUFLEN];
+	uint64_t messages;
+	uint64_t errors;
+	uint64_t hist[HIST_BUCKETS];
+};
+
+static const uint8_t key[16] = "relay shared key";
+
+static int port;
+static int msg_size = 256;
+static int ncpu;
+static atomic_int stop_server;
+static atomic_int stop_clients;
+static atomic_int accepted;
+static atomic_int connected;
+static pthread_barrier_t start_messages;
+
+static void *
+xmalloc(size_t size)
+{
+	void *p = malloc(size);
+
+	if(!p) {
+		printf("malloc error!\n");
+		exit(1);
+	}
+
+	return p;
+}
+
+static void
+pin(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu % ncpu, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static void
+set_nonblock(int fd)
+{
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+// Connections from slabs of POOL_SLAB, returned to the free list on close
+static struct relay_conn *
+pool_get(struct shard *sh)
+{
+	struct relay_conn *c;
+	int i;
+
+	if(!sh->free) {
+		c = xmalloc(POOL_SLAB * sizeof(*c));
+
+		for(i = 0; i < POOL_SLAB; i++) {
+			c[i].next = sh->free;
+			sh->free = &c[i];
+		}
+	}
+
+	c = sh->free;
+	sh->free = c->next;
+
+	c->ivlen = 0;
+	c->pending = NULL;
+	c->pending_len = 0;
+	c->pending_off = 0;
+
+	return c;
+}
+
+static void
+pool_put(struct shard *sh, struct relay_conn *c)
+{
+	free(c->pending);
+	memset(&c->rx, 0, sizeof(c->rx));
+	memset(&c->tx, 0, sizeof(c->tx));
+
+	c->next = sh->free;
+	sh->free = c;
+}
+
+// Write what the socket takes, keep the rest
+// Return value: 0 (if all is well), -1 if the connection is broken
+static int
+send_buffered(int epoll_fd, int fd, void *owner, uint8_t **pending, uint32_t *pending_len, const uint8_t *data,
+	      uint32_t len)
+{
+	struct epoll_event ev;
+	ssize_t n = 0;
+
+	if(*pending_len == 0) {
+		n = write(fd, data, len);
+
+		if(n < 0) {
+			if(errno != EAGAIN)
+				return -1;
+			n = 0;
+		}
+
+		if(n == len)
+			return 0;
+
+		ev.events = EPOLLIN | EPOLLOUT;
+		ev.data.ptr = owner;
+		epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+	}
+
+	*pending = realloc(*pending, *pending_len + len - n);
+	if(!*pending) {
+		printf("realloc error!\n");
+		exit(1);
+	}
+
+	memcpy(*pending + *pending_len, data + n, len - n);
+	*pending_len += len - n;
+
+	return 0;
+}
+
+// Flush the kept bytes on EPOLLOUT
+static int
+send_pending(int epoll_fd, int fd, void *owner, uint8_t **pending, uint32_t *pending_len, uint32_t *pending_off)
+{
+	struct epoll_event ev;
+	ssize_t n;
+
+	n = write(fd, *pending + *pending_off, *pending_len - *pending_off);
+
+	if(n < 0)
+		return (errno == EAGAIN) ? 0 : -1;
+
+	*pending_off += n;
+
+	if(*pending_off == *pending_len) {
+		*pending_len = 0;
+		*pending_off = 0;
+
+		ev.events = EPOLLIN;
+		ev.data.ptr = owner;
+		epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+	}
+
+	return 0;
+}
+
+static void
+relay_close(struct shard *sh, struct relay_conn *c)
+{
+	epoll_ctl(sh->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+	close(c->fd);
+	pool_put(sh, c);
+}
+
+// Data of the connection: iv first, then decrypt and encrypt in place
+static int
+relay_read(struct shard *sh, struct relay_conn *c)
+{
+	uint8_t *p;
+	uint64_t t;
+	ssize_t n;
+	uint32_t k;
+
+	n = read(c->fd, sh->buf, sizeof(sh->buf));
+
+	if(n == 0)
+		return -1;
+
+	if(n < 0)
+		return (errno == EAGAIN) ? 0 : -1;
+
+	p = sh->buf;
+
+	if(c->ivlen < 16) {
+		k = (16 - c->ivlen < n) ? 16 - c->ivlen : n;
+		memcpy(c->iv + c->ivlen, p, k);
+		c->ivlen += k;
+		p += k;
+		n -= k;
+
+		if(c->ivlen < 16)
+			return 0;
+
+		t = now_ns();
+		hc128_set_key_and_iv(&c->rx, key, 16, c->iv, 16);
+		c->iv[15] ^= 0x80;
+		hc128_set_key_and_iv(&c->tx, key, 16, c->iv, 16);
+		sh->setup_ns += now_ns() - t;
+
+		atomic_fetch_add(&accepted, 1);
+
+		if(!n)
+			return 0;
+	}
+
+	t = now_ns();
+	hc128_crypt(&c->rx, p, n, p);
+	hc128_crypt(&c->tx, p, n, p);
+	sh->crypt_ns += now_ns() - t;
+	sh->bytes += n;
+
+	return send_buffered(sh->epoll_fd, c->fd, c, &c->pending, &c->pending_len, p, n);
+}
+
+// Accept all waiting connections
+// Out of descriptors the listening socket stays readable, it leaves the
+// epoll set for ACCEPT_BACKOFF instead of waking the shard up in a loop
+static void
+shard_accept(struct shard *sh)
+{
+	struct epoll_event ev;
+	struct relay_conn *c;
+	int fd;
+
+	for(;;) {
+		fd = accept4(sh->listen_fd, NULL, NULL, SOCK_NONBLOCK);
+
+		if(fd < 0) {
+			if((errno == EINTR) || (errno == ECONNABORTED))
+				continue;
+
+			if(errno != EAGAIN) {
+				epoll_ctl(sh->epoll_fd, EPOLL_CTL_DEL, sh->listen_fd, NULL);
+				sh->accept_resume = now_ns() + ACCEPT_BACKOFF;
+			}
+
+			return;
+		}
+
+		c = pool_get(sh);
+		c->fd = fd;
+
+		ev.events = EPOLLIN;
+		ev.data.ptr = c;
+		epoll_ctl(sh->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+	}
+}
+
+static void *
+shard_main(void *arg)
+{
+	struct shard *sh = arg;
+	struct epoll_event ev, events[EVENTS];
+	struct relay_conn *c;
+	struct timespec ts;
+	int i, n;
+
+	pin(sh->id);
+
+	while(!atomic_load(&stop_server)) {
+		n = epoll_wait(sh->epoll_fd, events, EVENTS, sh->accept_resume ? ACCEPT_BACKOFF / 1000000 : 100);
+
+		if(sh->accept_resume && (now_ns() >= sh->accept_resume)) {
+			sh->accept_resume = 0;
+
+			ev.events = EPOLLIN;
+			ev.data.ptr = NULL;
+			epoll_ctl(sh->epoll_fd, EPOLL_CTL_ADD, sh->listen_fd, &ev);
+		}
+
+		for(i = 0; i < n; i++) {
+			// The listening socket has no connection
+			if(events[i].data.ptr == NULL) {
+				shard_accept(sh);
+				continue;
+			}
+
+			c = events[i].data.ptr;
+
+			if((events[i].events & EPOLLOUT) &&
+			   send_pending(sh->epoll_fd, c->fd, c, &c->pending, &c->pending_len, &c->pending_off)) {
+				relay_close(sh, c);
+				continue;
+			}
+
+			if((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && relay_read(sh, c))
+				relay_close(sh, c);
+		}
+	}
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	sh->cpu_ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+	return NULL;
+}
+
+static int
+listen_socket(int reuse_port)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	int fd, one = 1;
+
+	fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(reuse_port ? port : 0);
+
+	if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, SOMAXCONN)) {
+		printf("listen error!\n");
+		exit(1);
+	}
+
+	getsockname(fd, (struct sockaddr *)&addr, &len);
+	port = ntohs(addr.sin_port);
+
+	return fd;
+}
+
+// Plaintext byte k of the messages of the connection
+static inline uint8_t
+pattern(uint32_t id, uint32_t k)
+{
+	return (uint8_t)(k * 7 + id);
+}
+
+static int
+client_send(struct client *cl, struct client_conn *c)
+{
+	uint32_t k;
+
+	for(k = 0; k < msg_size; k++)
+		cl->buf[k] = pattern(c->id, k);
+
+	hc128_crypt(&c->tx, cl->buf, msg_size, cl->buf);
+
+	c->received = 0;
+	c->sent_at = now_ns();
+
+	return send_buffered(cl->epoll_fd, c->fd, c, &c->pending, &c->pending_len, cl->buf, msg_size);
+}
+
+// Echo bytes: decrypt, check, on the whole message record the latency
+static int
+client_read(struct client *cl, struct client_conn *c)
+{
+	ssize_t n, k;
+
+	n = read(c->fd, cl->buf, sizeof(cl->buf));
+
+	if(n <= 0)
+		return (n < 0 && errno == EAGAIN) ? 0 : -1;
+
+	hc128_crypt(&c->rx, cl->buf, n, cl->buf);
+
+	for(k = 0; k < n; k++) {
+		if(cl->buf[k] != pattern(c->id, c->received + k)) {
+			cl->errors++;
+			break;
+		}
+	}
+
+	c->received += n;
+
+	if(c->received < msg_size)
+		return 0;
+
+	cl->hist[hist_bucket(now_ns() - c->sent_at)]++;
+	cl->messages++;
+
+	if(atomic_load(&stop_clients))
+		return 0;
+
+	return client_send(cl, c);
+}
+
+static void
+client_connect(struct client *cl, struct client_conn *c)
+{
+	struct sockaddr_in addr, src;
+	struct epoll_event ev;
+	uint8_t iv[16];
+	int one = 1;
+
+	c->fd = socket(AF_INET, SOCK_STREAM, 0);
+	setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	// Source addresses of 127/8 in turn, every one has its own ephemeral ports
+	setsockopt(c->fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &one, sizeof(one));
+	memset(&src, 0, sizeof(src));
+	src.sin_family = AF_INET;
+	src.sin_addr.s_addr = htonl(INADDR_LOOPBACK + 1 + c->id % SOURCE_ADDRS);
+	bind(c->fd, (struct sockaddr *)&src, sizeof(src));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+
+	if(connect(c->fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		printf("connect error: %s!\n", strerror(errno));
+		exit(1);
+	}
+
+	memset(iv, 0, sizeof(iv));
+	memcpy(iv, &c->id, sizeof(c->id));
+	memcpy(iv + 8, "client", 6);
+
+	hc128_set_key_and_iv(&c->tx, key, 16, iv, 16);
+	iv[15] ^= 0x80;
+	hc128_set_key_and_iv(&c->rx, key, 16, iv, 16);
+	iv[15] ^= 0x80;
+
+	if(write(c->fd, iv, 16) != 16) {
+		printf("write error!\n");
+		exit(1);
+	}
+
+	set_nonblock(c->fd);
+
+	c->pending = NULL;
+	c->pending_len = 0;
+	c->pending_off = 0;
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = c;
+	epoll_ctl(cl->epoll_fd, EPOLL_CTL_ADD, c->fd, &ev);
+}
+
+static void *
+client_main(void *arg)
+{
+	struct client *cl = arg;
+	struct epoll_event events[EVENTS];
+	struct client_conn *c;
+	int i, n;
+
+	pin(cl->id);
+
+	for(i = 0; i < cl->count; i++) {
+		cl->conns[i].id = cl->first + i;
+		client_connect(cl, &cl->conns[i]);
+		atomic_fetch_add(&connected, 1);
+	}
+
+	pthread_barrier_wait(&start_messages);
+
+	for(i = 0; i < cl->count; i++) {
+		if(client_send(cl, &cl->conns[i])) {
+			printf("send error!\n");
+			exit(1);
+		}
+	}
+
+	while(!atomic_load(&stop_clients)) {
+		n = epoll_wait(cl->epoll_fd, events, EVENTS, 100);
+
+		for(i = 0; i < n; i++) {
+			c = events[i].data.ptr;
+
+			if((events[i].events & EPOLLOUT) &&
+			   send_pending(cl->epoll_fd, c->fd, c, &c->pending, &c->pending_len, &c->pending_off))
+				cl->errors++;
+
+			if((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && client_read(cl, c)) {
+				epoll_ctl(cl->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+				cl->errors++;
+			}
+		}
+	}
+
+	for(i = 0; i < cl->count; i++) {
+		close(cl->conns[i].fd);
+		free(cl->conns[i].pending);
+	}
+
+	return NULL;
+}
+
+// As many descriptors as the hard limit allows, two per connection
+static int
+raise_fd_limit(int conns)
+{
+	struct rlimit rl;
+	int max;
+
+	getrlimit(RLIMIT_NOFILE, &rl);
+	rl.rlim_cur = rl.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &rl);
+	getrlimit(RLIMIT_NOFILE, &rl);
+
+	max = (rl.rlim_cur > 0x7fffffff) ? 0x3fffffff : ((int)rl.rlim_cur - 64) / 2;
+
+	if(conns > max) {
+		printf("descriptor limit %lu: connections reduced to %d\n", (unsigned long)rl.rlim_cur, max);
+		conns = max;
+	}
+
+	return conns;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct shard *shards;
+	struct client *clients;
+	struct epoll_event ev;
+	uint64_t hist[HIST_BUCKETS], messages = 0, errors = 0, bytes = 0;
+	uint64_t setup_ns = 0, crypt_ns = 0, cpu_ns = 0, t0, t_conn, t_msg;
+	int conns = 10000, nshards, nclients, seconds = 5, opt, i, j;
+
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	nshards = nclients = ncpu;
+
+	while((opt = getopt(argc, argv, "c:m:s:l:t:")) != -1) {
+		switch(opt) {
+		case 'c':
+			conns = atoi(optarg);
+			break;
+		case 'm':
+			msg_size = atoi(optarg);
+			break;
+		case 's':
+			nshards = atoi(optarg);
+			break;
+		case 'l':
+			nclients = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		default:
+			printf("Usage: %s [-c connections] [-m message size] [-s shards] [-l client threads] [-t seconds]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if((msg_size < 1) || (msg_size > MAX_MSG) || (conns < 1) || (nshards < 1) || (nclients < 1)) {
+		printf("Bad options!\n");
+		return 1;
+	}
+
+	conns = raise_fd_limit(conns);
+	if(nclients > conns)
+		nclients = conns;
+
+	shards = xmalloc(nshards * sizeof(*shards));
+	clients = xmalloc(nclients * sizeof(*clients));
+
+	for(i = 0; i < nshards; i++) {
+		memset(&shards[i], 0, sizeof(shards[i]));
+		shards[i].id = i;
+		shards[i].listen_fd = listen_socket(i > 0);
+		shards[i].epoll_fd = epoll_create1(0);
+
+		ev.events = EPOLLIN;
+		ev.data.ptr = NULL;
+		epoll_ctl(shards[i].epoll_fd, EPOLL_CTL_ADD, shards[i].listen_fd, &ev);
+	}
+
+	for(i = 0; i < nshards; i++)
+		pthread_create(&shards[i].thread, NULL, shard_main, &shards[i]);
+
+	printf("shards = %d client threads = %d connections = %d message = %d bytes\n\n",
+	       nshards, nclients, conns, msg_size);
+
+	pthread_barrier_init(&start_messages, NULL, nclients + 1);
+
+	t0 = now_ns();
+
+	for(i = 0; i < nclients; i++) {
+		memset(&clients[i], 0, sizeof(clients[i]));
+		clients[i].id = i;
+		clients[i].epoll_fd = epoll_create1(0);
+		clients[i].first = (int)((long)conns * i / nclients);
+		clients[i].count = (int)((long)conns * (i + 1) / nclients) - clients[i].first;
+		clients[i].conns = xmalloc(clients[i].count * sizeof(struct client_conn));
+
+		pthread_create(&clients[i].thread, NULL, client_main, &clients[i]);
+	}
+
+	// Connection phase: connect, iv, contexts of both sides
+	while(atomic_load(&accepted) < conns)
+		usleep(1000);
+
+	t_conn = now_ns() - t0;
+
+	pthread_barrier_wait(&start_messages);
+
+	t0 = now_ns();
+	sleep(seconds);
+	atomic_store(&stop_clients, 1);
+	t_msg = now_ns() - t0;
+
+	for(i = 0; i < nclients; i++)
+		pthread_join(clients[i].thread, NULL);
+
+	atomic_store(&stop_server, 1);
+
+	for(i = 0; i < nshards; i++) {
+		pthread_join(shards[i].thread, NULL);
+		setup_ns += shards[i].setup_ns;
+		crypt_ns += shards[i].crypt_ns;
+		cpu_ns += shards[i].cpu_ns;
+		bytes += shards[i].bytes;
+		close(shards[i].listen_fd);
+		close(shards[i].epoll_fd);
+	}
+
+	memset(hist, 0, sizeof(hist));
+
+	for(i = 0; i < nclients; i++) {
+		for(j = 0; j < HIST_BUCKETS; j++)
+			hist[j] += clients[i].hist[j];
+
+		messages += clients[i].messages;
+		errors += clients[i].errors;
+		close(clients[i].epoll_fd);
+		free(clients[i].conns);
+	}
+
+	printf("connections/sec  = %.0f\n", conns / (t_conn / 1e9));
+	printf("messages/sec     = %.0f\n", messages / (t_msg / 1e9));
+	printf("relay MB/s       = %.1f\n", bytes / (t_msg / 1e9) / 1e6);
+	printf("latency p50      = %.1f us\n", hist_percentile(hist, messages, 0.50) / 1e3);
+	printf("latency p99      = %.1f us\n", hist_percentile(hist, messages, 0.99) / 1e3);
+	printf("server CPU       = %.2f s: key setup %.1f %%, crypt %.1f %%, other %.1f %%\n",
+	       cpu_ns / 1e9, 100.0 * setup_ns / cpu_ns, 100.0 * crypt_ns / cpu_ns,
+	       100.0 - 100.0 * (setup_ns + crypt_ns) / cpu_ns);
+
+	free(shards);
+	free(clients);
+
+	if(errors) {
+		printf("Echo errors: %lu!\n", (unsigned long)errors);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,517 @@
+/*
+ * Replay of the session traces.
+ * Trace: one record per line "session direction size [gap]", direction c
+ * (client to server) or s, size in bytes, gap in microseconds before the
+ * record; lines starting with # are comments. A session is created at its
+ * first record (a context per direction, as the server does) and destroyed
+ * at its last one.
+ * Without -f an IMIX trace is generated: -a sessions active at a time, a
+ * geometric number of records per session (mean -m), sizes 40/576/1500 in
+ * the 7:4:1 mix; -o writes it out.
+ * Every variant replays the whole trace, the time of every record (with the
+ * create and destroy of its session) goes into the histogram.
+ * Variants: crypt (hc128_crypt), bulk (hc128_crypt_bulk), cryptv (5-byte
+ * header and payload as two fragments), rekey (hc128_rekey, new epoch every
+ * REKEY_INTERVAL bytes, set up inline).
+ * Printed: MB/s, records/s, share of the session setup in the time, p50,
+ * p99, p99.9 of the record latency.
+ * Example: ./bench/replay -g 20000 -a 256 -m 20 -o imix.trace
+ *          ./bench/replay -f imix.trace -p
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "../hc128.h"
+#include "../hc128_rekey.h"
+#include "bench.h"
+
+#define MAX_RECORD	(1 << 20)
+#define REKEY_INTERVAL	65536
+#define HEADER		5
+
+enum {
+	V_CRYPT,
+	V_BULK,
+	V_CRYPTV,
+	V_REKEY,
+	VARIANTS
+};
+
+static const char *variant_name[VARIANTS] = { "crypt", "bulk", "cryptv", "rekey" };
+
+/*
+ * Record of the trace
+ * session - dense index of the session
+ * first, last - the session is created before, destroyed after the record
+*/
+struct record {
+	uint32_t session;
+	uint32_t size;
+	uint32_t gap;
+	uint8_t dir;
+	uint8_t first;
+	uint8_t last;
+};
+
+struct trace {
+	struct record *rec;
+	size_t n;
+	size_t cap;
+	uint32_t sessions;
+	uint64_t bytes;
+};
+
+// Contexts of the session, one per direction
+struct session {
+	void *ctx[2];
+};
+
+static const uint8_t key[16] = "replay key 16 b!";
+
+static void *
+xmalloc(size_t size)
+{
+	void *p = malloc(size);
+
+	if(!p) {
+		printf("malloc error!\n");
+		exit(1);
+	}
+
+	return p;
+}
+
+static void
+trace_add(struct trace *tr, uint32_t session, int dir, uint32_t size, uint32_t gap)
+{
+	struct record *r;
+
+	if(tr->n == tr->cap) {
+		tr->cap = tr->cap ? tr->cap * 2 : 4096;
+		if(!(tr->rec = realloc(tr->rec, tr->cap * sizeof(*tr->rec)))) {
+			printf("realloc error!\n");
+			exit(1);
+		}
+	}
+
+	r = &tr->rec[tr->n++];
+	r->session = session;
+	r->dir = dir;
+	r->size = size;
+	r->gap = gap;
+	r->first = r->last = 0;
+	tr->bytes += size;
+}
+
+/*
+ * Session ids of the file into dense indexes (open addressing, the table
+ * grows at half load), then the first and last record of every session.
+*/
+static void
+trace_finish(struct trace *tr, int dense)
+{
+	uint32_t *ids = NULL, *idx = NULL, cap = 0, mask, h, i;
+	uint8_t *seen;
+	size_t k;
+
+	if(!dense) {
+		cap = 1024;
+
+		for(;;) {
+			mask = cap - 1;
+			ids = xmalloc(cap * sizeof(*ids));
+			idx = xmalloc(cap * sizeof(*idx));
+			memset(idx, 0xFF, cap * sizeof(*idx));
+			tr->sessions = 0;
+
+			for(k = 0; k < tr->n; k++) {
+				h = (tr->rec[k].session * 2654435761U) & mask;
+
+				while((idx[h] != UINT32_MAX) && (ids[h] != tr->rec[k].session))
+					h = (h + 1) & mask;
+
+				if(idx[h] == UINT32_MAX) {
+					if(tr->sessions >= cap / 2)
+						break;
+					ids[h] = tr->rec[k].session;
+					idx[h] = tr->sessions++;
+				}
+			}
+
+			if(k == tr->n)
+				break;
+
+			free(ids);
+			free(idx);
+			cap *= 2;
+		}
+
+		// Second pass: the ids are all in the table now
+		for(k = 0; k < tr->n; k++) {
+			h = (tr->rec[k].session * 2654435761U) & mask;
+
+			while(ids[h] != tr->rec[k].session)
+				h = (h + 1) & mask;
+
+			tr->rec[k].session = idx[h];
+		}
+
+		free(ids);
+		free(idx);
+	}
+
+	seen = xmalloc(tr->sessions);
+
+	memset(seen, 0, tr->sessions);
+	for(k = 0; k < tr->n; k++) {
+		i = tr->rec[k].session;
+		tr->rec[k].first = !seen[i];
+		seen[i] = 1;
+	}
+
+	memset(seen, 0, tr->sessions);
+	for(k = tr->n; k-- > 0;) {
+		i = tr->rec[k].session;
+		tr->rec[k].last = !seen[i];
+		seen[i] = 1;
+	}
+
+	free(seen);
+}
+
+/*
+ * Read the trace file
+ * Return value: 0 (if all is well), -1 if all bad
+*/
+static int
+trace_read(struct trace *tr, const char *path)
+{
+	FILE *f = fopen(path, "r");
+	char line[256], dir;
+	unsigned long session, size, gap;
+	int n, lineno = 0;
+
+	if(!f)
+		return -1;
+
+	while(fgets(line, sizeof(line), f)) {
+		lineno++;
+
+		if((line[0] == '#') || (line[0] == '\n'))
+			continue;
+
+		gap = 0;
+		n = sscanf(line, "%lu %c %lu %lu", &session, &dir, &size, &gap);
+
+		if((n < 3) || ((dir != 'c') && (dir != 's')) || (size > MAX_RECORD)) {
+			printf("%s:%d: bad record!\n", path, lineno);
+			fclose(f);
+			return -1;
+		}
+
+		trace_add(tr, session, dir == 's', size, gap);
+	}
+
+	fclose(f);
+	trace_finish(tr, 0);
+
+	return 0;
+}
+
+// IMIX: 40, 576 and 1500 bytes in the 7:4:1 mix
+static uint32_t
+imix_size(void)
+{
+	int r = rand() % 12;
+
+	return (r < 7) ? 40 : (r < 11) ? 576 : 1500;
+}
+
+// Records of a session: geometric with the mean
+static uint32_t
+session_records(uint32_t mean)
+{
+	uint32_t n = 1;
+
+	while((n < 100 * mean) && (rand() % mean))
+		n++;
+
+	return n;
+}
+
+/*
+ * IMIX trace: active sessions at a time, a random active session sends
+ * every record, a finished session is replaced by a new one.
+*/
+static void
+trace_imix(struct trace *tr, uint32_t sessions, uint32_t active, uint32_t mean)
+{
+	uint32_t *id = xmalloc(active * sizeof(*id)), *left = xmalloc(active * sizeof(*left));
+	uint32_t next = 0, live = 0, i;
+
+	srand(1);
+
+	for(i = 0; (i < active) && (next < sessions); i++, live++) {
+		id[i] = next++;
+		left[i] = session_records(mean);
+	}
+
+	while(live) {
+		i = rand() % live;
+
+		trace_add(tr, id[i], rand() & 1, imix_size(), 0);
+
+		if(--left[i])
+			continue;
+
+		if(next < sessions) {
+			id[i] = next++;
+			left[i] = session_records(mean);
+		} else {
+			live--;
+			id[i] = id[live];
+			left[i] = left[live];
+		}
+	}
+
+	tr->sessions = next;
+	trace_finish(tr, 1);
+
+	free(id);
+	free(left);
+}
+
+static int
+trace_write(const struct trace *tr, const char *path)
+{
+	FILE *f = fopen(path, "w");
+	size_t k;
+
+	if(!f)
+		return -1;
+
+	fprintf(f, "# session direction size [gap us]\n");
+
+	for(k = 0; k < tr->n; k++)
+		fprintf(f, "%u %c %u %u\n", tr->rec[k].session, tr->rec[k].dir ? 's' : 'c', tr->rec[k].size, tr->rec[k].gap);
+
+	return fclose(f);
+}
+
+// Iv of the direction of the session
+static void
+session_iv(uint8_t *iv, uint32_t session, int dir)
+{
+	memset(iv, 0, 16);
+	memcpy(iv, &session, sizeof(session));
+	iv[15] = dir;
+}
+
+static void
+session_create(struct session *s, int variant, uint32_t id)
+{
+	uint8_t iv[16];
+	int d;
+
+	for(d = 0; d < 2; d++) {
+		session_iv(iv, id, d);
+
+		if(variant == V_REKEY) {
+			if(!(s->ctx[d] = hc128_rekey_create(key, iv, REKEY_INTERVAL, HC128_REKEY_SYNC))) {
+				printf("Rekey stream create error!\n");
+				exit(1);
+			}
+			continue;
+		}
+
+		s->ctx[d] = xmalloc(sizeof(struct hc128_context));
+		hc128_set_key_and_iv(s->ctx[d], key, 16, iv, 16);
+	}
+}
+
+static void
+session_destroy(struct session *s, int variant)
+{
+	int d;
+
+	for(d = 0; d < 2; d++) {
+		if(variant == V_REKEY) {
+			hc128_rekey_destroy(s->ctx[d]);
+		} else {
+			memset(s->ctx[d], 0, sizeof(struct hc128_context));
+			free(s->ctx[d]);
+		}
+
+		s->ctx[d] = NULL;
+	}
+}
+
+static void
+record_crypt(void *ctx, int variant, uint8_t *buf, uint32_t size)
+{
+	struct iovec v[2];
+
+	switch(variant) {
+	case V_CRYPT:
+		hc128_crypt(ctx, buf, size, buf);
+		break;
+	case V_BULK:
+		hc128_crypt_bulk(ctx, buf, size, buf);
+		break;
+	case V_CRYPTV:
+		v[0].iov_base = buf;
+		v[0].iov_len = (size < HEADER) ? size : HEADER;
+		v[1].iov_base = buf + v[0].iov_len;
+		v[1].iov_len = size - v[0].iov_len;
+		hc128_cryptv(ctx, v, 2, v, 2);
+		break;
+	default:
+		hc128_rekey_crypt(ctx, buf, size, buf);
+	}
+}
+
+// Busy wait for the gap, the sleep granularity is too coarse
+static void
+wait_gap(uint64_t until)
+{
+	while(now_ns() < until)
+		;
+}
+
+static void
+replay(const struct trace *tr, int variant, int pace, uint8_t *buf)
+{
+	struct session *s = xmalloc(tr->sessions * sizeof(*s));
+	static uint64_t hist[HIST_BUCKETS];
+	uint64_t t, t0, setup = 0, start, busy = 0, due = 0;
+	const struct record *r;
+	size_t k;
+
+	memset(hist, 0, sizeof(hist));
+	start = now_ns();
+
+	for(k = 0; k < tr->n; k++) {
+		r = &tr->rec[k];
+
+		if(pace && r->gap) {
+			due = ((due > now_ns()) ? due : now_ns()) + r->gap * 1000ULL;
+			wait_gap(due);
+		}
+
+		t = now_ns();
+
+		if(r->first) {
+			session_create(&s[r->session], variant, r->session);
+			t0 = now_ns();
+			setup += t0 - t;
+		}
+
+		record_crypt(s[r->session].ctx[r->dir], variant, buf, r->size);
+
+		if(r->last) {
+			t0 = now_ns();
+			session_destroy(&s[r->session], variant);
+			setup += now_ns() - t0;
+		}
+
+		t = now_ns() - t;
+		busy += t;
+		hist[hist_bucket(t)]++;
+	}
+
+	t = now_ns() - start;
+
+	printf("%-8s %10.1f %12.0f %9.1f%% %10.2f %10.2f %10.2f\n", variant_name[variant], tr->bytes / (busy / 1e3),
+	       tr->n / (busy / 1e9), 100.0 * setup / busy, hist_percentile(hist, tr->n, 0.50) / 1e3,
+	       hist_percentile(hist, tr->n, 0.99) / 1e3, hist_percentile(hist, tr->n, 0.999) / 1e3);
+
+	if(pace)
+		printf("%-8s wall time %.2f s\n", "", t / 1e9);
+
+	free(s);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct trace tr;
+	const char *in = NULL, *out = NULL;
+	uint32_t sessions = 20000, active = 256, mean = 20;
+	uint8_t *buf;
+	int pace = 0, opt, v;
+
+	while((opt = getopt(argc, argv, "f:g:a:m:o:p")) != -1) {
+		switch(opt) {
+		case 'f':
+			in = optarg;
+			break;
+		case 'g':
+			sessions = strtoul(optarg, NULL, 10);
+			break;
+		case 'a':
+			active = strtoul(optarg, NULL, 10);
+			break;
+		case 'm':
+			mean = strtoul(optarg, NULL, 10);
+			break;
+		case 'o':
+			out = optarg;
+			break;
+		case 'p':
+			pace = 1;
+			break;
+		default:
+			printf("Usage: %s [-f trace | -g sessions -a active -m records per session] [-o trace out] [-p]\n",
+			       argv[0]);
+			return 1;
+		}
+	}
+
+	if(!sessions || !active || !mean) {
+		printf("Sessions, active sessions and records per session > 0!\n");
+		return 1;
+	}
+
+	memset(&tr, 0, sizeof(tr));
+
+	if(in) {
+		if(trace_read(&tr, in)) {
+			printf("Trace read error!\n");
+			return 1;
+		}
+	} else {
+		trace_imix(&tr, sessions, active, mean);
+	}
+
+	if(out && trace_write(&tr, out)) {
+		printf("Trace write error!\n");
+		return 1;
+	}
+
+	if(!tr.n) {
+		printf("Empty trace!\n");
+		return 1;
+	}
+
+	buf = xmalloc(MAX_RECORD);
+	memset(buf, 0, MAX_RECORD);
+
+	printf("trace: %s, %zu records, %u sessions, %.1f MB, %.1f bytes per record\n\n", in ? in : "IMIX", tr.n,
+	       tr.sessions, tr.bytes / 1e6, (double)tr.bytes / tr.n);
+	printf("%-8s %10s %12s %10s %10s %10s %10s\n", "variant", "MB/s", "records/s", "setup", "p50 us", "p99 us",
+	       "p99.9 us");
+
+	for(v = 0; v < VARIANTS; v++)
+		replay(&tr, v, pace, buf);
+
+	free(buf);
+	free(tr.rec);
+
+	return 0;
+}
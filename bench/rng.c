@@ -0,0 +1,216 @@
+/*
+ * Benchmark of the HC-128 random number generator.
+ * Small requests of hc128_rng_bytes() and getrandom() are compared,
+ * every thread makes the same number of requests.
+ * First the output across the automatic reseeds is checked, -c runs only
+ * the check.
+ * Example: ./bench/rng 4
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/random.h>
+
+#include "../hc128_rng.h"
+
+#define REQUESTS	1000000
+
+// Reseeds crossed by every check
+#define RESEEDS		4
+
+struct job {
+	size_t size;
+	int source;
+};
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *
+worker(void *arg)
+{
+	struct job *job = arg;
+	uint8_t buf[256];
+	uint64_t sum = 0;
+	long i;
+
+	for(i = 0; i < REQUESTS; i++) {
+		if(job->source == 0)
+			hc128_rng_bytes(buf, job->size);
+		else if(getrandom(buf, job->size, 0) != (ssize_t)job->size) {
+			printf("getrandom error!\n");
+			exit(1);
+		}
+
+		sum += buf[0];
+	}
+
+	return (void *)(uintptr_t)sum;
+}
+
+// Zero values of n calls of hc128_rng_u32() (size 4) or hc128_rng_u64() (size 8)
+static long
+zero_values(int size, long n)
+{
+	long i, z = 0;
+
+	for(i = 0; i < n; i++)
+		z += (size == 4) ? (hc128_rng_u32() == 0) : (hc128_rng_u64() == 0);
+
+	return z;
+}
+
+// Zero 8 byte words of n hc128_rng_bytes() requests of len bytes
+static long
+zero_words(uint8_t *buf, size_t len, long n)
+{
+	uint64_t v;
+	long i, z = 0;
+	size_t k;
+
+	for(i = 0; i < n; i++) {
+		memset(buf, 0, len);
+		hc128_rng_bytes(buf, len);
+
+		for(k = 0; k + 8 <= len; k += 8) {
+			memcpy(&v, buf + k, 8);
+			z += (v == 0);
+		}
+	}
+
+	return z;
+}
+
+/*
+ * The values stay random across RESEEDS automatic reseeds at the smallest
+ * interval (one buffer): u32 and u64 values, small requests which leave
+ * the buffer partly used, large requests served directly, and after the
+ * interval was lowered below the bytes generated since the last reseed.
+ * Return value: 0 (if all is well), 1 if the output degenerates
+*/
+static int
+check_reseed(void)
+{
+	static uint8_t big[3 * HC128_RNG_BUFLEN + 64];
+	uint8_t small[24];
+	const char *fail = NULL;
+
+	hc128_rng_reseed();
+	hc128_rng_set_reseed_interval(HC128_RNG_BUFLEN);
+
+	// A zero u32 is 2^-32 per value, one is let through
+	if(zero_values(4, RESEEDS * HC128_RNG_BUFLEN / 4) > 1)
+		fail = "u32";
+	else if(zero_values(8, RESEEDS * HC128_RNG_BUFLEN / 8))
+		fail = "u64";
+	else if(zero_words(small, sizeof(small), RESEEDS * HC128_RNG_BUFLEN / sizeof(small)))
+		fail = "small requests";
+	else if(zero_words(big, sizeof(big), RESEEDS))
+		fail = "large requests";
+	else {
+		// Part of an interval generated at the default, then the interval lowered
+		hc128_rng_set_reseed_interval(HC128_RNG_RESEED);
+		zero_values(8, 5 * HC128_RNG_BUFLEN / 8);
+		hc128_rng_set_reseed_interval(HC128_RNG_BUFLEN);
+
+		if(zero_values(8, RESEEDS * HC128_RNG_BUFLEN / 8) || zero_words(big, sizeof(big), RESEEDS))
+			fail = "lowered interval";
+	}
+
+	hc128_rng_set_reseed_interval(HC128_RNG_RESEED);
+
+	if(fail) {
+		printf("rng: zero values across the reseeds (%s)!\n", fail);
+		return 1;
+	}
+
+	printf("rng reseed check: ok\n");
+
+	return 0;
+}
+
+// Run the job on the threads, return requests per second of all threads
+static double
+run(struct job *job, int threads)
+{
+	pthread_t tid[threads];
+	double t;
+	int i;
+
+	t = now();
+
+	for(i = 0; i < threads; i++) {
+		if(pthread_create(&tid[i], NULL, worker, job)) {
+			printf("Error create thread!\n");
+			exit(1);
+		}
+	}
+
+	for(i = 0; i < threads; i++)
+		pthread_join(tid[i], NULL);
+
+	return (double)REQUESTS * threads / (now() - t);
+}
+
+int
+main(int argc, char *argv[])
+{
+	static const size_t sizes[] = { 4, 8, 16, 32, 64, 256 };
+	struct job job;
+	double hc, sys, t;
+	uint64_t sum = 0;
+	int threads = 1;
+	unsigned int i;
+	long k;
+
+	if(check_reseed())
+		return 1;
+
+	if((argc > 1) && !strcmp(argv[1], "-c"))
+		return 0;
+
+	if(argc > 1)
+		threads = atoi(argv[1]);
+
+	if(threads < 1)
+		threads = 1;
+
+	printf("threads = %d\n", threads);
+	printf("%6s %16s %16s %8s\n", "size", "hc128 req/s", "getrandom req/s", "speedup");
+
+	for(i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		job.size = sizes[i];
+
+		job.source = 0;
+		hc = run(&job, threads);
+
+		job.source = 1;
+		sys = run(&job, threads);
+
+		printf("%6zu %16.0f %16.0f %8.1f\n", sizes[i], hc, sys, hc / sys);
+	}
+
+	t = now();
+	for(k = 0; k < REQUESTS; k++)
+		sum += hc128_rng_u32();
+	printf("\nhc128_rng_u32:     %.1f ns/call\n", (now() - t) * 1e9 / REQUESTS);
+
+	t = now();
+	for(k = 0; k < REQUESTS; k++)
+		sum += hc128_rng_uniform(1000);
+	printf("hc128_rng_uniform: %.1f ns/call (%llu)\n", (now() - t) * 1e9 / REQUESTS,
+	       (unsigned long long)(sum & 1));
+
+	return 0;
+}
@@ -0,0 +1,313 @@
+/*
+ * Scaling of the throughput of independent streams over the cores.
+ * T threads, each with its own context and buffer (allocated and touched by
+ * the thread, so it is local to its node), encrypt their buffer in place
+ * again and again for -d milliseconds, in calls of CHUNK bytes. The buffer
+ * sizes go from L1 to DRAM, for every size T doubles up to -t.
+ * Printed: GB/s of all threads, GB/s per thread and the efficiency, the
+ * speed over T times the speed of one thread of the same size. Where the
+ * efficiency falls with the size the shared caches or the memory bandwidth
+ * are the limit.
+ * -p pins thread i to the i-th cpu of the order of -m:
+ * spread - one thread per core first, the SMT siblings after all cores
+ * compact - both siblings of a core before the next core
+ * nosmt - one thread per core, no siblings (-t is at most the cores)
+ * Spread and compact at the same T are the SMT comparison. The cores and
+ * siblings come from /sys/devices/system/cpu, a cpu without topology is a
+ * core of its own.
+ * Example: ./bench/scaling -p -m compact -s 16,256,4096,65536 -d 200
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+#include "../hc128.h"
+#include "bench.h"
+
+#define MAX_SIZES	16
+#define CHUNK		65536
+
+enum {
+	M_SPREAD,
+	M_COMPACT,
+	M_NOSMT
+};
+
+static const char *mode_name[] = { "spread", "compact", "nosmt" };
+
+struct worker {
+	pthread_t thread;
+	int cpu;
+	uint32_t id;
+	size_t size;
+	uint64_t bytes;
+};
+
+static pthread_barrier_t start_barrier;
+static atomic_int stop;
+
+static void *
+xmalloc(size_t size)
+{
+	void *p = malloc(size);
+
+	if(!p) {
+		printf("malloc error!\n");
+		exit(1);
+	}
+
+	return p;
+}
+
+// First cpu of the siblings of the cpu: the core, the cpu itself if unknown
+static int
+core_of(int cpu)
+{
+	char path[128];
+	FILE *f;
+	int core;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+
+	if(!(f = fopen(path, "r")))
+		return cpu;
+
+	if(fscanf(f, "%d", &core) != 1)
+		core = cpu;
+
+	fclose(f);
+
+	return core;
+}
+
+/*
+ * Order of the cpus of the process for the mode
+ * Return value: cpus in the order
+*/
+static int
+cpu_order(int *order, int mode)
+{
+	cpu_set_t set;
+	int cpus[CPU_SETSIZE], core[CPU_SETSIZE], n = 0, k = 0, i, j;
+
+	CPU_ZERO(&set);
+	if(sched_getaffinity(0, sizeof(set), &set))
+		return 0;
+
+	for(i = 0; i < CPU_SETSIZE; i++) {
+		if(CPU_ISSET(i, &set)) {
+			cpus[n] = i;
+			core[n++] = core_of(i);
+		}
+	}
+
+	// The first sibling is not ours: the cpu is the core
+	for(i = 0; i < n; i++) {
+		for(j = 0; (j < n) && (cpus[j] != core[i]); j++)
+			;
+
+		if(j == n)
+			core[i] = cpus[i];
+	}
+
+	for(i = 0; i < n; i++) {
+		if(core[i] != cpus[i])
+			continue;
+
+		order[k++] = cpus[i];
+
+		if(mode == M_COMPACT)
+			for(j = 0; j < n; j++)
+				if((core[j] == cpus[i]) && (j != i))
+					order[k++] = cpus[j];
+	}
+
+	// Siblings after all cores
+	if(mode == M_SPREAD)
+		for(i = 0; i < n; i++)
+			if(core[i] != cpus[i])
+				order[k++] = cpus[i];
+
+	return k;
+}
+
+static void *
+worker_run(void *arg)
+{
+	struct worker *w = arg;
+	struct hc128_context ctx;
+	uint8_t key[16], iv[16], *buf;
+	size_t off, n;
+	cpu_set_t set;
+
+	if(w->cpu >= 0) {
+		CPU_ZERO(&set);
+		CPU_SET(w->cpu, &set);
+		pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	}
+
+	memset(key, 0x5A, sizeof(key));
+	memset(iv, 0, sizeof(iv));
+	memcpy(iv, &w->id, sizeof(w->id));
+	hc128_set_key_and_iv(&ctx, key, 16, iv, 16);
+
+	// One pass before the start: page faults and caches
+	buf = xmalloc(w->size);
+	memset(buf, 0, w->size);
+	hc128_crypt(&ctx, buf, w->size, buf);
+
+	pthread_barrier_wait(&start_barrier);
+
+	for(off = 0; !atomic_load_explicit(&stop, memory_order_relaxed); off += n) {
+		if(off == w->size)
+			off = 0;
+
+		n = (w->size - off < CHUNK) ? w->size - off : CHUNK;
+		hc128_crypt(&ctx, buf + off, n, buf + off);
+		w->bytes += n;
+	}
+
+	free(buf);
+
+	return NULL;
+}
+
+// GB/s of the threads
+static double
+run(int threads, size_t size, const int *order, int ncpu, uint32_t ms)
+{
+	struct worker *w = xmalloc(threads * sizeof(*w));
+	struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+	uint64_t t, bytes = 0;
+	int i;
+
+	pthread_barrier_init(&start_barrier, NULL, threads + 1);
+	atomic_store(&stop, 0);
+
+	for(i = 0; i < threads; i++) {
+		memset(&w[i], 0, sizeof(w[i]));
+		w[i].id = i;
+		w[i].size = size;
+		w[i].cpu = order ? order[i % ncpu] : -1;
+
+		if(pthread_create(&w[i].thread, NULL, worker_run, &w[i])) {
+			printf("Thread create error!\n");
+			exit(1);
+		}
+	}
+
+	pthread_barrier_wait(&start_barrier);
+	t = now_ns();
+
+	nanosleep(&ts, NULL);
+	atomic_store(&stop, 1);
+
+	for(i = 0; i < threads; i++) {
+		pthread_join(w[i].thread, NULL);
+		bytes += w[i].bytes;
+	}
+
+	t = now_ns() - t;
+
+	pthread_barrier_destroy(&start_barrier);
+	free(w);
+
+	return bytes / (double)t;
+}
+
+// Comma separated sizes in KB
+static int
+parse_sizes(const char *s, size_t *sizes)
+{
+	char *end;
+	int n = 0;
+
+	while(*s && (n < MAX_SIZES)) {
+		sizes[n] = strtoul(s, &end, 10) * 1024;
+
+		if((end == s) || !sizes[n])
+			return 0;
+
+		n++;
+		s = (*end == ',') ? end + 1 : end;
+	}
+
+	return n;
+}
+
+int
+main(int argc, char *argv[])
+{
+	static int order[CPU_SETSIZE];
+	size_t sizes[MAX_SIZES] = { 16 << 10, 256 << 10, 4 << 20, 64 << 20 };
+	uint32_t ms = 200;
+	int nsizes = 4, pin = 0, mode = M_SPREAD, max = 0, ncpu, opt, s, t;
+	double gbs, gbs1;
+
+	while((opt = getopt(argc, argv, "t:s:d:pm:")) != -1) {
+		switch(opt) {
+		case 't':
+			max = atoi(optarg);
+			break;
+		case 's':
+			nsizes = parse_sizes(optarg, sizes);
+			break;
+		case 'd':
+			ms = strtoul(optarg, NULL, 10);
+			break;
+		case 'p':
+			pin = 1;
+			break;
+		case 'm':
+			for(mode = M_NOSMT; (mode >= 0) && strcmp(optarg, mode_name[mode]); mode--)
+				;
+			break;
+		default:
+			mode = -1;
+		}
+	}
+
+	ncpu = cpu_order(order, mode < 0 ? M_SPREAD : mode);
+
+	if(!max)
+		max = ncpu;
+
+	if((mode < 0) || !nsizes || !ms || (max < 1) || !ncpu || ((mode == M_NOSMT) && (max > ncpu))) {
+		printf("Usage: %s [-t max threads] [-s KB,KB,...] [-d ms] [-p] [-m spread|compact|nosmt]\n", argv[0]);
+		if(mode == M_NOSMT)
+			printf("nosmt: at most %d threads\n", ncpu);
+		return 1;
+	}
+
+	printf("cpus = %d (%s), pinned = %s, %u ms per cell\n\n", ncpu, mode_name[mode], pin ? "yes" : "no", ms);
+	printf("%10s %8s %10s %12s %10s %10s\n", "size KB", "threads", "GB/s", "GB/s/thread", "efficiency",
+	       "total MB");
+
+	for(s = 0; s < nsizes; s++) {
+		gbs1 = 0;
+
+		for(t = 1;; t = (t * 2 > max) ? max : t * 2) {
+			gbs = run(t, sizes[s], pin ? order : NULL, ncpu, ms);
+
+			if(t == 1)
+				gbs1 = gbs;
+
+			printf("%10zu %8d %10.3f %12.3f %9.1f%% %10.1f\n", sizes[s] >> 10, t, gbs, gbs / t,
+			       100 * gbs / (gbs1 * t), (double)sizes[s] * t / (1 << 20));
+
+			if(t == max)
+				break;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,340 @@
+/*
+ * Benchmark of the session hibernation tier hc128_sessions.c.
+ * All sessions are opened, a few percent stay active, the clock hibernates
+ * the rest. Printed: resident and hibernated counts, RSS before and after,
+ * and the wake-up latency from the page cache, from the disk (the file
+ * pages dropped from the cache) and from the disk after the prefetch.
+ * The keystream of sample sessions is checked across hibernation, their
+ * records in the file must not show the serialized context, and a record
+ * changed in the file must not wake up. -c runs only the checks, on
+ * 2 * 997 sessions by default.
+ * Example: ./bench/sessions 100000 5 /tmp
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../hc128.h"
+#include "../hc128_sessions.h"
+#include "bench.h"
+
+#define IDLE		10
+#define SAMPLE		997
+#define WAKE_RUNS	2000
+#define PREFETCH	64
+
+static const uint8_t key[16] = "session key 16b!";
+
+static void *
+xmalloc(size_t size)
+{
+	void *p = malloc(size);
+
+	if(!p) {
+		printf("malloc error!\n");
+		exit(1);
+	}
+
+	return p;
+}
+
+// Resident set of the process in MB
+static double
+rss_mb(void)
+{
+	unsigned long size, resident;
+	FILE *f = fopen("/proc/self/statm", "r");
+
+	if(!f || (fscanf(f, "%lu %lu", &size, &resident) != 2)) {
+		if(f)
+			fclose(f);
+		return 0;
+	}
+
+	fclose(f);
+
+	return resident * (double)sysconf(_SC_PAGESIZE) / (1 << 20);
+}
+
+static void
+session_iv(uint8_t *iv, uint32_t id)
+{
+	memset(iv, 0, 16);
+	memcpy(iv, &id, sizeof(id));
+}
+
+static int
+cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+// Wake WAKE_RUNS random hibernated sessions, print p50 and p99
+static int
+wake_latency(struct hc128_sessions *s, uint32_t n, uint32_t active, const char *name, int prefetch)
+{
+	static uint64_t lat[WAKE_RUNS];
+	uint32_t ids[PREFETCH], id;
+	uint8_t block[64];
+	uint64_t t;
+	int i, k, m = 0;
+
+	for(i = 0; i < WAKE_RUNS; i += PREFETCH) {
+		m = (WAKE_RUNS - i < PREFETCH) ? WAKE_RUNS - i : PREFETCH;
+
+		// Random idle sessions, never the active ones at the start
+		for(k = 0; k < m; k++) {
+			id = active + (uint32_t)(((uint64_t)rand() * RAND_MAX + rand()) % (n - active));
+			ids[k] = id;
+		}
+
+		if(prefetch)
+			hc128_sessions_prefetch(s, ids, m);
+
+		for(k = 0; k < m; k++) {
+			struct hc128_context *ctx;
+
+			t = now_ns();
+			ctx = hc128_sessions_get(s, ids[k]);
+			if(!ctx)
+				return -1;
+			hc128_crypt(ctx, block, sizeof(block), block);
+			lat[i + k] = now_ns() - t;
+		}
+	}
+
+	qsort(lat, WAKE_RUNS, sizeof(lat[0]), cmp_u64);
+
+	printf("%-24s p50 %8.1f us   p99 %8.1f us\n", name, lat[WAKE_RUNS / 2] / 1e3, lat[WAKE_RUNS * 99 / 100] / 1e3);
+
+	return 0;
+}
+
+// Hibernate everything idle: two clock passes
+static void
+sweep(struct hc128_sessions *s, uint64_t *clock, uint32_t n)
+{
+	*clock += IDLE;
+	hc128_sessions_tick(s, *clock, n);
+	*clock += IDLE;
+	hc128_sessions_tick(s, *clock, n);
+}
+
+// Drop the clean file pages from the page cache
+static void
+drop_cache(const char *path)
+{
+	int fd = open(path, O_RDONLY);
+
+	if(fd < 0)
+		return;
+
+	fdatasync(fd);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+}
+
+/*
+ * The records of the hibernated sample sessions do not contain their
+ * serialized context (ref), a flipped byte in a record makes the wake-up
+ * fail until it is flipped back
+ * Return value: 0 (if all is well), 1 if all bad
+*/
+static int
+check_sealed(struct hc128_sessions *s, const char *path, struct hc128_context *ref, uint32_t nref,
+	     uint32_t active, uint32_t n)
+{
+	uint8_t ser[HC128_SERIALIZED_MAX], rec[HC128_SESSIONS_RECORD], c;
+	uint32_t i, id, len;
+	off_t off;
+	int fd, bad = 0;
+
+	if((fd = open(path, O_RDWR)) < 0) {
+		printf("Session file open error!\n");
+		return 1;
+	}
+
+	for(i = 0; i < nref; i++) {
+		id = i * SAMPLE;
+
+		if(id < active)
+			continue;
+
+		len = hc128_serialize(&ref[i], ser);
+
+		if((pread(fd, rec, sizeof(rec), (off_t)id * HC128_SESSIONS_RECORD) != sizeof(rec)) ||
+		   memmem(rec, sizeof(rec), ser, 64) || memmem(rec, sizeof(rec), ser + len - 64, 64)) {
+			printf("Session %u: serialized context in the clear in the file!\n", id);
+			bad = 1;
+		}
+	}
+
+	// The last session is idle, its record is changed
+	off = (off_t)(n - 1) * HC128_SESSIONS_RECORD + 100;
+
+	if(pread(fd, &c, 1, off) != 1)
+		bad = 1;
+
+	c ^= 1;
+	if((pwrite(fd, &c, 1, off) != 1) || hc128_sessions_get(s, n - 1)) {
+		printf("Session %u: changed record woke up!\n", n - 1);
+		bad = 1;
+	}
+
+	c ^= 1;
+	if((pwrite(fd, &c, 1, off) != 1) || !hc128_sessions_get(s, n - 1)) {
+		printf("Session %u: record lost!\n", n - 1);
+		bad = 1;
+	}
+
+	close(fd);
+
+	printf("sealed records check: %s\n", bad ? "failed" : "ok");
+
+	return bad;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct hc128_sessions *s;
+	struct hc128_sessions_stats st;
+	struct hc128_context *ref, *ctx;
+	int check = (argc > 1) && !strcmp(argv[1], "-c");
+	uint32_t n = (argc > 1 + check) ? strtoul(argv[1 + check], NULL, 10) : (check ? 2 * SAMPLE : 100000);
+	uint32_t percent = (argc > 2 + check) ? atoi(argv[2 + check]) : 5;
+	const char *dir = (argc > 3 + check) ? argv[3 + check] : "/tmp";
+	uint8_t iv[16], a[200], b[200];
+	uint32_t id, active, nref, i;
+	uint64_t clock = 0, t;
+	double rss_base, rss_open, rss_hib;
+	char path[4096];
+
+	if((n < 2 * SAMPLE) || (percent >= 100)) {
+		printf("Usage: %s [-c] [sessions >= %d] [active percent] [dir]\n", argv[0], 2 * SAMPLE);
+		return 1;
+	}
+
+	snprintf(path, sizeof(path), "%s/hc128_sessions_bench.%d", dir, (int)getpid());
+
+	active = (uint64_t)n * percent / 100;
+	nref = n / SAMPLE;
+	ref = xmalloc(nref * sizeof(*ref));
+
+	rss_base = rss_mb();
+
+	if(!(s = hc128_sessions_create(path, n, IDLE))) {
+		printf("Session store create error!\n");
+		return 1;
+	}
+
+	t = now_ns();
+	for(id = 0; id < n; id++) {
+		session_iv(iv, id);
+
+		if(hc128_sessions_open(s, id, key, 16, iv, 16)) {
+			printf("Session open error!\n");
+			return 1;
+		}
+	}
+	t = now_ns() - t;
+
+	// Sample sessions leave unused keystream bytes behind
+	for(i = 0; i < nref; i++) {
+		id = i * SAMPLE;
+		session_iv(iv, id);
+		hc128_set_key_and_iv(&ref[i], key, 16, iv, 16);
+		hc128_keystream(&ref[i], a, 100);
+		hc128_keystream(hc128_sessions_get(s, id), b, 100);
+	}
+
+	rss_open = rss_mb();
+
+	printf("sessions = %u active = %u context = %zu bytes serialized = %d bytes\n", n, active,
+	       sizeof(struct hc128_context), HC128_SERIALIZED_MIN);
+	printf("open: %.1f sessions/ms\n\n", n / (t / 1e6));
+
+	// The active sessions are used between the clock passes
+	t = now_ns();
+	for(i = 0; i < 4; i++) {
+		for(id = 0; id < active; id++)
+			hc128_sessions_get(s, id);
+
+		clock += IDLE;
+		hc128_sessions_tick(s, clock, n);
+	}
+	t = now_ns() - t;
+
+	rss_hib = rss_mb();
+	hc128_sessions_stats(s, &st);
+
+	printf("resident = %u hibernated = %u (clock passes %.1f ms)\n", st.resident, st.hibernated, t / 1e6);
+	printf("RSS: base %.1f MB, all resident %.1f MB, after hibernation %.1f MB, saved %.0f bytes per idle session\n\n",
+	       rss_base, rss_open, rss_hib, (rss_open - rss_hib) * (1 << 20) / st.hibernated);
+
+	if(check_sealed(s, path, ref, nref, active, n))
+		return 1;
+
+	// The keystream goes on across the hibernation
+	for(i = 0; i < nref; i++) {
+		id = i * SAMPLE;
+
+		if(!(ctx = hc128_sessions_get(s, id))) {
+			printf("Session %u lost!\n", id);
+			return 1;
+		}
+
+		hc128_keystream(&ref[i], a, sizeof(a));
+		hc128_keystream(ctx, b, sizeof(b));
+
+		if(memcmp(a, b, sizeof(a))) {
+			printf("Session %u keystream mismatch after wake-up!\n", id);
+			return 1;
+		}
+	}
+
+	printf("keystream check: %u sessions ok\n\n", nref);
+
+	if(check) {
+		hc128_sessions_destroy(s);
+		unlink(path);
+		free(ref);
+
+		return 0;
+	}
+
+	srand(1);
+	sweep(s, &clock, n);
+	if(wake_latency(s, n, active, "wake-up, page cache", 0))
+		return 1;
+
+	sweep(s, &clock, n);
+	drop_cache(path);
+	if(wake_latency(s, n, active, "wake-up, disk", 0))
+		return 1;
+
+	sweep(s, &clock, n);
+	drop_cache(path);
+	if(wake_latency(s, n, active, "wake-up, disk, prefetch", 1))
+		return 1;
+
+	hc128_sessions_stats(s, &st);
+	printf("\nhibernations = %lu wakeups = %lu\n", (unsigned long)st.hibernations, (unsigned long)st.wakeups);
+
+	if(hc128_sessions_destroy(s))
+		printf("Session store destroy error!\n");
+
+	unlink(path);
+	free(ref);
+
+	return 0;
+}
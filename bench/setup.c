@@ -0,0 +1,299 @@
+/*
+ * Latency distribution of the context setup.
+ * Every setup is timed and counted in a histogram with 16 linear buckets
+ * per power of two, printed are p50, p99, p99.9 and max.
+ * Scenarios:
+ * warm - the same context again and again
+ * cold - the next context of an arena of -c contexts, visited round-robin,
+ * so the context has long left the caches
+ * threads - the cold scenario in -t threads at once, an arena per thread
+ * Variants:
+ * standard - hc128_set_key_and_iv()
+ * split - the ECRYPT API on the engine (hc-128-engine.c): ECRYPT_keysetup()
+ * once per context, ECRYPT_ivsetup() timed
+ * batched - hc128_set_key_and_iv_multi() of BATCH contexts, each context of
+ * the batch waits for the whole batch, that is its latency
+ * pooled - context taken from a LIFO pool shared by the threads, set up and
+ * given back; the arena slot of the connection is only read. Acquire and
+ * release are timed with the setup.
+ * Example: ./bench/setup -n 20000 -c 8192 -t 4
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "../hc128.h"
+#include "../hc128_sources/ecrypt-sync.h"
+#include "bench.h"
+
+#define BATCH		4
+#define POOL_SIZE	64
+
+enum {
+	V_STANDARD,
+	V_SPLIT,
+	V_BATCHED,
+	V_POOLED,
+	VARIANTS
+};
+
+static const char *variant_name[VARIANTS] = { "standard", "split", "batched", "pooled" };
+
+/*
+ * Thread of the run
+ * arena - contexts visited round-robin (ECRYPT contexts for split)
+ * n - contexts in the arena, 1 (BATCH for batched) if warm
+*/
+struct worker {
+	pthread_t thread;
+	int variant;
+	uint32_t calls;
+	uint32_t id;
+
+	void *arena;
+	uint32_t n;
+
+	uint64_t hist[HIST_BUCKETS];
+	uint64_t max;
+};
+
+// LIFO pool of the contexts shared by the threads
+static struct {
+	pthread_mutex_t mutex;
+	struct hc128_context *free[POOL_SIZE];
+	int top;
+} pool = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+
+static const uint8_t key[16] = "setup key 16 b!!";
+
+static void *
+xmalloc(size_t size)
+{
+	void *p = malloc(size);
+
+	if(!p) {
+		printf("malloc error!\n");
+		exit(1);
+	}
+
+	return p;
+}
+
+static void
+record(struct worker *w, uint64_t t, int n)
+{
+	w->hist[hist_bucket(t)] += n;
+
+	if(t > w->max)
+		w->max = t;
+}
+
+// Different iv for every call of every thread
+static void
+call_iv(uint8_t *iv, uint32_t id, uint32_t call)
+{
+	memset(iv, 0, 16);
+	memcpy(iv, &call, sizeof(call));
+	memcpy(iv + 4, &id, sizeof(id));
+}
+
+static struct hc128_context *
+pool_get(void)
+{
+	struct hc128_context *ctx;
+
+	pthread_mutex_lock(&pool.mutex);
+	ctx = pool.free[--pool.top];
+	pthread_mutex_unlock(&pool.mutex);
+
+	return ctx;
+}
+
+static void
+pool_put(struct hc128_context *ctx)
+{
+	pthread_mutex_lock(&pool.mutex);
+	pool.free[pool.top++] = ctx;
+	pthread_mutex_unlock(&pool.mutex);
+}
+
+static void *
+worker_run(void *arg)
+{
+	struct worker *w = arg;
+	struct hc128_context *arena = w->arena, *ctx, *batch[BATCH];
+	ECRYPT_ctx *earena = w->arena;
+	uint8_t iv[BATCH][16];
+	volatile uint32_t sink = 0;
+	uint32_t call, slot = 0, k;
+	uint64_t t;
+
+	for(call = 0; call < w->calls; call++) {
+		call_iv(iv[0], w->id, call);
+
+		switch(w->variant) {
+		case V_STANDARD:
+			t = now_ns();
+			hc128_set_key_and_iv(&arena[slot], key, 16, iv[0], 16);
+			record(w, now_ns() - t, 1);
+			break;
+		case V_SPLIT:
+			t = now_ns();
+			ECRYPT_ivsetup(&earena[slot], iv[0]);
+			record(w, now_ns() - t, 1);
+			break;
+		case V_BATCHED:
+			for(k = 0; k < BATCH; k++) {
+				batch[k] = &arena[(slot + k) % w->n];
+				call_iv(iv[k], w->id, call + k);
+			}
+
+			t = now_ns();
+			hc128_set_key_and_iv_multi(batch, BATCH, key, 16, (const uint8_t (*)[16])iv, 16);
+			record(w, now_ns() - t, BATCH);
+
+			call += BATCH - 1;
+			slot = (slot + BATCH - 1) % w->n;
+			break;
+		default:
+			// The connection state is in the arena, the context in the pool
+			sink += arena[slot].counter;
+
+			t = now_ns();
+			ctx = pool_get();
+			hc128_set_key_and_iv(ctx, key, 16, iv[0], 16);
+			pool_put(ctx);
+			record(w, now_ns() - t, 1);
+		}
+
+		if(++slot == w->n)
+			slot = 0;
+	}
+
+	return NULL;
+}
+
+/*
+ * One scenario of the variant in nthreads threads
+ * contexts - arena of every thread, 0 for the warm scenario
+*/
+static void
+run(const char *scenario, int variant, int nthreads, uint32_t contexts, uint32_t calls)
+{
+	struct worker *w = xmalloc(nthreads * sizeof(*w));
+	uint64_t hist[HIST_BUCKETS], max = 0, total = 0;
+	ECRYPT_ctx *e;
+	uint32_t k;
+	int i, j;
+
+	for(i = 0; i < nthreads; i++) {
+		memset(&w[i], 0, sizeof(w[i]));
+
+		w[i].variant = variant;
+		w[i].calls = calls;
+		w[i].id = i;
+		w[i].n = contexts ? contexts : (variant == V_BATCHED) ? BATCH : 1;
+
+		// Set up once, so the timed calls do not take page faults
+		if(variant == V_SPLIT) {
+			e = w[i].arena = xmalloc((size_t)w[i].n * sizeof(ECRYPT_ctx));
+
+			for(k = 0; k < w[i].n; k++) {
+				ECRYPT_keysetup(&e[k], key, 128, 128);
+				ECRYPT_ivsetup(&e[k], key);
+			}
+		} else {
+			w[i].arena = xmalloc((size_t)w[i].n * sizeof(struct hc128_context));
+
+			for(k = 0; k < w[i].n; k++)
+				hc128_set_key_and_iv(&((struct hc128_context *)w[i].arena)[k], key, 16, key, 16);
+		}
+	}
+
+	for(i = 0; i < nthreads; i++) {
+		if(pthread_create(&w[i].thread, NULL, worker_run, &w[i])) {
+			printf("Thread create error!\n");
+			exit(1);
+		}
+	}
+
+	memset(hist, 0, sizeof(hist));
+
+	for(i = 0; i < nthreads; i++) {
+		pthread_join(w[i].thread, NULL);
+
+		for(j = 0; j < HIST_BUCKETS; j++) {
+			hist[j] += w[i].hist[j];
+			total += w[i].hist[j];
+		}
+
+		if(w[i].max > max)
+			max = w[i].max;
+
+		free(w[i].arena);
+	}
+
+	printf("%-10s %-10s %10lu %10.2f %10.2f %10.2f %10.2f\n", scenario, variant_name[variant], (unsigned long)total,
+	       hist_percentile(hist, total, 0.50) / 1e3, hist_percentile(hist, total, 0.99) / 1e3,
+	       hist_percentile(hist, total, 0.999) / 1e3, max / 1e3);
+
+	free(w);
+}
+
+int
+main(int argc, char *argv[])
+{
+	uint32_t calls = 20000, contexts = 8192;
+	int threads = 4, opt, v;
+
+	while((opt = getopt(argc, argv, "n:c:t:")) != -1) {
+		switch(opt) {
+		case 'n':
+			calls = strtoul(optarg, NULL, 10);
+			break;
+		case 'c':
+			contexts = strtoul(optarg, NULL, 10);
+			break;
+		case 't':
+			threads = atoi(optarg);
+			break;
+		default:
+			printf("Usage: %s [-n calls] [-c cold contexts] [-t threads]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if(!calls || (contexts < BATCH) || (threads < 1) || (threads > POOL_SIZE)) {
+		printf("Calls > 0, contexts >= %d, threads 1..%d!\n", BATCH, POOL_SIZE);
+		return 1;
+	}
+
+	ECRYPT_init();
+
+	for(pool.top = 0; pool.top < POOL_SIZE; pool.top++)
+		pool.free[pool.top] = xmalloc(sizeof(struct hc128_context));
+
+	printf("calls = %u, cold arena = %u contexts (%.1f MB), threads = %d, batch = %d\n\n", calls, contexts,
+	       contexts * (double)sizeof(struct hc128_context) / (1 << 20), threads, BATCH);
+	printf("%-10s %-10s %10s %10s %10s %10s %10s\n", "scenario", "variant", "setups", "p50 us", "p99 us", "p99.9 us",
+	       "max us");
+
+	for(v = 0; v < VARIANTS; v++)
+		run("warm", v, 1, 0, calls);
+
+	for(v = 0; v < VARIANTS; v++)
+		run("cold", v, 1, contexts, calls);
+
+	for(v = 0; v < VARIANTS; v++)
+		run("threads", v, threads, contexts, calls);
+
+	for(pool.top--; pool.top >= 0; pool.top--)
+		free(pool.free[pool.top]);
+
+	return 0;
+}
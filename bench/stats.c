@@ -0,0 +1,259 @@
+/*
+ * Check and cost of the usage statistics (hc128.c compiled with -DHC128_STATS).
+ * Threads run a known mix of setups and crypt calls, the snapshot must
+ * match the counts worked out here: once while the threads are running
+ * (their own shards) and once after they exited (the retired counters).
+ * Then nanoseconds per hc128_crypt() call of a few sizes with the counters
+ * on; make bench with and without HC128_STATS=1 compares all kernels.
+ * Example: ./bench/stats -t 4 -n 1000
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#include "../hc128.h"
+#include "bench.h"
+
+#define BATCH		4
+#define COST_CALLS	200000
+
+static const uint32_t sizes[] = { 40, 576, 1500, 4096, 64, 0, 17 };
+
+#define SIZES	(sizeof(sizes) / sizeof(sizes[0]))
+
+static const uint8_t key[16] = "stats key 16 b!!";
+
+static pthread_barrier_t counted, release;
+
+struct worker {
+	pthread_t thread;
+	uint32_t rounds;
+};
+
+static void *
+xmalloc(size_t size)
+{
+	void *p = malloc(size);
+
+	if(!p) {
+		printf("malloc error!\n");
+		exit(1);
+	}
+
+	return p;
+}
+
+static int
+size_bucket(uint64_t len)
+{
+	int i = len ? 64 - __builtin_clzll(len) : 0;
+
+	return (i < HC128_STATS_SIZES) ? i : HC128_STATS_SIZES - 1;
+}
+
+// One piece of a stream with remain unused keystream bytes
+static void
+expect_piece(struct hc128_stats *e, uint32_t *remain, uint32_t len)
+{
+	uint32_t n = (len < *remain) ? len : *remain;
+
+	if(*remain)
+		e->partial++;
+
+	*remain -= n;
+	len -= n;
+
+	e->blocks += (len + 63) / 64;
+
+	if(len % 64) {
+		e->tails++;
+		*remain = 64 - len % 64;
+	}
+}
+
+/*
+ * Counts of one thread: a setup, a batch, the rounds of the sizes with
+ * hc128_crypt(), a cryptv call of two fragments of the sizes per round
+*/
+static void
+expect_thread(struct hc128_stats *e, uint32_t rounds)
+{
+	uint32_t remain = 0, r, i;
+
+	e->setups += 1 + BATCH;
+
+	for(r = 0; r < rounds; r++) {
+		for(i = 0; i < SIZES; i++) {
+			expect_piece(e, &remain, sizes[i]);
+			e->calls++;
+			e->bytes += sizes[i];
+			e->sizes[size_bucket(sizes[i])]++;
+		}
+
+		expect_piece(e, &remain, sizes[r % SIZES]);
+		expect_piece(e, &remain, sizes[(r + 1) % SIZES]);
+		e->calls++;
+		e->bytes += sizes[r % SIZES] + sizes[(r + 1) % SIZES];
+		e->sizes[size_bucket(sizes[r % SIZES] + sizes[(r + 1) % SIZES])]++;
+	}
+}
+
+static void *
+worker_run(void *arg)
+{
+	struct worker *w = arg;
+	struct hc128_context ctx, batch_ctx[BATCH], *batch[BATCH];
+	uint8_t iv[BATCH][16], buf[8192];
+	struct iovec v[2];
+	uint32_t r, i;
+
+	memset(iv, 0, sizeof(iv));
+	memset(buf, 0, sizeof(buf));
+
+	hc128_set_key_and_iv(&ctx, key, 16, iv[0], 16);
+
+	for(i = 0; i < BATCH; i++) {
+		batch[i] = &batch_ctx[i];
+		iv[i][0] = i;
+	}
+
+	hc128_set_key_and_iv_multi(batch, BATCH, key, 16, (const uint8_t (*)[16])iv, 16);
+
+	for(r = 0; r < w->rounds; r++) {
+		for(i = 0; i < SIZES; i++)
+			hc128_crypt(&ctx, buf, sizes[i], buf);
+
+		v[0].iov_base = buf;
+		v[0].iov_len = sizes[r % SIZES];
+		v[1].iov_base = buf + 4096;
+		v[1].iov_len = sizes[(r + 1) % SIZES];
+		hc128_cryptv(&ctx, v, 2, v, 2);
+	}
+
+	// The snapshot of the running threads is taken between the barriers
+	pthread_barrier_wait(&counted);
+	pthread_barrier_wait(&release);
+
+	return NULL;
+}
+
+static int
+check(const char *when, const struct hc128_stats *base, const struct hc128_stats *e)
+{
+	struct hc128_stats s;
+	uint64_t *got = (uint64_t *)&s, *want = (uint64_t *)e;
+	const uint64_t *b = (const uint64_t *)base;
+	size_t i;
+
+	hc128_stats_snapshot(&s);
+
+	for(i = 0; i < sizeof(s) / sizeof(uint64_t); i++) {
+		if(got[i] - b[i] != want[i]) {
+			printf("%s: counter %zu = %lu, expected %lu!\n", when, i, (unsigned long)(got[i] - b[i]),
+			       (unsigned long)want[i]);
+			return 1;
+		}
+	}
+
+	printf("%s: ok\n", when);
+
+	return 0;
+}
+
+// Nanoseconds per hc128_crypt() call of the size
+static double
+cost(uint32_t len)
+{
+	struct hc128_context ctx;
+	uint8_t *buf = xmalloc(len + 1);
+	uint64_t t;
+	int i;
+
+	memset(buf, 0, len + 1);
+	hc128_set_key_and_iv(&ctx, key, 16, key, 16);
+
+	t = now_ns();
+	for(i = 0; i < COST_CALLS; i++)
+		hc128_crypt(&ctx, buf, len, buf);
+	t = now_ns() - t;
+
+	free(buf);
+
+	return (double)t / COST_CALLS;
+}
+
+int
+main(int argc, char *argv[])
+{
+	static const uint32_t cost_sizes[] = { 16, 64, 576, 1500 };
+	struct hc128_stats base, e;
+	struct worker *w;
+	uint32_t rounds = 1000;
+	int threads = 4, opt, i, bad;
+
+	while((opt = getopt(argc, argv, "t:n:")) != -1) {
+		switch(opt) {
+		case 't':
+			threads = atoi(optarg);
+			break;
+		case 'n':
+			rounds = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			printf("Usage: %s [-t threads] [-n rounds]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if(threads < 1) {
+		printf("Threads > 0!\n");
+		return 1;
+	}
+
+	w = xmalloc(threads * sizeof(*w));
+	memset(&e, 0, sizeof(e));
+
+	pthread_barrier_init(&counted, NULL, threads + 1);
+	pthread_barrier_init(&release, NULL, threads + 1);
+
+	hc128_stats_snapshot(&base);
+
+	for(i = 0; i < threads; i++) {
+		w[i].rounds = rounds;
+		expect_thread(&e, rounds);
+
+		if(pthread_create(&w[i].thread, NULL, worker_run, &w[i])) {
+			printf("Thread create error!\n");
+			return 1;
+		}
+	}
+
+	pthread_barrier_wait(&counted);
+	bad = check("running threads", &base, &e);
+	pthread_barrier_wait(&release);
+
+	for(i = 0; i < threads; i++)
+		pthread_join(w[i].thread, NULL);
+
+	bad |= check("exited threads", &base, &e);
+
+	if(bad) {
+		printf("Statistics check failed!\n");
+		return 1;
+	}
+
+	printf("\n%10s %12s\n", "size", "ns per call");
+
+	for(i = 0; i < (int)(sizeof(cost_sizes) / sizeof(cost_sizes[0])); i++)
+		printf("%10u %12.1f\n", cost_sizes[i], cost(cost_sizes[i]));
+
+	free(w);
+
+	return 0;
+}
@@ -0,0 +1,129 @@
+/*
+ * Benchmark of the header-only C++ engine hc128.hpp.
+ * The keystream of every sink is checked against hc128.c with random
+ * splits, then the throughput is compared with hc128_crypt().
+ * Example: ./bench/stream
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "../hc128.h"
+#include "../hc128.hpp"
+
+static double
+now()
+{
+	using namespace std::chrono;
+
+	return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Every sink with random splits must give the keystream of hc128.c
+static bool
+check(const std::uint8_t *key, const std::uint8_t *iv)
+{
+	const std::size_t len = 20000;
+	std::vector<std::uint8_t> in(len), ref(len), a(len), b(len), c(len);
+	struct hc128_context ctx;
+	std::size_t off, n;
+
+	for(std::size_t i = 0; i < len; i++)
+		in[i] = std::uint8_t(i * 13 + 5);
+
+	hc128_set_key_and_iv(&ctx, key, 16, iv, 16);
+	hc128_crypt(&ctx, in.data(), len, ref.data());
+
+	hc128::stream s1(key, 16, iv, 16), s2(key, 16, iv, 16), s3(key, 16, iv, 16);
+
+	b = in;
+	std::srand(1);
+
+	for(off = 0; off < len; off += n) {
+		n = std::rand() % 3000;
+		if(n > len - off)
+			n = len - off;
+
+		s1.crypt(in.data() + off, a.data() + off, n);
+		s2.crypt(b.data() + off, n);
+		s3.keystream(c.data() + off, n);
+	}
+
+	for(std::size_t i = 0; i < len; i++)
+		c[i] ^= in[i];
+
+	// Move keeps the position of the stream
+	hc128::stream moved(std::move(s1));
+	std::uint8_t tail[64], tail_ref[64];
+	std::memset(tail, 0, sizeof(tail));
+	moved.keystream(tail, sizeof(tail));
+	hc128_keystream(&ctx, tail_ref, sizeof(tail_ref));
+
+	return (a == ref) && (b == ref) && (c == ref) && !std::memcmp(tail, tail_ref, sizeof(tail));
+}
+
+int
+main()
+{
+	static const std::size_t sizes[] = { 64, 1500, 16384, 1 << 20 };
+	std::uint8_t key[16], iv[16];
+
+	std::memset(key, 'k', sizeof(key));
+	std::memset(iv, 'i', sizeof(iv));
+
+	if(!check(key, iv)) {
+		std::printf("C++ engine mismatch with hc128.c!\n");
+		return 1;
+	}
+
+	std::printf("check: ok\n\n");
+	std::printf("%10s %12s %12s %12s %12s\n", "size", "C GB/s", "xor GB/s", "inplace GB/s", "stream GB/s");
+
+	for(std::size_t size : sizes) {
+		std::vector<std::uint8_t> in(size, 'q'), out(size);
+		const std::size_t iters = (128UL << 20) / size;
+		struct hc128_context ctx;
+		double t, t_c, t_xor, t_inplace, t_stream;
+
+		hc128_set_key_and_iv(&ctx, key, 16, iv, 16);
+		hc128::stream s(key, 16, iv, 16);
+
+		// Best of the repetitions, the machine may be shared
+		t_c = t_xor = t_inplace = t_stream = 1e9;
+
+		for(int r = 0; r < 5; r++) {
+			t = now();
+			for(std::size_t k = 0; k < iters; k++)
+				hc128_crypt(&ctx, in.data(), size, out.data());
+			t_c = std::min(t_c, now() - t);
+
+			t = now();
+			for(std::size_t k = 0; k < iters; k++)
+				s.crypt(in.data(), out.data(), size);
+			t_xor = std::min(t_xor, now() - t);
+
+			t = now();
+			for(std::size_t k = 0; k < iters; k++)
+				s.crypt(out.data(), size);
+			t_inplace = std::min(t_inplace, now() - t);
+
+			t = now();
+			for(std::size_t k = 0; k < iters; k++)
+				s.keystream(out.data(), size);
+			t_stream = std::min(t_stream, now() - t);
+		}
+
+		const double bytes = double(iters) * size;
+
+		std::printf("%10zu %12.3f %12.3f %12.3f %12.3f\n", size,
+			    bytes / t_c / 1e9, bytes / t_xor / 1e9,
+			    bytes / t_inplace / 1e9, bytes / t_stream / 1e9);
+	}
+
+	return 0;
+}
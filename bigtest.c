@@ -3,18 +3,32 @@
  * Example: 
  * encrypt - ./bigtest -t 1 -b 1000000 -i file1 -o file2
  * decrypt - ./bigtest -t 2 -b 1000000 -i file2 -o file3
+ * directory - ./bigtest -t 1 -I dir1 -O dir2 -w 8
 */
 
+#define _XOPEN_SOURCE 700
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
 #include <getopt.h>
+#include <errno.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/time.h>
 
 #include "hc128.h"
 
 #define MAX_FILE	4096
 
+// Directory mode: files not larger than SMALL_FILE are grouped into batches
+#define SMALL_FILE	65536
+#define BATCH_FILES	16
+#define BATCH_BYTES	(1 << 20)
+#define DIR_HEADER	16
+
 // Allocates memory
 void *
 xmalloc(size_t size)
@@ -59,7 +73,451 @@ help(void)
 	printf("\t--block(-b) - block size data read from the file. By default = 10000\n");
 	printf("\t--input(-i) - input file\n");
 	printf("\t--output(-o) - output file\n");
-	printf("Example: ./bigtest -t 1 -b 1000 -i 1.txt -o crypt or ./bigtest -t 2 -b 1000 -i crypt -o decrypt\n\n");
+	printf("\t--input-dir(-I) - input directory (directory mode)\n");
+	printf("\t--output-dir(-O) - output directory (directory mode)\n");
+	printf("\t--workers(-w) - number of worker threads in directory mode. By default = 1\n");
+	printf("\t--sweep(-s) - directory mode: repeat the run for 1, 2, 4 ... workers\n");
+	printf("\t--legacy(-l) - file of the old format: every block starts on a new keystream block\n");
+	printf("Example: ./bigtest -t 1 -b 1000 -i 1.txt -o crypt or ./bigtest -t 2 -b 1000 -i crypt -o decrypt\n");
+	printf("Example: ./bigtest -t 1 -w 8 -I plain -O crypt or ./bigtest -t 2 -w 8 -I crypt -O decrypt\n\n");
+}
+
+/*
+ * Directory mode.
+ * Every file gets its own context. The encryption draws a random nonce
+ * for the run, every output file starts with the header of DIR_HEADER
+ * bytes: the nonce and the number of the file in the run. The iv of the
+ * file is the common iv xored with the header, so no two files of the
+ * run and no two runs share a key/iv pair; the decryption reads the
+ * header back from the encrypted file.
+ * Small files are grouped into batches with one batched key setup,
+ * large files are streamed by blocks.
+*/
+
+// File of the input tree
+struct dir_file {
+	char *path;
+	off_t size;
+};
+
+// Job for the worker: one large file or a batch of small files
+struct dir_job {
+	int first;
+	int count;
+};
+
+struct dir_task {
+	const char *input;
+	const char *output;
+	uint32_t block;
+	int action;
+	const uint8_t *key;
+	const uint8_t *iv;
+	uint8_t nonce[8];
+
+	struct dir_file *files;
+	int nfiles;
+	struct dir_job *jobs;
+	int njobs;
+
+	pthread_mutex_t lock;
+	int next;
+	uint64_t bytes;
+	int done;
+};
+
+static struct dir_file *dir_files;
+static int dir_nfiles, dir_maxfiles;
+static size_t dir_root;
+static const char *dir_output;
+
+// Create the directory tree of the path
+static void
+make_dirs(char *path)
+{
+	char *p;
+
+	for(p = path + 1; *p; p++) {
+		if(*p != '/')
+			continue;
+
+		*p = '\0';
+		if((mkdir(path, 0755) < 0) && (errno != EEXIST)) {
+			printf("Error create directory %s!\n", path);
+			exit(1);
+		}
+		*p = '/';
+	}
+}
+
+// nftw callback: collects regular files and creates output directories
+static int
+dir_walk(const char *path, const struct stat *st, int type, struct FTW *ftw)
+{
+	char name[2 * MAX_FILE];
+
+	if(strlen(path + dir_root) + strlen(dir_output) + 2 >= MAX_FILE) {
+		printf("Too long path %s!\n", path);
+		exit(1);
+	}
+
+	if(type == FTW_D) {
+		snprintf(name, sizeof(name), "%s%s/", dir_output, path + dir_root);
+		make_dirs(name);
+		return 0;
+	}
+
+	if(type != FTW_F)
+		return 0;
+
+	if(dir_nfiles == dir_maxfiles) {
+		dir_maxfiles = dir_maxfiles ? dir_maxfiles * 2 : 1024;
+		dir_files = realloc(dir_files, sizeof(*dir_files) * dir_maxfiles);
+
+		if(dir_files == NULL) {
+			printf("Allocates memory error!\n");
+			exit(1);
+		}
+	}
+
+	dir_files[dir_nfiles].path = strdup(path + dir_root);
+	dir_files[dir_nfiles].size = st->st_size;
+	dir_nfiles++;
+
+	return 0;
+}
+
+// Header of the file of the encryption run: nonce, number of the file (little endian)
+static void
+dir_file_header(const struct dir_task *task, int file, uint8_t header[DIR_HEADER])
+{
+	int i;
+
+	memcpy(header, task->nonce, 8);
+
+	for(i = 0; i < 8; i++)
+		header[8 + i] = (uint8_t)((uint64_t)file >> (8 * i));
+}
+
+// Iv of the file: the common iv xored with the header
+static void
+dir_file_iv(const uint8_t *iv, const uint8_t header[DIR_HEADER], uint8_t out[16])
+{
+	int i;
+
+	for(i = 0; i < 16; i++)
+		out[i] = iv[i] ^ header[i];
+}
+
+// Random nonce of the encryption run
+static void
+dir_nonce(uint8_t nonce[8])
+{
+	FILE *fp = fopen("/dev/urandom", "rb");
+
+	if((fp == NULL) || (fread(nonce, 1, 8, fp) != 8)) {
+		printf("Error read /dev/urandom!\n");
+		exit(1);
+	}
+
+	fclose(fp);
+}
+
+// Split the files into jobs
+static void
+dir_make_jobs(struct dir_task *task)
+{
+	int i, first;
+	off_t bytes;
+
+	task->jobs = xmalloc(sizeof(*task->jobs) * (task->nfiles + 1));
+	task->njobs = 0;
+
+	for(i = 0; i < task->nfiles; ) {
+		if(task->files[i].size > SMALL_FILE) {
+			task->jobs[task->njobs].first = i++;
+			task->jobs[task->njobs++].count = 1;
+			continue;
+		}
+
+		first = i;
+		bytes = 0;
+
+		while((i < task->nfiles) && (task->files[i].size <= SMALL_FILE) &&
+		      (i - first < BATCH_FILES) && (bytes + task->files[i].size <= BATCH_BYTES)) {
+			bytes += task->files[i].size;
+			i++;
+		}
+
+		task->jobs[task->njobs].first = first;
+		task->jobs[task->njobs++].count = i - first;
+	}
+}
+
+// Read the whole small file, return the number of bytes read
+static size_t
+read_file(const char *path, uint8_t *buf, size_t size)
+{
+	FILE *fp;
+	size_t n;
+
+	fp = open_file((char *)path, 1);
+	n = fread(buf, 1, size, fp);
+	fclose(fp);
+
+	return n;
+}
+
+// Write the file, the header first if any
+static void
+write_file(const char *path, const uint8_t *header, const uint8_t *buf, size_t size)
+{
+	FILE *fd;
+
+	fd = open_file((char *)path, 2);
+	if(header)
+		fwrite(header, 1, DIR_HEADER, fd);
+	fwrite(buf, 1, size, fd);
+	fclose(fd);
+}
+
+// Encrypt/decrypt the batch of small files with one batched key setup
+static uint64_t
+dir_batch(struct dir_task *task, struct dir_job *job, struct hc128_context *ctx, uint8_t *buf, uint8_t *out)
+{
+	struct hc128_context *pctx[BATCH_FILES];
+	uint8_t iv[BATCH_FILES][16], header[BATCH_FILES][DIR_HEADER];
+	size_t len[BATCH_FILES], offset;
+	char name[MAX_FILE];
+	int i;
+
+	for(i = 0, offset = 0; i < job->count; i++) {
+		struct dir_file *f = &task->files[job->first + i];
+
+		snprintf(name, sizeof(name), "%s%s", task->input, f->path);
+		len[i] = read_file(name, buf + offset, f->size);
+
+		if(task->action == 1)
+			dir_file_header(task, job->first + i, header[i]);
+		else {
+			// The header of the encrypted file, the data moved over it
+			if(len[i] < DIR_HEADER) {
+				printf("No header in %s!\n", name);
+				exit(1);
+			}
+
+			memcpy(header[i], buf + offset, DIR_HEADER);
+			len[i] -= DIR_HEADER;
+			memmove(buf + offset, buf + offset + DIR_HEADER, len[i]);
+		}
+
+		offset += len[i];
+
+		dir_file_iv(task->iv, header[i], iv[i]);
+		pctx[i] = &ctx[i];
+	}
+
+	if(hc128_set_key_and_iv_multi(pctx, job->count, task->key, 16, iv, 16)) {
+		printf("HC128 context filling error!\n");
+		exit(1);
+	}
+
+	for(i = 0, offset = 0; i < job->count; i++) {
+		hc128_crypt(pctx[i], buf + offset, len[i], out + offset);
+
+		snprintf(name, sizeof(name), "%s%s", task->output, task->files[job->first + i].path);
+		write_file(name, (task->action == 1) ? header[i] : NULL, out + offset, len[i]);
+		offset += len[i];
+	}
+
+	return offset;
+}
+
+// Encrypt/decrypt the large file by blocks
+static uint64_t
+dir_stream(struct dir_task *task, struct dir_job *job, struct hc128_context *ctx, uint8_t *buf, uint8_t *out)
+{
+	struct dir_file *f = &task->files[job->first];
+	char name[MAX_FILE];
+	uint8_t iv[16], header[DIR_HEADER];
+	uint64_t total = 0;
+	uint32_t byte;
+	FILE *fp, *fd;
+
+	snprintf(name, sizeof(name), "%s%s", task->input, f->path);
+	fp = open_file(name, 1);
+
+	if(task->action == 1)
+		dir_file_header(task, job->first, header);
+	else if(fread(header, 1, DIR_HEADER, fp) != DIR_HEADER) {
+		printf("No header in %s!\n", name);
+		exit(1);
+	}
+
+	snprintf(name, sizeof(name), "%s%s", task->output, f->path);
+	fd = open_file(name, 2);
+
+	if(task->action == 1)
+		fwrite(header, 1, DIR_HEADER, fd);
+
+	dir_file_iv(task->iv, header, iv);
+
+	if(hc128_set_key_and_iv(ctx, task->key, 16, iv, 16)) {
+		printf("HC128 context filling error!\n");
+		exit(1);
+	}
+
+	while((byte = fread(buf, 1, task->block, fp)) > 0) {
+		hc128_crypt(ctx, buf, byte, out);
+		fwrite(out, 1, byte, fd);
+		total += byte;
+	}
+
+	fclose(fp);
+	fclose(fd);
+
+	return total;
+}
+
+// Worker thread of the directory mode
+static void *
+dir_worker(void *arg)
+{
+	struct dir_task *task = arg;
+	struct hc128_context *ctx;
+	struct dir_job *job;
+	uint8_t *buf, *out;
+	uint64_t bytes = 0;
+	size_t size;
+	int files = 0;
+
+	size = task->block > BATCH_BYTES ? task->block : BATCH_BYTES;
+
+	ctx = xmalloc(sizeof(*ctx) * BATCH_FILES);
+	buf = xmalloc(size);
+	out = xmalloc(size);
+
+	for(;;) {
+		pthread_mutex_lock(&task->lock);
+		job = (task->next < task->njobs) ? &task->jobs[task->next++] : NULL;
+		pthread_mutex_unlock(&task->lock);
+
+		if(job == NULL)
+			break;
+
+		if(task->files[job->first].size > SMALL_FILE)
+			bytes += dir_stream(task, job, ctx, buf, out);
+		else
+			bytes += dir_batch(task, job, ctx, buf, out);
+
+		files += job->count;
+	}
+
+	pthread_mutex_lock(&task->lock);
+	task->bytes += bytes;
+	task->done += files;
+	pthread_mutex_unlock(&task->lock);
+
+	memset(ctx, 0, sizeof(*ctx) * BATCH_FILES);
+	free(ctx);
+	free(buf);
+	free(out);
+
+	return NULL;
+}
+
+// Run the directory mode with the given number of workers
+static void
+dir_run(struct dir_task *task, int workers)
+{
+	pthread_t *tid;
+	struct timeval t1, t2;
+	double sec;
+	int i;
+
+	task->next = 0;
+	task->bytes = 0;
+	task->done = 0;
+
+	if(task->action == 1)
+		dir_nonce(task->nonce);
+
+	tid = xmalloc(sizeof(*tid) * workers);
+
+	gettimeofday(&t1, NULL);
+
+	for(i = 0; i < workers; i++) {
+		if(pthread_create(&tid[i], NULL, dir_worker, task)) {
+			printf("Error create thread!\n");
+			exit(1);
+		}
+	}
+
+	for(i = 0; i < workers; i++)
+		pthread_join(tid[i], NULL);
+
+	gettimeofday(&t2, NULL);
+
+	sec = (t2.tv_sec - t1.tv_sec) + (t2.tv_usec - t1.tv_usec) / 1e6;
+	if(sec <= 0)
+		sec = 1e-6;
+
+	printf("workers = %3d files = %d bytes = %llu time = %.3f s files/sec = %.0f GB/s = %.3f\n",
+	       workers, task->done, (unsigned long long)task->bytes, sec,
+	       task->done / sec, task->bytes / sec / 1e9);
+
+	free(tid);
+}
+
+// Encrypt/decrypt the directory tree
+static void
+dir_crypt(char *input, char *output, uint32_t block, int action, int workers, int sweep, const uint8_t *key,
+	  const uint8_t *iv)
+{
+	struct dir_task task;
+	int i, n;
+
+	for(n = strlen(input); (n > 1) && (input[n - 1] == '/'); n--)
+		input[n - 1] = '\0';
+
+	for(n = strlen(output); (n > 1) && (output[n - 1] == '/'); n--)
+		output[n - 1] = '\0';
+
+	dir_root = strlen(input);
+	dir_output = output;
+
+	if(nftw(input, dir_walk, 64, FTW_PHYS) < 0) {
+		printf("Error walk directory %s!\n", input);
+		exit(1);
+	}
+
+	memset(&task, 0, sizeof(task));
+	task.input = input;
+	task.output = output;
+	task.block = block;
+	task.action = action;
+	task.key = key;
+	task.iv = iv;
+	task.files = dir_files;
+	task.nfiles = dir_nfiles;
+	pthread_mutex_init(&task.lock, NULL);
+
+	dir_make_jobs(&task);
+
+	if(sweep) {
+		for(n = 1; n < workers; n *= 2)
+			dir_run(&task, n);
+	}
+
+	dir_run(&task, workers);
+
+	pthread_mutex_destroy(&task.lock);
+
+	for(i = 0; i < dir_nfiles; i++)
+		free(dir_files[i].path);
+
+	free(dir_files);
+	free(task.jobs);
 }
 
 int
@@ -70,15 +528,21 @@ main(int argc, char *argv[])
 	uint32_t byte, block = 10000;
 	uint8_t *buf, *out, key[16], iv[16];
 	char file1[MAX_FILE], file2[MAX_FILE];
-	int res, action = 1;
+	char dir1[MAX_FILE] = "", dir2[MAX_FILE] = "";
+	int res, action = 1, workers = 1, sweep = 0, legacy = 0;
 
 	const struct option long_option [] = {
-		{"input",  1, NULL, 'i'},
-		{"output", 1, NULL, 'o'},
-		{"block",  1, NULL, 'b'},
-		{"type",   1, NULL, 't'},
-		{"help",   0, NULL, 'h'},
-		{0, 	   0, NULL,  0 }
+		{"input",      1, NULL, 'i'},
+		{"output",     1, NULL, 'o'},
+		{"input-dir",  1, NULL, 'I'},
+		{"output-dir", 1, NULL, 'O'},
+		{"workers",    1, NULL, 'w'},
+		{"sweep",      0, NULL, 's'},
+		{"legacy",     0, NULL, 'l'},
+		{"block",      1, NULL, 'b'},
+		{"type",       1, NULL, 't'},
+		{"help",       0, NULL, 'h'},
+		{0, 	       0, NULL,  0 }
 	};
 	
 	if(argc < 2) {
@@ -86,7 +550,7 @@ main(int argc, char *argv[])
 		return 0;
 	}
 
-	while((res = getopt_long(argc, argv, "i:o:b:t:h", long_option, 0)) != -1) {
+	while((res = getopt_long(argc, argv, "i:o:I:O:w:slb:t:h", long_option, 0)) != -1) {
 		switch(res) {
 		case 'b' : block = atoi(optarg);
 			   break;
@@ -94,6 +558,16 @@ main(int argc, char *argv[])
 			   break;
 		case 'o' : strcpy(file2, optarg);
 			   break;
+		case 'I' : strcpy(dir1, optarg);
+			   break;
+		case 'O' : strcpy(dir2, optarg);
+			   break;
+		case 'w' : workers = atoi(optarg);
+			   break;
+		case 's' : sweep = 1;
+			   break;
+		case 'l' : legacy = 1;
+			   break;
 		case 't' : action = atoi(optarg);
 			   break;
 		case 'h' : help();
@@ -101,14 +575,24 @@ main(int argc, char *argv[])
 		}
 	}
 	
+	memset(key, 'k', sizeof(key));
+	memset(iv, 'i', sizeof(iv));
+
+	if(dir1[0] || dir2[0]) {
+		if(!dir1[0] || !dir2[0] || (workers < 1) || (block < 1)) {
+			help();
+			return 1;
+		}
+
+		dir_crypt(dir1, dir2, block, action, workers, sweep, key, iv);
+		return 0;
+	}
+
 	buf = xmalloc(sizeof(uint8_t) * block);
 	out = xmalloc(sizeof(uint8_t) * block);
 	
 	fp = open_file(file1, 1);
 	fd = open_file(file2, 2);
-	
-	memset(key, 'k', sizeof(key));
-	memset(iv, 'i', sizeof(iv));
 
 	if(hc128_set_key_and_iv(&ctx, (uint8_t *)key, 16, iv, 16)) {
 		printf("HC128 context filling error!\n");
@@ -116,7 +600,9 @@ main(int argc, char *argv[])
 	}
 	
 	while((byte = fread(buf, 1, block, fp)) > 0) {
-		if(action == 1)
+		if(legacy)
+			hc128_crypt_blockwise(&ctx, buf, byte, out);
+		else if(action == 1)
 			hc128_crypt(&ctx, buf, byte, out);
 		else
 			hc128_crypt(&ctx, buf, byte, out);
@@ -0,0 +1,964 @@
+/*
+ * Conformance of all kernels of the library.
+ * Vectors: every vector of the ECRYPT file (hc128_sources/verified.test-vectors)
+ * is generated by every kernel, in one call and in calls of mixed sizes,
+ * the stream ranges (stream[0..63], stream[192..255], ... stream[131008..131071])
+ * and the xor-digest of the whole stream must match.
+ * Differential: -r rounds of a random key, iv, plaintext, split into calls
+ * (0, 1..63, whole blocks, blocks +-1 bytes, the rest) and misalignment of
+ * the input and output (in place too); every kernel must give the ciphertext
+ * of one ECRYPT_encrypt_bytes() call of the linked ECRYPT code: the
+ * reference hc-128.c in conformance, the engine adapter in conformance_engine.
+ * Kernels: hc128_crypt, _crypt_bulk, _cryptv, _keystream, _keystream_blocks,
+ * serialize/deserialize after every call, _set_key_and_iv_multi,
+ * _keystream_multi, _crypt_fanout and the ECRYPT API; the other contexts
+ * of the multi-context kernels are checked against ECRYPT too. conformance_cxx
+ * (-DHC128_CONFORMANCE_STREAM) adds the C++ engine hc128::stream of
+ * hc128.hpp with every sink: crypt, crypt in place and keystream
+ * (through the shim conformance_stream.cpp).
+ * With -DHC128_FUZZER the differential of one input is the libFuzzer entry
+ * point (make conformance_fuzzer, clang).
+ * Example: ./conformance -f hc128_sources/verified.test-vectors -r 2000 -s 1
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "hc128.h"
+#include "hc128_sources/ecrypt-sync.h"
+
+#define MAX_VECTORS	256
+#define MAX_RANGES	8
+#define MAX_STREAM	131072
+#define MAX_CHUNKS	64
+#define MAX_LEN		8192
+#define OTHERS		4
+
+/*
+ * Vector of the ECRYPT file
+ * range - stream[first..last] of the vector
+ * len - length of the stream: the last range up to a whole block
+*/
+struct vector {
+	char name[32];
+	uint8_t key[16];
+	uint8_t iv[16];
+	struct {
+		uint32_t first;
+		uint32_t last;
+		uint8_t bytes[64];
+	} range[MAX_RANGES];
+	int ranges;
+	uint8_t digest[64];
+	uint32_t len;
+};
+
+// Calls of a stream: len bytes in n calls of chunk[i] bytes
+struct plan {
+	uint32_t len;
+	int n;
+	uint32_t chunk[MAX_CHUNKS];
+};
+
+/*
+ * Kernel under test: stream of key and iv over the calls of the plan
+ * keystream - the kernel writes the keystream, not the ciphertext
+ * Return value: 0 (if all is well), -1 if all bad
+*/
+struct kernel {
+	const char *name;
+	int (*run)(const uint8_t *key, const uint8_t *iv, const uint8_t *in, uint8_t *out, const struct plan *plan);
+	int keystream;
+};
+
+// Streams of the contexts of a multi-context kernel, lane 0 of run_keystream_multi() the longest
+static uint8_t lane_out[OTHERS + 1][MAX_STREAM + MAX_CHUNKS * 64];
+static uint8_t lane_in[MAX_STREAM], lane_ref[MAX_STREAM + MAX_CHUNKS * 64];
+
+static void *
+xmalloc(size_t size)
+{
+	void *p = malloc(size);
+
+	if(!p) {
+		printf("malloc error!\n");
+		exit(1);
+	}
+
+	return p;
+}
+
+// Iv of the i-th other context of a multi-context kernel
+static void
+other_iv(uint8_t *iv, const uint8_t *base, int i)
+{
+	memcpy(iv, base, 16);
+	iv[15] ^= i + 1;
+}
+
+/*
+ * The i-th other context against one ECRYPT call
+ * lane - len bytes of its stream after the first skip bytes of keystream,
+ * the keystream itself, or in ^ keystream if in is given
+ * Return value: 0 (if all is well), -1 if all bad
+*/
+static int
+other_check(const uint8_t *key, const uint8_t *iv, int i, const uint8_t *lane, const uint8_t *in, uint32_t skip,
+	    uint32_t len)
+{
+	ECRYPT_ctx *ctx = xmalloc(sizeof(*ctx));
+	uint8_t other[16];
+	uint32_t k;
+	int r = 0;
+
+	other_iv(other, iv, i);
+	ECRYPT_keysetup(ctx, key, 128, 128);
+	ECRYPT_ivsetup(ctx, other);
+
+	memset(lane_ref, 0, skip + len);
+	ECRYPT_encrypt_bytes(ctx, lane_ref, lane_ref, skip + len);
+
+	for(k = 0; k < len; k++)
+		if(lane[k] != ((in ? in[k] : 0) ^ lane_ref[skip + k]))
+			r = -1;
+
+	free(ctx);
+
+	return r;
+}
+
+static int
+run_crypt(const uint8_t *key, const uint8_t *iv, const uint8_t *in, uint8_t *out, const struct plan *plan)
+{
+	struct hc128_context ctx;
+	uint32_t off = 0;
+	int i;
+
+	if(hc128_set_key_and_iv(&ctx, key, 16, iv, 16))
+		return -1;
+
+	for(i = 0; i < plan->n; off += plan->chunk[i++])
+		hc128_crypt(&ctx, in + off, plan->chunk[i], out + off);
+
+	return 0;
+}
+
+static int
+run_crypt_bulk(const uint8_t *key, const uint8_t *iv, const uint8_t *in, uint8_t *out, const struct plan *plan)
+{
+	struct hc128_context ctx;
+	uint32_t off = 0;
+	int i;
+
+	if(hc128_set_key_and_iv(&ctx, key, 16, iv, 16))
+		return -1;
+
+	for(i = 0; i < plan->n; off += plan->chunk[i++])
+		hc128_crypt_bulk(&ctx, in + off, plan->chunk[i], out + off);
+
+	return 0;
+}
+
+// Every call in fragments: the input cut at a third, the output at a half, an empty one between
+static int
+run_cryptv(const uint8_t *key, const uint8_t *iv, const uint8_t *in, uint8_t *out, const struct plan *plan)
+{
+	struct hc128_context ctx;
+	struct iovec vi[2], vo[3];
+	uint32_t off = 0, n;
+	int i;
+
+	if(hc128_set_key_and_iv(&ctx, key, 16, iv, 16))
+		return -1;
+
+	for(i = 0; i < plan->n; off += plan->chunk[i++]) {
+		n = plan->chunk[i];
+
+		vi[0].iov_base = (void *)(in + off);
+		vi[0].iov_len = n / 3;
+		vi[1].iov_base = (void *)(in + off + n / 3);
+		vi[1].iov_len = n - n / 3;
+
+		vo[0].iov_base = out + off;
+		vo[0].iov_len = n / 2;
+		vo[1].iov_base = out + off + n / 2;
+		vo[1].iov_len = 0;
+		vo[2].iov_base = out + off + n / 2;
+		vo[2].iov_len = n - n / 2;
+
+		if(hc128_cryptv(&ctx, vi, 2, vo, 3))
+			return -1;
+	}
+
+	return 0;
+}
+
+static int
+run_keystream(const uint8_t *key, const uint8_t *iv, const uint8_t *in, uint8_t *out, const struct plan *plan)
+{
+	struct hc128_context ctx;
+	uint32_t off = 0;
+	int i;
+
+	if(hc128_set_key_and_iv(&ctx, key, 16, iv, 16))
+		return -1;
+
+	for(i = 0; i < plan->n; off += plan->chunk[i++])
+		hc128_keystream(&ctx, out + off, plan->chunk[i]);
+
+	return 0;
+}
+
+// The whole blocks of every call by hc128_keystream_blocks(), the rest by hc128_keystream()
+static int
+run_keystream_blocks(const uint8_t *key, const uint8_t *iv, const uint8_t *in, uint8_t *out, const struct plan *plan)
+{
+	struct hc128_context ctx;
+	uint32_t off = 0, n;
+	int i;
+
+	if(hc128_set_key_and_iv(&ctx, key, 16, iv, 16))
+		return -1;
+
+	for(i = 0; i < plan->n; off += plan->chunk[i++]) {
+		n = plan->chunk[i] & ~63U;
+
+		hc128_keystream_blocks(&ctx, out + off, n / 64);
+		hc128_keystream(&ctx, out + off + n, plan->chunk[i] - n);
+	}
+
+	return 0;
+}
+
+// After every call the context goes through hc128_serialize() into a fresh one
+static int
+run_serialize(const uint8_t *key, const uint8_t *iv, const uint8_t *in, uint8_t *out, const struct plan *plan)
+{
+	struct hc128_context *a = xmalloc(sizeof(*a)), *b = xmalloc(sizeof(*b)), *t;
+	uint8_t s[HC128_SERIALIZED_MAX];
+	uint32_t off = 0, n;
+	int i, r = 0;
+
+	if(hc128_set_key_and_iv(a, key, 16, iv, 16))
+		r = -1;
+
+	for(i = 0; !r && (i < plan->n); off += plan->chunk[i++]) {
+		hc128_crypt(a, in + off, plan->chunk[i], out + off);
+
+		n = hc128_serialize(a, s);
+		memset(b, 0xAA, sizeof(*b));
+
+		if((n < HC128_SERIALIZED_MIN) || (n > HC128_SERIALIZED_MAX) || hc128_deserialize(b, s, n))
+			r = -1;
+
+		t = a;
+		a = b;
+		b = t;
+	}
+
+	free(a);
+	free(b);
+
+	return r;
+}
+
+// The context set up in a batch with others, second of the batch; the keystreams of the others are checked
+static int
+run_setup_multi(const uint8_t *key, const uint8_t *iv, const uint8_t *in, uint8_t *out, const struct plan *plan)
+{
+	struct hc128_context *ctx[OTHERS + 1];
+	uint8_t ivs[OTHERS + 1][16];
+	uint32_t off = 0;
+	int i, j, r = 0;
+
+	for(i = 0; i <= OTHERS; i++) {
+		ctx[i] = xmalloc(sizeof(struct hc128_context));
+		other_iv(ivs[i], iv, i);
+	}
+
+	memcpy(ivs[1], iv, 16);
+
+	if(hc128_set_key_and_iv_multi(ctx, OTHERS + 1, key, 16, (const uint8_t (*)[16])ivs, 16))
+		r = -1;
+
+	for(i = 0; !r && (i < plan->n); off += plan->chunk[i++]) {
+		hc128_crypt(ctx[1], in + off, plan->chunk[i], out + off);
+
+		for(j = 0; j <= OTHERS; j++)
+			if(j != 1)
+				hc128_keystream(ctx[j], lane_out[j] + off, plan->chunk[i]);
+	}
+
+	for(j = 0; !r && (j <= OTHERS); j++)
+		if((j != 1) && other_check(key, iv, j, lane_out[j], NULL, 0, plan->len))
+			r = -1;
+
+	for(i = 0; i <= OTHERS; i++)
+		free(ctx[i]);
+
+	return r;
+}
+
+/*
+ * The whole blocks of every call in lockstep with the other contexts, the
+ * rest by hc128_keystream(); the first other goes out of block alignment on
+ * the way. The keystreams of the others are checked.
+*/
+static int
+run_keystream_multi(const uint8_t *key, const uint8_t *iv, const uint8_t *in, uint8_t *out, const struct plan *plan)
+{
+	struct hc128_context *ctx[OTHERS + 1];
+	uint8_t other[16], *o[OTHERS + 1];
+	uint32_t off = 0, n, pos[OTHERS + 1] = { 0 };
+	int i, j, r = 0;
+
+	for(j = 0; j <= OTHERS; j++) {
+		ctx[j] = xmalloc(sizeof(struct hc128_context));
+		other_iv(other, iv, j);
+		if(hc128_set_key_and_iv(ctx[j], key, 16, (j == OTHERS / 2) ? iv : other, 16))
+			r = -1;
+	}
+
+	for(i = 0; !r && (i < plan->n); off += plan->chunk[i++]) {
+		n = plan->chunk[i] & ~63U;
+
+		for(j = 0; j <= OTHERS; j++)
+			o[j] = (j == OTHERS / 2) ? out + off : lane_out[j] + pos[j];
+
+		hc128_keystream_multi(ctx, OTHERS + 1, o, n / 64);
+		hc128_keystream(ctx[OTHERS / 2], out + off + n, plan->chunk[i] - n);
+
+		for(j = 0; j <= OTHERS; j++)
+			pos[j] += n;
+
+		hc128_keystream(ctx[0], lane_out[0] + pos[0], i % 64);
+		pos[0] += i % 64;
+	}
+
+	for(j = 0; !r && (j <= OTHERS); j++)
+		if((j != OTHERS / 2) && other_check(key, iv, j, lane_out[j], NULL, 0, pos[j]))
+			r = -1;
+
+	for(j = 0; j <= OTHERS; j++)
+		free(ctx[j]);
+
+	return r;
+}
+
+/*
+ * One plaintext for the context among others, some of them not block
+ * aligned. The ciphertexts of the others are checked against the plaintext
+ * saved before the call, in may be out.
+*/
+static int
+run_fanout(const uint8_t *key, const uint8_t *iv, const uint8_t *in, uint8_t *out, const struct plan *plan)
+{
+	struct hc128_context *ctx[OTHERS + 1];
+	uint8_t other[16], skip[64], *o[OTHERS + 1];
+	uint32_t off = 0;
+	int i, j, r = 0;
+
+	for(j = 0; j <= OTHERS; j++) {
+		ctx[j] = xmalloc(sizeof(struct hc128_context));
+		other_iv(other, iv, j);
+
+		if(j == OTHERS / 2) {
+			if(hc128_set_key_and_iv(ctx[j], key, 16, iv, 16))
+				r = -1;
+			continue;
+		}
+
+		if(hc128_set_key_and_iv(ctx[j], key, 16, other, 16))
+			r = -1;
+
+		hc128_keystream(ctx[j], skip, j * 13 % 64);
+	}
+
+	for(i = 0; !r && (i < plan->n); off += plan->chunk[i++]) {
+		for(j = 0; j <= OTHERS; j++)
+			o[j] = (j == OTHERS / 2) ? out + off : lane_out[j] + off;
+
+		memcpy(lane_in + off, in + off, plan->chunk[i]);
+		hc128_crypt_fanout(ctx, OTHERS + 1, in + off, plan->chunk[i], o);
+	}
+
+	for(j = 0; !r && (j <= OTHERS); j++)
+		if((j != OTHERS / 2) && other_check(key, iv, j, lane_out[j], lane_in, j * 13 % 64, plan->len))
+			r = -1;
+
+	for(j = 0; j <= OTHERS; j++)
+		free(ctx[j]);
+
+	return r;
+}
+
+/*
+ * ECRYPT API: the engine keeps the keystream between the calls, the
+ * reference only over whole blocks, so it gets one call
+*/
+static int
+run_ecrypt(const uint8_t *key, const uint8_t *iv, const uint8_t *in, uint8_t *out, const struct plan *plan)
+{
+	ECRYPT_ctx *ctx = xmalloc(sizeof(*ctx));
+#ifdef ECRYPT_HC128_ENGINE
+	uint32_t off = 0;
+	int i;
+#endif
+
+	ECRYPT_keysetup(ctx, key, 128, 128);
+	ECRYPT_ivsetup(ctx, iv);
+
+#ifdef ECRYPT_HC128_ENGINE
+	for(i = 0; i < plan->n; off += plan->chunk[i++])
+		ECRYPT_encrypt_bytes(ctx, in + off, out + off, plan->chunk[i]);
+#else
+	ECRYPT_encrypt_bytes(ctx, in, out, plan->len);
+#endif
+
+	free(ctx);
+
+	return 0;
+}
+
+#ifdef HC128_CONFORMANCE_STREAM
+// hc128::stream of conformance_stream.cpp: sink 0 - crypt, 1 - crypt in place, 2 - keystream
+int conformance_stream(int sink, const uint8_t *key, const uint8_t *iv, const uint8_t *in, uint8_t *out,
+		       const uint32_t *chunk, int n);
+
+static int
+run_stream(const uint8_t *key, const uint8_t *iv, const uint8_t *in, uint8_t *out, const struct plan *plan)
+{
+	return conformance_stream(0, key, iv, in, out, plan->chunk, plan->n);
+}
+
+static int
+run_stream_inplace(const uint8_t *key, const uint8_t *iv, const uint8_t *in, uint8_t *out, const struct plan *plan)
+{
+	return conformance_stream(1, key, iv, in, out, plan->chunk, plan->n);
+}
+
+static int
+run_stream_keystream(const uint8_t *key, const uint8_t *iv, const uint8_t *in, uint8_t *out, const struct plan *plan)
+{
+	return conformance_stream(2, key, iv, in, out, plan->chunk, plan->n);
+}
+#endif
+
+static const struct kernel kernels[] = {
+	{ "hc128_crypt", run_crypt, 0 },
+	{ "hc128_crypt_bulk", run_crypt_bulk, 0 },
+	{ "hc128_cryptv", run_cryptv, 0 },
+	{ "hc128_keystream", run_keystream, 1 },
+	{ "hc128_keystream_blocks", run_keystream_blocks, 1 },
+	{ "hc128_serialize", run_serialize, 0 },
+	{ "hc128_set_key_and_iv_multi", run_setup_multi, 0 },
+	{ "hc128_keystream_multi", run_keystream_multi, 1 },
+	{ "hc128_crypt_fanout", run_fanout, 0 },
+#ifdef HC128_CONFORMANCE_STREAM
+	{ "hc128::stream crypt", run_stream, 0 },
+	{ "hc128::stream crypt in place", run_stream_inplace, 0 },
+	{ "hc128::stream keystream", run_stream_keystream, 1 },
+#endif
+	{ "ECRYPT", run_ecrypt, 0 }
+};
+
+#define KERNELS	(int)(sizeof(kernels) / sizeof(kernels[0]))
+
+/*
+ * Output of the kernel as ciphertext of the plaintext pt
+ * Return value: 0 (if all is well), -1 if all bad
+*/
+static int
+kernel_run(const struct kernel *k, const uint8_t *key, const uint8_t *iv, const uint8_t *pt, const uint8_t *in,
+	   uint8_t *out, const struct plan *plan)
+{
+	uint32_t i;
+
+	if(k->run(key, iv, in, out, plan))
+		return -1;
+
+	if(k->keystream)
+		for(i = 0; i < plan->len; i++)
+			out[i] ^= pt[i];
+
+	return 0;
+}
+
+/*
+ * Differential of one stream: every kernel against one ECRYPT call
+ * in_off, out_off - misalignment of the input and output, inplace - out is in
+ * Return value: the failed kernel, -1 if all is well
+*/
+static int
+differential(const uint8_t *key, const uint8_t *iv, const uint8_t *pt, const struct plan *plan, int in_off,
+	     int out_off, int inplace, uint32_t *at)
+{
+	static uint8_t ref[MAX_LEN], inbuf[MAX_LEN + 64], outbuf[MAX_LEN + 64];
+	ECRYPT_ctx ectx;
+	uint8_t *in = inbuf + in_off, *out = inplace ? in : outbuf + out_off;
+	int k;
+
+	ECRYPT_keysetup(&ectx, key, 128, 128);
+	ECRYPT_ivsetup(&ectx, iv);
+	ECRYPT_encrypt_bytes(&ectx, pt, ref, plan->len);
+
+	for(k = 0; k < KERNELS; k++) {
+		memcpy(in, pt, plan->len);
+
+		if(kernel_run(&kernels[k], key, iv, pt, in, out, plan)) {
+			*at = 0;
+			return k;
+		}
+
+		for(*at = 0; *at < plan->len; (*at)++)
+			if(out[*at] != ref[*at])
+				return k;
+	}
+
+	return -1;
+}
+
+#ifdef HC128_FUZZER
+/*
+ * libFuzzer entry: key (16 bytes), iv (16), misalignment (1), then one byte
+ * per call: below 128 the size of the call, above it (b - 128) whole blocks
+*/
+int
+LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	static uint8_t pt[MAX_LEN];
+	struct plan plan;
+	uint32_t n, at;
+	size_t i;
+
+	if(size < 33)
+		return 0;
+
+	memset(&plan, 0, sizeof(plan));
+
+	for(i = 33; (i < size) && (plan.n < MAX_CHUNKS); i++) {
+		n = (data[i] < 128) ? data[i] : (data[i] - 128) * 64;
+
+		if(plan.len + n > MAX_LEN)
+			break;
+
+		plan.chunk[plan.n++] = n;
+		plan.len += n;
+	}
+
+	for(n = 0; n < plan.len; n++)
+		pt[n] = n * 131 + data[n % size];
+
+	if(differential(data, data + 16, pt, &plan, data[32] & 15, data[32] >> 4, (data[32] & 0x11) == 0x11, &at) >= 0)
+		abort();
+
+	return 0;
+}
+#else
+static uint64_t rng_state;
+
+// splitmix64
+static uint64_t
+rng(void)
+{
+	uint64_t z = (rng_state += 0x9E3779B97F4A7C15ULL);
+
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+
+	return z ^ (z >> 31);
+}
+
+// Size of the next call: the sizes where the kernels change paths
+static uint32_t
+random_chunk(uint32_t left)
+{
+	uint32_t n;
+
+	switch(rng() % 6) {
+	case 0:
+		n = 0;
+		break;
+	case 1:
+		n = 1 + rng() % 63;
+		break;
+	case 2:
+		n = 64 * (1 + rng() % 8);
+		break;
+	case 3:
+		n = 64 * (1 + rng() % 8) + ((rng() & 1) ? 1 : -1);
+		break;
+	case 4:
+		n = rng() % (2048 + 1);
+		break;
+	default:
+		n = left;
+	}
+
+	return (n < left) ? n : left;
+}
+
+static void
+random_plan(struct plan *plan, uint32_t len)
+{
+	uint32_t left;
+
+	plan->len = len;
+	plan->n = 0;
+
+	for(left = len; left && (plan->n < MAX_CHUNKS - 1); left -= plan->chunk[plan->n++])
+		plan->chunk[plan->n] = random_chunk(left);
+
+	if(left)
+		plan->chunk[plan->n++] = left;
+}
+
+static void
+print_plan(const struct plan *plan)
+{
+	int i;
+
+	printf("calls:");
+	for(i = 0; i < plan->n; i++)
+		printf(" %u", plan->chunk[i]);
+	printf("\n");
+}
+
+/*
+ * Random differential rounds
+ * Return value: 0 (if all is well), -1 if all bad
+*/
+static int
+check_random(uint32_t rounds, uint64_t seed, uint32_t max)
+{
+	static uint8_t pt[MAX_LEN];
+	struct plan plan;
+	uint8_t key[16], iv[16];
+	uint32_t r, i, at;
+	int in_off, out_off, inplace, k;
+
+	rng_state = seed;
+
+	for(r = 0; r < rounds; r++) {
+		for(i = 0; i < 16; i++) {
+			key[i] = rng();
+			iv[i] = rng();
+		}
+
+		for(i = 0; i < max; i++)
+			pt[i] = rng();
+
+		random_plan(&plan, rng() % (max + 1));
+
+		in_off = rng() % 16;
+		out_off = rng() % 16;
+		inplace = !(rng() % 4);
+
+		if((k = differential(key, iv, pt, &plan, in_off, out_off, inplace, &at)) >= 0) {
+			printf("%s: differs from ECRYPT at byte %u, seed %lu round %u, length %u, input +%d, output %s%d\n",
+			       kernels[k].name, at, (unsigned long)seed, r, plan.len, in_off, inplace ? "in place +" : "+",
+			       inplace ? in_off : out_off);
+			print_plan(&plan);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int
+hex_value(int c)
+{
+	if((c >= '0') && (c <= '9'))
+		return c - '0';
+	if((c >= 'A') && (c <= 'F'))
+		return c - 'A' + 10;
+	if((c >= 'a') && (c <= 'f'))
+		return c - 'a' + 10;
+
+	return -1;
+}
+
+// Hex digits of s appended to out (at most max bytes), -1 on anything else
+static int
+hex_append(const char *s, uint8_t *out, int *len, int max)
+{
+	int hi, lo;
+
+	for(; *s; s++) {
+		if((*s == ' ') || (*s == '\n') || (*s == '\r'))
+			continue;
+
+		if(((hi = hex_value(s[0])) < 0) || ((lo = hex_value(s[1])) < 0) || (*len >= max))
+			return -1;
+
+		out[(*len)++] = hi << 4 | lo;
+		s++;
+	}
+
+	return 0;
+}
+
+// The field of the vector the hex goes to, NULL for the fields not checked
+static uint8_t *
+field(struct vector *v, const char *name, int *max)
+{
+	unsigned long first, last;
+
+	*max = 64;
+
+	if(!strcmp(name, "key")) {
+		*max = 16;
+		return v->key;
+	}
+
+	if(!strcmp(name, "IV")) {
+		*max = 16;
+		return v->iv;
+	}
+
+	if(!strcmp(name, "xor-digest"))
+		return v->digest;
+
+	if((sscanf(name, "stream[%lu..%lu]", &first, &last) == 2) && (last - first == 63) && (v->ranges < MAX_RANGES) &&
+	   (last < MAX_STREAM)) {
+		v->range[v->ranges].first = first;
+		v->range[v->ranges].last = last;
+		return v->range[v->ranges++].bytes;
+	}
+
+	return NULL;
+}
+
+/*
+ * Vectors of the ECRYPT file: "Set n, vector# m:" starts a vector, then
+ * "name = hex" fields, the hex going on in the lines below
+ * Return value: number of the vectors, -1 if all bad
+*/
+static int
+read_vectors(const char *path, struct vector *vec)
+{
+	FILE *f = fopen(path, "r");
+	char line[256], name[64], *eq, *p;
+	struct vector *v = NULL;
+	uint8_t *dst = NULL;
+	int n = 0, len = 0, max = 0, lineno = 0, i;
+
+	if(!f)
+		return -1;
+
+	while(fgets(line, sizeof(line), f)) {
+		lineno++;
+
+		for(p = line; *p == ' '; p++)
+			;
+
+		// A field ends at the blank line
+		if((*p == '\n') || (*p == '\r')) {
+			dst = NULL;
+			continue;
+		}
+
+		if(!strncmp(p, "Set ", 4)) {
+			if(n == MAX_VECTORS)
+				break;
+
+			v = &vec[n++];
+			memset(v, 0, sizeof(*v));
+			snprintf(v->name, sizeof(v->name), "%.*s", (int)strcspn(p, ":\n"), p);
+			dst = NULL;
+			continue;
+		}
+
+		if(!v)
+			continue;
+
+		if((eq = strchr(p, '='))) {
+			for(i = eq - p; (i > 0) && (p[i - 1] == ' '); i--)
+				;
+			snprintf(name, sizeof(name), "%.*s", i, p);
+
+			dst = field(v, name, &max);
+			len = 0;
+			p = eq + 1;
+		}
+
+		if(!dst || !*p || (*p == '\n'))
+			continue;
+
+		if(hex_append(p, dst, &len, max)) {
+			printf("%s:%d: bad hex!\n", path, lineno);
+			fclose(f);
+			return -1;
+		}
+	}
+
+	fclose(f);
+
+	for(i = 0; i < n; i++) {
+		v = &vec[i];
+
+		for(max = 0; max < v->ranges; max++)
+			if(v->range[max].last + 1 > v->len)
+				v->len = v->range[max].last + 1;
+
+		v->len = (v->len + 63) & ~63U;
+
+		if(!v->ranges) {
+			printf("%s: no stream ranges!\n", v->name);
+			return -1;
+		}
+	}
+
+	return n;
+}
+
+// The calls of the vector plans: one call, then calls of these sizes in turn
+static const uint32_t vector_chunks[] = { 1, 63, 64, 65, 127, 200, 0, 4096, 3 };
+
+static void
+vector_plan(struct plan *plan, uint32_t len, int split)
+{
+	uint32_t left, n;
+	int i = 0;
+
+	plan->len = len;
+	plan->n = 0;
+
+	if(!split) {
+		plan->chunk[plan->n++] = len;
+		return;
+	}
+
+	for(left = len; left && (plan->n < MAX_CHUNKS - 1); left -= n) {
+		n = vector_chunks[i++ % (sizeof(vector_chunks) / sizeof(vector_chunks[0]))];
+		plan->chunk[plan->n++] = n = (n < left) ? n : left;
+	}
+
+	if(left)
+		plan->chunk[plan->n++] = left;
+}
+
+/*
+ * All vectors by all kernels
+ * Return value: 0 (if all is well), -1 if all bad
+*/
+static int
+check_vectors(const struct vector *vec, int n)
+{
+	struct plan plan;
+	uint8_t *zero = xmalloc(MAX_STREAM), *out = xmalloc(MAX_STREAM), digest[64];
+	uint32_t i;
+	int k, j, split, r, kbad, bad = 0;
+
+	memset(zero, 0, MAX_STREAM);
+
+	for(k = 0; k < KERNELS; k++) {
+		kbad = 0;
+
+		for(j = 0; j < n; j++) {
+			for(split = 0; split < 2; split++) {
+				vector_plan(&plan, vec[j].len, split);
+
+				if(kernel_run(&kernels[k], vec[j].key, vec[j].iv, zero, zero, out, &plan)) {
+					printf("%s: %s refused!\n", kernels[k].name, vec[j].name);
+					kbad = 1;
+					continue;
+				}
+
+				for(r = 0; r < vec[j].ranges; r++) {
+					if(memcmp(out + vec[j].range[r].first, vec[j].range[r].bytes, 64)) {
+						printf("%s: %s, stream[%u..%u] differs (%s)!\n", kernels[k].name, vec[j].name,
+						       vec[j].range[r].first, vec[j].range[r].last, split ? "split calls" : "one call");
+						kbad = 1;
+					}
+				}
+
+				memset(digest, 0, sizeof(digest));
+				for(i = 0; i < vec[j].len; i++)
+					digest[i % 64] ^= out[i];
+
+				if(memcmp(digest, vec[j].digest, 64)) {
+					printf("%s: %s, xor-digest differs (%s)!\n", kernels[k].name, vec[j].name,
+					       split ? "split calls" : "one call");
+					kbad = 1;
+				}
+			}
+		}
+
+		if(!kbad)
+			printf("%-28s %d vectors ok\n", kernels[k].name, n);
+
+		bad |= kbad;
+	}
+
+	free(zero);
+	free(out);
+
+	return bad ? -1 : 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *path = "hc128_sources/verified.test-vectors";
+	struct vector *vec;
+	uint32_t rounds = 1000, max = 4096;
+	uint64_t seed = 1;
+	int n, opt;
+
+	while((opt = getopt(argc, argv, "f:r:s:l:")) != -1) {
+		switch(opt) {
+		case 'f':
+			path = optarg;
+			break;
+		case 'r':
+			rounds = strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			seed = strtoull(optarg, NULL, 10);
+			break;
+		case 'l':
+			max = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			printf("Usage: %s [-f test vectors] [-r random rounds] [-s seed] [-l max length]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if(max > MAX_LEN) {
+		printf("Max length <= %d!\n", MAX_LEN);
+		return 1;
+	}
+
+	ECRYPT_init();
+
+	vec = xmalloc(MAX_VECTORS * sizeof(*vec));
+
+	if((n = read_vectors(path, vec)) <= 0) {
+		printf("Test vectors read error!\n");
+		return 1;
+	}
+
+	if(check_vectors(vec, n)) {
+		printf("Test vectors failed!\n");
+		return 1;
+	}
+
+	if(check_random(rounds, seed, max)) {
+		printf("Differential check failed!\n");
+		return 1;
+	}
+
+	printf("differential: %u random rounds ok (seed %lu, length <= %u)\n", rounds, (unsigned long)seed, max);
+
+	free(vec);
+
+	return 0;
+}
+#endif
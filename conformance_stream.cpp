@@ -0,0 +1,49 @@
+/*
+ * The header-only engine hc128::stream (hc128.hpp) for conformance.c, which
+ * is C: one stream of the key and iv over the calls of a plan, through one
+ * of the sinks of the engine.
+*/
+
+#include <cstdint>
+#include <cstring>
+
+#include "hc128.hpp"
+
+extern "C" int conformance_stream(int sink, const std::uint8_t *key, const std::uint8_t *iv, const std::uint8_t *in,
+				  std::uint8_t *out, const std::uint32_t *chunk, int n);
+
+/*
+ * sink - 0: crypt(in, out), 1: crypt(buf) in place (the input is copied to
+ * out first unless it is out), 2: keystream(out)
+ * chunk, n - sizes of the calls
+ * Return value: 0 (if all is well), -1 if all bad
+*/
+int
+conformance_stream(int sink, const std::uint8_t *key, const std::uint8_t *iv, const std::uint8_t *in,
+		   std::uint8_t *out, const std::uint32_t *chunk, int n)
+{
+	try {
+		hc128::stream s(key, 16, iv, 16);
+		std::uint32_t off = 0;
+
+		for(int i = 0; i < n; off += chunk[i++]) {
+			switch(sink) {
+			case 0:
+				s.crypt(in + off, out + off, chunk[i]);
+				break;
+			case 1:
+				if(in != out)
+					std::memcpy(out + off, in + off, chunk[i]);
+				s.crypt(out + off, chunk[i]);
+				break;
+			default:
+				s.keystream(out + off, chunk[i]);
+			}
+		}
+	}
+	catch(...) {
+		return -1;
+	}
+
+	return 0;
+}
@@ -14,11 +14,35 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/uio.h>
+
+#ifdef HC128_PROFILE
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+#endif
+
+#ifdef HC128_STATS
+#include <pthread.h>
+#endif
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define HC128_SDT
+#endif
+#endif
 
 #include "hc128.h"
 
 #define HC128		16
 
+// Plaintext window and contexts in lockstep of hc128_crypt_fanout()
+#define FANOUT_WINDOW	4096
+#define FANOUT_LANES	4
+
 #define ROTL32(v, n)	((v << n) | (v >> (32 - n)))
 #define ROTR32(v, n)	((v >> n) | (v << (32 - n)))
 
@@ -100,6 +124,207 @@
 	res = U32TO32((res2 ^ ctx->w[512+a]));			\
 }
 
+// Stage counters of the profiled build, nothing at all otherwise
+#ifdef HC128_PROFILE
+static __thread struct hc128_profile profile;
+
+static inline uint64_t
+hc128_profile_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+// Time since t goes to the stage, t starts the next stage
+static inline void
+hc128_profile_lap(int stage, uint64_t *t)
+{
+	uint64_t now = hc128_profile_ticks();
+
+	profile.ticks[stage] += now - *t;
+	profile.count[stage]++;
+	*t = now;
+}
+
+void
+hc128_profile_get(struct hc128_profile *p)
+{
+	*p = profile;
+}
+
+void
+hc128_profile_reset(void)
+{
+	memset(&profile, 0, sizeof(profile));
+}
+
+#define PROFILE_START(t)	uint64_t t = hc128_profile_ticks()
+#define PROFILE_LAP(stage, t)	hc128_profile_lap(HC128_PROFILE_##stage, &t)
+#else
+#define PROFILE_START(t)
+#define PROFILE_LAP(stage, t)
+#endif
+
+/*
+ * Usage statistics, nothing at all without HC128_STATS.
+ * Every thread counts in its own shard with plain stores, the shards are
+ * summed by hc128_stats_snapshot(). A shard is linked on the first call of
+ * its thread and folded into the retired counters when the thread exits.
+*/
+#ifdef HC128_STATS
+struct hc128_stats_shard {
+	struct hc128_stats stats;
+	struct hc128_stats_shard *next;
+	struct hc128_stats_shard **prev;
+	int linked;
+};
+
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+static pthread_key_t stats_key;
+static struct hc128_stats_shard *stats_shards;
+static struct hc128_stats stats_retired;
+static __thread struct hc128_stats_shard stats_shard;
+
+// Counters of from added to to, the shard of a running thread is read whole words
+static void
+hc128_stats_add(struct hc128_stats *to, const struct hc128_stats *from)
+{
+	const uint64_t *f = (const uint64_t *)from;
+	uint64_t *t = (uint64_t *)to;
+	size_t i;
+
+	for(i = 0; i < sizeof(*to) / sizeof(uint64_t); i++)
+		t[i] += __atomic_load_n(&f[i], __ATOMIC_RELAXED);
+}
+
+static void
+hc128_stats_retire(void *arg)
+{
+	struct hc128_stats_shard *shard = arg;
+
+	pthread_mutex_lock(&stats_mutex);
+
+	hc128_stats_add(&stats_retired, &shard->stats);
+
+	if(shard->next)
+		shard->next->prev = shard->prev;
+	*shard->prev = shard->next;
+
+	pthread_mutex_unlock(&stats_mutex);
+
+	memset(shard, 0, sizeof(*shard));
+}
+
+static void
+hc128_stats_key(void)
+{
+	pthread_key_create(&stats_key, hc128_stats_retire);
+}
+
+static void
+hc128_stats_link(void)
+{
+	pthread_once(&stats_once, hc128_stats_key);
+
+	pthread_mutex_lock(&stats_mutex);
+
+	stats_shard.next = stats_shards;
+	stats_shard.prev = &stats_shards;
+	if(stats_shards)
+		stats_shards->prev = &stats_shard.next;
+	stats_shards = &stats_shard;
+	stats_shard.linked = 1;
+
+	pthread_mutex_unlock(&stats_mutex);
+
+	pthread_setspecific(stats_key, &stats_shard);
+}
+
+static inline struct hc128_stats *
+hc128_stats_local(void)
+{
+	if(__builtin_expect(!stats_shard.linked, 0))
+		hc128_stats_link();
+
+	return &stats_shard.stats;
+}
+
+// Size bucket: 0 bytes, then the bit length of the size
+static inline int
+hc128_stats_size(uint64_t len)
+{
+	int i = len ? 64 - __builtin_clzll(len) : 0;
+
+	return (i < HC128_STATS_SIZES) ? i : HC128_STATS_SIZES - 1;
+}
+
+/*
+ * Sum of the retired counters and the shards of the running threads.
+ * A thread counting during the snapshot is seen before or after each of its
+ * stores, so the counters are not a consistent cut, each one is exact.
+ * stats - pointer on the statistics
+*/
+void
+hc128_stats_snapshot(struct hc128_stats *stats)
+{
+	struct hc128_stats_shard *shard;
+
+	pthread_mutex_lock(&stats_mutex);
+
+	*stats = stats_retired;
+
+	for(shard = stats_shards; shard; shard = shard->next)
+		hc128_stats_add(stats, &shard->stats);
+
+	pthread_mutex_unlock(&stats_mutex);
+}
+
+// Plain store of the new value: the shard has a single writer
+#define STATS_ADD(field, n)	do {						\
+	struct hc128_stats *s_ = hc128_stats_local();				\
+	__atomic_store_n(&s_->field, s_->field + (n), __ATOMIC_RELAXED);	\
+} while(0)
+
+#define STATS_CALL(len)	do {							\
+	struct hc128_stats *s_ = hc128_stats_local();				\
+	uint64_t *b_ = &s_->sizes[hc128_stats_size(len)];			\
+	__atomic_store_n(&s_->calls, s_->calls + 1, __ATOMIC_RELAXED);		\
+	__atomic_store_n(&s_->bytes, s_->bytes + (len), __ATOMIC_RELAXED);	\
+	__atomic_store_n(b_, *b_ + 1, __ATOMIC_RELAXED);			\
+} while(0)
+#else
+#define STATS_ADD(field, n)
+#define STATS_CALL(len)
+#endif
+
+/*
+ * USDT probes of the provider hc128 (sys/sdt.h), compiled out without it.
+ * A probe is a nop until a tracer attaches, see the .bt scripts in bench.
+ * setup_entry(ctx, keylen), setup_return(ctx, result)
+ * setup_multi_entry(ctx array, n), setup_multi_return(ctx array, result)
+ * crypt_entry(ctx, len, api), crypt_return(ctx, len, api)
+ * api - PROBE_CRYPT, PROBE_CRYPT_BULK, PROBE_CRYPTV below
+*/
+#define PROBE_CRYPT		0
+#define PROBE_CRYPT_BULK	1
+#define PROBE_CRYPTV		2
+
+#ifdef HC128_SDT
+#define PROBE2(name, a, b)	DTRACE_PROBE2(hc128, name, a, b)
+#define PROBE3(name, a, b, c)	DTRACE_PROBE3(hc128, name, a, b, c)
+#else
+#define PROBE2(name, a, b)
+#define PROBE3(name, a, b, c)
+#endif
+
 // HC128 initialization function
 static void
 hc128_init(struct hc128_context *ctx)
@@ -107,63 +332,78 @@ hc128_init(struct hc128_context *ctx)
 	memset(ctx, 0, sizeof(*ctx));
 }
 
-// Function update array w[1024]
+// Function update 16 elements of array w[1024]
 static void
-hc128_setup_update(struct hc128_context *ctx)
+hc128_setup_update_block(struct hc128_context *ctx)
 {
-	int i, a;
-	
-	for(i = 0; i < 64; i++) {
+	int a;
 
-		a = ctx->counter & 0x1FF;
-		
-		if(ctx->counter < 512) {
-			UPDATE_P(ctx, a +  0, a +  1,  0,  6, 13,  4);
-			UPDATE_P(ctx, a +  1, a +  2,  1,  7, 14,  5);
-			UPDATE_P(ctx, a +  2, a +  3,  2,  8, 15,  6);		
-			UPDATE_P(ctx, a +  3, a +  4,  3,  9,  0,  7);
-			UPDATE_P(ctx, a +  4, a +  5,  4, 10,  1,  8);
-			UPDATE_P(ctx, a +  5, a +  6,  5, 11,  2,  9);
-			UPDATE_P(ctx, a +  6, a +  7,  6, 12,  3, 10);
-			UPDATE_P(ctx, a +  7, a +  8,  7, 13,  4, 11);
-			UPDATE_P(ctx, a +  8, a +  9,  8, 14,  5, 12);
-			UPDATE_P(ctx, a +  9, a + 10,  9, 15,  6, 13);
-			UPDATE_P(ctx, a + 10, a + 11, 10,  0,  7, 14);
-			UPDATE_P(ctx, a + 11, a + 12, 11,  1,  8, 15);
-			UPDATE_P(ctx, a + 12, a + 13, 12,  2,  9,  0);
-			UPDATE_P(ctx, a + 13, a + 14, 13,  3, 10,  1);
-			UPDATE_P(ctx, a + 14, a + 15, 14,  4, 11,  2);
-			UPDATE_P(ctx, a + 15, ((a + 16) & 0x1FF), 15,  5, 12,  3);
-		}
-		else {
-			UPDATE_Q(ctx, a +  0, a +  1,  0,  6, 13,  4);
-			UPDATE_Q(ctx, a +  1, a +  2,  1,  7, 14,  5);
-			UPDATE_Q(ctx, a +  2, a +  3,  2,  8, 15,  6);
-			UPDATE_Q(ctx, a +  3, a +  4,  3,  9,  0,  7);
-			UPDATE_Q(ctx, a +  4, a +  5,  4, 10,  1,  8);
-			UPDATE_Q(ctx, a +  5, a +  6,  5, 11,  2,  9);
-			UPDATE_Q(ctx, a +  6, a +  7,  6, 12,  3, 10);
-			UPDATE_Q(ctx, a +  7, a +  8,  7, 13,  4, 11);
-			UPDATE_Q(ctx, a +  8, a +  9,  8, 14,  5, 12);
-			UPDATE_Q(ctx, a +  9, a + 10,  9, 15,  6, 13);
-			UPDATE_Q(ctx, a + 10, a + 11, 10,  0,  7, 14);
-			UPDATE_Q(ctx, a + 11, a + 12, 11,  1,  8, 15);
-			UPDATE_Q(ctx, a + 12, a + 13, 12,  2,  9,  0);
-			UPDATE_Q(ctx, a + 13, a + 14, 13,  3, 10,  1);
-			UPDATE_Q(ctx, a + 14, a + 15, 14,  4, 11,  2);
-			UPDATE_Q(ctx, a + 15, ((a + 16) & 0x1FF), 15,  5, 12,  3);
-		}
-		
-		ctx->counter = (ctx->counter + 16) & 0x3FF;
+	a = ctx->counter & 0x1FF;
+	
+	if(ctx->counter < 512) {
+		UPDATE_P(ctx, a +  0, a +  1,  0,  6, 13,  4);
+		UPDATE_P(ctx, a +  1, a +  2,  1,  7, 14,  5);
+		UPDATE_P(ctx, a +  2, a +  3,  2,  8, 15,  6);		
+		UPDATE_P(ctx, a +  3, a +  4,  3,  9,  0,  7);
+		UPDATE_P(ctx, a +  4, a +  5,  4, 10,  1,  8);
+		UPDATE_P(ctx, a +  5, a +  6,  5, 11,  2,  9);
+		UPDATE_P(ctx, a +  6, a +  7,  6, 12,  3, 10);
+		UPDATE_P(ctx, a +  7, a +  8,  7, 13,  4, 11);
+		UPDATE_P(ctx, a +  8, a +  9,  8, 14,  5, 12);
+		UPDATE_P(ctx, a +  9, a + 10,  9, 15,  6, 13);
+		UPDATE_P(ctx, a + 10, a + 11, 10,  0,  7, 14);
+		UPDATE_P(ctx, a + 11, a + 12, 11,  1,  8, 15);
+		UPDATE_P(ctx, a + 12, a + 13, 12,  2,  9,  0);
+		UPDATE_P(ctx, a + 13, a + 14, 13,  3, 10,  1);
+		UPDATE_P(ctx, a + 14, a + 15, 14,  4, 11,  2);
+		UPDATE_P(ctx, a + 15, ((a + 16) & 0x1FF), 15,  5, 12,  3);
 	}
+	else {
+		UPDATE_Q(ctx, a +  0, a +  1,  0,  6, 13,  4);
+		UPDATE_Q(ctx, a +  1, a +  2,  1,  7, 14,  5);
+		UPDATE_Q(ctx, a +  2, a +  3,  2,  8, 15,  6);
+		UPDATE_Q(ctx, a +  3, a +  4,  3,  9,  0,  7);
+		UPDATE_Q(ctx, a +  4, a +  5,  4, 10,  1,  8);
+		UPDATE_Q(ctx, a +  5, a +  6,  5, 11,  2,  9);
+		UPDATE_Q(ctx, a +  6, a +  7,  6, 12,  3, 10);
+		UPDATE_Q(ctx, a +  7, a +  8,  7, 13,  4, 11);
+		UPDATE_Q(ctx, a +  8, a +  9,  8, 14,  5, 12);
+		UPDATE_Q(ctx, a +  9, a + 10,  9, 15,  6, 13);
+		UPDATE_Q(ctx, a + 10, a + 11, 10,  0,  7, 14);
+		UPDATE_Q(ctx, a + 11, a + 12, 11,  1,  8, 15);
+		UPDATE_Q(ctx, a + 12, a + 13, 12,  2,  9,  0);
+		UPDATE_Q(ctx, a + 13, a + 14, 13,  3, 10,  1);
+		UPDATE_Q(ctx, a + 14, a + 15, 14,  4, 11,  2);
+		UPDATE_Q(ctx, a + 15, ((a + 16) & 0x1FF), 15,  5, 12,  3);
+	}
+	
+	ctx->counter = (ctx->counter + 16) & 0x3FF;
 }
 
-// Function initialization process
-// System is ready to generate keystream
+// Function update array w[1024]: 32 blocks of P, then 32 blocks of Q
 static void
-hc128_initialization_process(struct hc128_context *ctx)
+hc128_setup_update(struct hc128_context *ctx)
 {
 	int i;
+	PROFILE_START(t);
+
+	for(i = 0; i < 32; i++)
+		hc128_setup_update_block(ctx);
+
+	PROFILE_LAP(SETUP_P, t);
+
+	for(i = 0; i < 32; i++)
+		hc128_setup_update_block(ctx);
+
+	PROFILE_LAP(SETUP_Q, t);
+}
+
+// Expansion of the key and iv into array w[1024]
+static void
+hc128_expand(struct hc128_context *ctx)
+{
+	int i;
+	PROFILE_START(t);
 
 	for(i = 0; i < 8; i++) {
 		ctx->w[i] = U8TO32_LITTLE(ctx->key + (i * 4) % 16);
@@ -175,6 +415,8 @@ hc128_initialization_process(struct hc128_context *ctx)
 	
 	for(i = 16; i < (256 + 16); i++)
 		ctx->w[i] = F2(ctx->w[i-2]) + ctx->w[i-7] + F1(ctx->w[i-15]) + ctx->w[i-16] + i;
+
+	PROFILE_LAP(EXPAND_KEY, t);
 	
 	for(i = 0; i < 16; i++)
 		ctx->w[i] = ctx->w[256 + i];
@@ -182,11 +424,22 @@ hc128_initialization_process(struct hc128_context *ctx)
 	for(i = 16; i < 1024; i++)
 		ctx->w[i] = F2(ctx->w[i-2]) + ctx->w[i-7] + F1(ctx->w[i-15]) + ctx->w[i-16] + 256 + i;
 
+	PROFILE_LAP(EXPAND_W, t);
+
 	for(i = 0; i < 16; i++) {
 		ctx->x[i] = ctx->w[496+i];
 		ctx->y[i] = ctx->w[1008+i];
 	}
-	
+
+	PROFILE_LAP(XY, t);
+}
+
+// Function initialization process
+// System is ready to generate keystream
+static void
+hc128_initialization_process(struct hc128_context *ctx)
+{
+	hc128_expand(ctx);
 	hc128_setup_update(ctx);
 }
 
@@ -195,23 +448,76 @@ hc128_initialization_process(struct hc128_context *ctx)
 int
 hc128_set_key_and_iv(struct hc128_context *ctx, const uint8_t *key, const int keylen, const uint8_t iv[16], const int ivlen)
 {
+	PROBE2(setup_entry, ctx, keylen);
+
 	hc128_init(ctx);
 
 	if(keylen <= HC128)
 		ctx->keylen = keylen;
-	else
+	else {
+		PROBE2(setup_return, ctx, -1);
 		return -1;
+	}
 	
 	if((ivlen > 0) && (ivlen <= 16))
 		ctx->ivlen = ivlen;
-	else
+	else {
+		PROBE2(setup_return, ctx, -1);
 		return -1;
+	}
 	
 	memcpy(ctx->key, key, ctx->keylen);
 	memcpy(ctx->iv, iv, ctx->ivlen);
 	ctx->counter = 0;
 
 	hc128_initialization_process(ctx);
+	STATS_ADD(setups, 1);
+
+	PROBE2(setup_return, ctx, 0);
+
+	return 0;
+}
+
+/*
+ * Batched filling of the HC128 contexts.
+ * All contexts get the same key and their own iv[i]. The 64 update
+ * rounds of the contexts are interleaved, so the independent contexts
+ * hide each other's latency and the setup cost is amortized.
+ * ctx - array of n pointers on HC128 contexts
+ * iv - array of n initialization vectors
+ * Return value: 0 (if all is well), -1 id all bad
+*/
+int
+hc128_set_key_and_iv_multi(struct hc128_context **ctx, const int n, const uint8_t *key, const int keylen, const uint8_t iv[][16], const int ivlen)
+{
+	int i, j;
+
+	PROBE2(setup_multi_entry, ctx, n);
+
+	if((keylen > HC128) || (ivlen <= 0) || (ivlen > 16)) {
+		PROBE2(setup_multi_return, ctx, -1);
+		return -1;
+	}
+
+	for(j = 0; j < n; j++) {
+		hc128_init(ctx[j]);
+
+		ctx[j]->keylen = keylen;
+		ctx[j]->ivlen = ivlen;
+		memcpy(ctx[j]->key, key, keylen);
+		memcpy(ctx[j]->iv, iv[j], ivlen);
+
+		hc128_expand(ctx[j]);
+	}
+
+	for(i = 0; i < 64; i++) {
+		for(j = 0; j < n; j++)
+			hc128_setup_update_block(ctx[j]);
+	}
+
+	STATS_ADD(setups, n);
+
+	PROBE2(setup_multi_return, ctx, 0);
 
 	return 0;
 }
@@ -261,23 +567,75 @@ hc128_generate_keystream(struct hc128_context *ctx, uint32_t *keystream)
 	}
 	
 	ctx->counter = (ctx->counter + 16) & 0x3ff;
+	STATS_ADD(blocks, 1);
 }
 
-/*
- * HC128 crypt algorithm.
- * ctx - pointer on HC128 context
- * buf - pointer on buffer data
- * buflen - length the data buffer
- * out - pointer on output array
-*/
-void
-hc128_crypt(struct hc128_context *ctx, const uint8_t *buf, uint32_t buflen, uint8_t *out)
+// XOR of the n bytes with the keystream, 8 bytes at a time
+static inline void
+hc128_xor(uint8_t *out, const uint8_t *buf, const uint8_t *keystream, uint32_t n)
+{
+	uint64_t a, b;
+
+	for(; n >= 8; n -= 8, out += 8, buf += 8, keystream += 8) {
+		memcpy(&a, buf, 8);
+		memcpy(&b, keystream, 8);
+		a ^= b;
+		memcpy(out, &a, 8);
+	}
+
+	while(n--)
+		*out++ = *buf++ ^ *keystream++;
+}
+
+// Use the keystream bytes left unused by the previous call
+// buf == NULL - the keystream itself is written to out
+// Return value: number of bytes processed
+static uint32_t
+hc128_use_remain(struct hc128_context *ctx, const uint8_t *buf, uint32_t buflen, uint8_t *out)
+{
+	uint32_t n;
+
+	n = (buflen < ctx->remain) ? buflen : ctx->remain;
+
+	if(buf)
+		hc128_xor(out, buf, ctx->stream + 64 - ctx->remain, n);
+	else
+		memcpy(out, ctx->stream + 64 - ctx->remain, n);
+
+	ctx->remain -= n;
+	STATS_ADD(partial, 1);
+
+	return n;
+}
+
+// Keep the keystream bytes of the last block unused by the call
+static void
+hc128_save_remain(struct hc128_context *ctx, const uint32_t *keystream, uint32_t used)
+{
+	memcpy(ctx->stream + used, (const uint8_t *)keystream + used, 64 - used);
+	ctx->remain = 64 - used;
+	STATS_ADD(tails, 1);
+}
+
+// Crypt of hc128_crypt(), also the tails and fragments of the other crypt calls
+static void
+hc128_crypt_stream(struct hc128_context *ctx, const uint8_t *buf, uint32_t buflen, uint8_t *out)
 {
 	uint32_t keystream[16];
-	uint32_t i;
+	uint32_t n;
+	PROFILE_START(t);
+
+	if(ctx->remain) {
+		n = hc128_use_remain(ctx, buf, buflen, out);
+		buflen -= n;
+		buf += n;
+		out += n;
+		PROFILE_LAP(COMBINE, t);
+	}
 
 	for(; buflen >= 64; buflen -= 64, buf += 64, out += 64) {
 		hc128_generate_keystream(ctx, keystream);
+		PROFILE_LAP(GENERATE, t);
 
 		*(uint32_t *)(out +  0) = *(uint32_t *)(buf +  0) ^ keystream[ 0];
 		*(uint32_t *)(out +  4) = *(uint32_t *)(buf +  4) ^ keystream[ 1];
@@ -295,14 +653,407 @@ hc128_crypt(struct hc128_context *ctx, const uint8_t *buf, uint32_t buflen, uint
 		*(uint32_t *)(out + 52) = *(uint32_t *)(buf + 52) ^ keystream[13];
 		*(uint32_t *)(out + 56) = *(uint32_t *)(buf + 56) ^ keystream[14];
 		*(uint32_t *)(out + 60) = *(uint32_t *)(buf + 60) ^ keystream[15];
+		PROFILE_LAP(COMBINE, t);
 	}
 	
 	if(buflen) {
 		hc128_generate_keystream(ctx, keystream);
-		
-		for(i = 0; i < buflen; i++)
-			out[i] = buf[i] ^ ((uint8_t *)keystream)[i];
+		PROFILE_LAP(GENERATE, t);
+		hc128_xor(out, buf, (uint8_t *)keystream, buflen);
+		hc128_save_remain(ctx, keystream, buflen);
+		PROFILE_LAP(COMBINE, t);
+	}
+}
+
+/*
+ * HC128 crypt algorithm.
+ * The keystream is continuous between the calls: the keystream bytes
+ * unused by the previous call are used first.
+ * ctx - pointer on HC128 context
+ * buf - pointer on buffer data
+ * buflen - length the data buffer
+ * out - pointer on output array
+*/
+void
+hc128_crypt(struct hc128_context *ctx, const uint8_t *buf, uint32_t buflen, uint8_t *out)
+{
+	STATS_CALL(buflen);
+	PROBE3(crypt_entry, ctx, buflen, PROBE_CRYPT);
+
+	hc128_crypt_stream(ctx, buf, buflen, out);
+
+	PROBE3(crypt_return, ctx, buflen, PROBE_CRYPT);
+}
+
+/*
+ * HC128 crypt of the format before the continuous keystream.
+ * Every call starts on a new keystream block, the keystream bytes of the
+ * last block unused by the call are dropped. For the data written by
+ * hc128_crypt() calls of lengths not a multiple of 64 before the keystream
+ * became continuous (the single file mode of the old bigtest); new data
+ * should use hc128_crypt().
+ * ctx - pointer on HC128 context
+ * buf - pointer on buffer data
+ * buflen - length the data buffer
+ * out - pointer on output array
+*/
+void
+hc128_crypt_blockwise(struct hc128_context *ctx, const uint8_t *buf, uint32_t buflen, uint8_t *out)
+{
+	STATS_CALL(buflen);
+	PROBE3(crypt_entry, ctx, buflen, PROBE_CRYPT);
+
+	ctx->remain = 0;
+	hc128_crypt_stream(ctx, buf, buflen, out);
+	ctx->remain = 0;
+
+	PROBE3(crypt_return, ctx, buflen, PROBE_CRYPT);
+}
+
+// Crypt of hc128_crypt_bulk()
+static void
+hc128_crypt_bulk_stream(struct hc128_context *ctx, const uint8_t *buf, uint32_t buflen, uint8_t *out)
+{
+	uint32_t keystream[256];
+	uint64_t a, k;
+	uint32_t i, n;
+
+	if(ctx->remain) {
+		n = hc128_use_remain(ctx, buf, buflen, out);
+		buflen -= n;
+		buf += n;
+		out += n;
 	}
+
+	while(buflen >= 64) {
+		n = (buflen < sizeof(keystream)) ? (buflen & ~63U) : sizeof(keystream);
+
+		for(i = 0; i < n / 64; i++)
+			hc128_generate_keystream(ctx, keystream + i * 16);
+
+		// 64-bit loads through memcpy, the keystream stays uint32_t
+		for(i = 0; i < n / 8; i++) {
+			memcpy(&a, buf + i * 8, 8);
+			memcpy(&k, (const uint8_t *)keystream + i * 8, 8);
+			a ^= k;
+			memcpy(out + i * 8, &a, 8);
+		}
+
+		buflen -= n;
+		buf += n;
+		out += n;
+	}
+
+	if(buflen)
+		hc128_crypt_stream(ctx, buf, buflen, out);
+}
+
+/*
+ * HC128 bulk crypt.
+ * The keystream of up to 16 blocks is generated first and then combined
+ * with the data in one simple loop, which the compiler vectorizes.
+ * The result is the same as of hc128_crypt().
+ * ctx - pointer on HC128 context
+ * buf - pointer on buffer data
+ * buflen - length the data buffer
+ * out - pointer on output array
+*/
+void
+hc128_crypt_bulk(struct hc128_context *ctx, const uint8_t *buf, uint32_t buflen, uint8_t *out)
+{
+	STATS_CALL(buflen);
+	PROBE3(crypt_entry, ctx, buflen, PROBE_CRYPT_BULK);
+
+	hc128_crypt_bulk_stream(ctx, buf, buflen, out);
+
+	PROBE3(crypt_return, ctx, buflen, PROBE_CRYPT_BULK);
+}
+
+/*
+ * HC128 keystream generation.
+ * The keystream is written directly to out, no input is read.
+ * It is continuous with hc128_crypt() and hc128_keystream_blocks().
+ * ctx - pointer on HC128 context
+ * out - pointer on output array
+ * len - length of the keystream in bytes
+*/
+void
+hc128_keystream(struct hc128_context *ctx, uint8_t *out, uint32_t len)
+{
+	uint32_t keystream[16];
+	uint32_t n;
+
+	if(ctx->remain) {
+		n = hc128_use_remain(ctx, NULL, len, out);
+		len -= n;
+		out += n;
+	}
+
+	for(; len >= 64; len -= 64, out += 64)
+		hc128_generate_keystream(ctx, (uint32_t *)out);
+
+	if(len) {
+		hc128_generate_keystream(ctx, keystream);
+		memcpy(out, keystream, len);
+		hc128_save_remain(ctx, keystream, len);
+	}
+}
+
+/*
+ * HC128 bulk keystream generation of the 64-byte blocks.
+ * ctx - pointer on HC128 context
+ * out - pointer on output array (blocks * 64 bytes)
+ * blocks - number of blocks
+*/
+void
+hc128_keystream_blocks(struct hc128_context *ctx, uint8_t *out, uint32_t blocks)
+{
+	// The stream is not block aligned after a partial call
+	if(ctx->remain) {
+		for(; blocks; blocks--, out += 64)
+			hc128_keystream(ctx, out, 64);
+
+		return;
+	}
+
+	for(; blocks; blocks--, out += 64)
+		hc128_generate_keystream(ctx, (uint32_t *)out);
+}
+
+/*
+ * HC128 keystream generation for n contexts in lockstep.
+ * Every round generates one block of each context, so the independent
+ * contexts overlap in the pipeline.
+ * ctx - array of n pointers on HC128 contexts
+ * out - array of n output arrays (blocks * 64 bytes each)
+ * blocks - number of blocks for each context
+*/
+void
+hc128_keystream_multi(struct hc128_context **ctx, const int n, uint8_t **out, uint32_t blocks)
+{
+	uint32_t i;
+	int j;
+
+	for(i = 0; i < blocks; i++) {
+		for(j = 0; j < n; j++) {
+			if(ctx[j]->remain)
+				hc128_keystream(ctx[j], out[j] + (size_t)i * 64, 64);
+			else
+				hc128_generate_keystream(ctx[j], (uint32_t *)(out[j] + (size_t)i * 64));
+		}
+	}
+}
+
+// Lockstep crypt of n <= FANOUT_LANES block aligned contexts over len (multiple of 64) bytes
+static void
+hc128_crypt_lanes(struct hc128_context **ctx, const int n, const uint8_t *buf, uint32_t len, uint8_t **out, uint32_t offset)
+{
+	uint32_t keystream[16];
+	uint32_t i;
+	int j;
+
+	for(i = 0; i < len; i += 64) {
+		for(j = 0; j < n; j++) {
+			hc128_generate_keystream(ctx[j], keystream);
+			hc128_xor(out[j] + offset + i, buf + i, (const uint8_t *)keystream, 64);
+		}
+	}
+}
+
+/*
+ * HC128 crypt of one plaintext for n contexts.
+ * The plaintext goes in windows of FANOUT_WINDOW bytes, every window is
+ * read from memory once and combined with the keystream of all contexts
+ * while it is in L1. Block aligned contexts run FANOUT_LANES in lockstep,
+ * contexts with unused keystream bytes go through hc128_crypt().
+ * The result for every context is the same as of hc128_crypt().
+ * One context may encrypt in place (its out is buf), its window is
+ * written after the others have read it.
+ * ctx - array of n pointers on HC128 contexts
+ * buf - pointer on buffer data
+ * buflen - length the data buffer
+ * out - array of n output arrays (buflen bytes each)
+*/
+void
+hc128_crypt_fanout(struct hc128_context **ctx, const int n, const uint8_t *buf, uint32_t buflen, uint8_t **out)
+{
+	struct hc128_context *lane[FANOUT_LANES];
+	uint8_t *lane_out[FANOUT_LANES];
+	uint32_t offset, len, full;
+	int j, k, m, inplace = -1;
+
+	for(j = 0; j < n; j++) {
+		STATS_CALL(buflen);
+
+		if(out[j] == buf)
+			inplace = j;
+	}
+
+	for(offset = 0; offset < buflen; offset += len) {
+		len = (buflen - offset < FANOUT_WINDOW) ? buflen - offset : FANOUT_WINDOW;
+		full = len & ~63U;
+
+		for(j = 0, m = 0; j < n; j++) {
+			if((j != inplace) && (ctx[j]->remain || !full))
+				hc128_crypt_stream(ctx[j], buf + offset, len, out[j] + offset);
+			else if(j != inplace) {
+				lane[m] = ctx[j];
+				lane_out[m] = out[j];
+				m++;
+			}
+
+			if(!m || ((m < FANOUT_LANES) && (j < n - 1)))
+				continue;
+
+			hc128_crypt_lanes(lane, m, buf + offset, full, lane_out, offset);
+
+			// Tail of the last window
+			for(k = 0; (len > full) && (k < m); k++)
+				hc128_crypt_stream(lane[k], buf + offset + full, len - full, lane_out[k] + offset + full);
+
+			m = 0;
+		}
+
+		if(inplace >= 0)
+			hc128_crypt_stream(ctx[inplace], buf + offset, len, out[inplace] + offset);
+	}
+}
+
+/*
+ * HC128 scatter/gather crypt.
+ * One continuous keystream runs over all fragments, the full block path
+ * of hc128_crypt() is used whenever 64 contiguous bytes are available.
+ * ctx - pointer on HC128 context
+ * in - array of inc input fragments
+ * out - array of outc output fragments
+ * Return value: 0 (if all is well), -1 if the total lengths differ
+*/
+int
+hc128_cryptv(struct hc128_context *ctx, const struct iovec *in, int inc, struct iovec *out, int outc)
+{
+	size_t inlen = 0, outlen = 0, inoff = 0, outoff = 0, n;
+	int i, j;
+
+	for(i = 0; i < inc; i++)
+		inlen += in[i].iov_len;
+
+	for(j = 0; j < outc; j++)
+		outlen += out[j].iov_len;
+
+	if(inlen != outlen)
+		return -1;
+
+	STATS_CALL(inlen);
+	PROBE3(crypt_entry, ctx, inlen, PROBE_CRYPTV);
+
+	for(i = 0, j = 0; (i < inc) && (j < outc); ) {
+		n = in[i].iov_len - inoff;
+
+		if(n > out[j].iov_len - outoff)
+			n = out[j].iov_len - outoff;
+
+		if(n > 0x40000000)
+			n = 0x40000000;
+
+		hc128_crypt_stream(ctx, (const uint8_t *)in[i].iov_base + inoff, n, (uint8_t *)out[j].iov_base + outoff);
+
+		inoff += n;
+		outoff += n;
+
+		if(inoff == in[i].iov_len) {
+			i++;
+			inoff = 0;
+		}
+
+		if(outoff == out[j].iov_len) {
+			j++;
+			outoff = 0;
+		}
+	}
+
+	PROBE3(crypt_return, ctx, inlen, PROBE_CRYPTV);
+
+	return 0;
+}
+
+// Format of the serialized context
+#define SERIALIZED_VERSION	1
+
+/*
+ * Serialization of the HC128 context.
+ * Only the state of the keystream is written: w (little endian), counter,
+ * remain and the unused keystream bytes. Key and iv are not written,
+ * x and y are rebuilt from w and counter by hc128_deserialize().
+ * ctx - pointer on HC128 context
+ * out - pointer on output array (HC128_SERIALIZED_MAX bytes)
+ * Return value: length of the serialized context
+*/
+uint32_t
+hc128_serialize(const struct hc128_context *ctx, uint8_t *out)
+{
+	int i;
+
+	for(i = 0; i < 1024; i++) {
+		out[i * 4 + 0] = (uint8_t)ctx->w[i];
+		out[i * 4 + 1] = (uint8_t)(ctx->w[i] >> 8);
+		out[i * 4 + 2] = (uint8_t)(ctx->w[i] >> 16);
+		out[i * 4 + 3] = (uint8_t)(ctx->w[i] >> 24);
+	}
+
+	out[4096] = (uint8_t)ctx->counter;
+	out[4097] = (uint8_t)(ctx->counter >> 8);
+	out[4098] = (uint8_t)ctx->remain;
+	out[4099] = SERIALIZED_VERSION;
+
+	memcpy(out + HC128_SERIALIZED_MIN, ctx->stream + 64 - ctx->remain, ctx->remain);
+
+	return HC128_SERIALIZED_MIN + ctx->remain;
+}
+
+/*
+ * Restore the HC128 context from hc128_serialize().
+ * The keystream goes on from the point of the serialization.
+ * x and y are the last 16 updated elements of P and Q: the block before
+ * counter in its half, or the last block of the half not in use.
+ * ctx - pointer on HC128 context (key and iv are left empty)
+ * in - serialized context
+ * len - length of the serialized context
+ * Return value: 0 (if all is well), -1 id all bad
+*/
+int
+hc128_deserialize(struct hc128_context *ctx, const uint8_t *in, uint32_t len)
+{
+	uint32_t counter, remain, p, q;
+	int i;
+
+	if(len < HC128_SERIALIZED_MIN)
+		return -1;
+
+	counter = in[4096] | ((uint32_t)in[4097] << 8);
+	remain = in[4098];
+
+	if((in[4099] != SERIALIZED_VERSION) || (counter & 0xFC0F) || (remain >= 64) ||
+	   (len != HC128_SERIALIZED_MIN + remain))
+		return -1;
+
+	hc128_init(ctx);
+
+	for(i = 0; i < 1024; i++)
+		ctx->w[i] = U8TO32_LITTLE(in + i * 4);
+
+	ctx->counter = counter;
+	ctx->remain = remain;
+	memcpy(ctx->stream + 64 - remain, in + HC128_SERIALIZED_MIN, remain);
+
+	p = (((counter < 512) ? counter : 512) - 16) & 0x1FF;
+	q = (((counter < 512) ? 0 : counter - 512) - 16) & 0x1FF;
+
+	for(i = 0; i < 16; i++) {
+		ctx->x[i] = ctx->w[p + i];
+		ctx->y[i] = ctx->w[512 + q + i];
+	}
+
+	return 0;
 }
 
 #if __BYTE_ORDER == __BIG_ENDIAN
@@ -7,6 +7,10 @@
 #ifndef HC128_H
 #define HC128_H
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /* 
  * HC128 context
  * keylen - chiper key length in bytes
@@ -17,6 +21,8 @@
  * x - array with 16 32-bit elements (for intermediate calculations)
  * y - array with 16 32-bit elements (for intermediate calculations)
  * counter - the counter system
+ * stream - keystream of the last block, unused by the previous hc128_crypt() call
+ * remain - number of unused bytes at the end of stream
 */
 struct hc128_context {
 	int keylen;
@@ -27,12 +33,108 @@ struct hc128_context {
 	uint32_t x[16];
 	uint32_t y[16];
 	uint32_t counter;
+	uint8_t stream[64];
+	uint32_t remain;
 };
 
+// Size of the serialized context: w, counter, remain, version, unused keystream
+#define HC128_SERIALIZED_MIN	4100
+#define HC128_SERIALIZED_MAX	(HC128_SERIALIZED_MIN + 64)
+
+struct iovec;
+
 int hc128_set_key_and_iv(struct hc128_context *ctx, const uint8_t *key, const int keylen, const uint8_t iv[16], const int ivlen);
 
+int hc128_set_key_and_iv_multi(struct hc128_context **ctx, const int n, const uint8_t *key, const int keylen, const uint8_t iv[][16], const int ivlen);
+
 void hc128_crypt(struct hc128_context *ctx, const uint8_t *buf, uint32_t buflen, uint8_t *out);
 
+void hc128_crypt_blockwise(struct hc128_context *ctx, const uint8_t *buf, uint32_t buflen, uint8_t *out);
+
+void hc128_crypt_bulk(struct hc128_context *ctx, const uint8_t *buf, uint32_t buflen, uint8_t *out);
+
+void hc128_keystream(struct hc128_context *ctx, uint8_t *out, uint32_t len);
+
+void hc128_keystream_blocks(struct hc128_context *ctx, uint8_t *out, uint32_t blocks);
+
+void hc128_keystream_multi(struct hc128_context **ctx, const int n, uint8_t **out, uint32_t blocks);
+
+void hc128_crypt_fanout(struct hc128_context **ctx, const int n, const uint8_t *buf, uint32_t buflen, uint8_t **out);
+
+int hc128_cryptv(struct hc128_context *ctx, const struct iovec *in, int inc, struct iovec *out, int outc);
+
+uint32_t hc128_serialize(const struct hc128_context *ctx, uint8_t *out);
+
+int hc128_deserialize(struct hc128_context *ctx, const uint8_t *in, uint32_t len);
+
 void hc128_test_vectors(struct hc128_context *ctx);
 
+#ifdef HC128_PROFILE
+/*
+ * Stages of the profiled build (hc128.c compiled with -DHC128_PROFILE)
+ * EXPAND_KEY - key and iv into w, the first expansion loop
+ * EXPAND_W - the second expansion loop, w[16..1023]
+ * XY - copy of x and y from w
+ * SETUP_P, SETUP_Q - the 64 setup update rounds, P and Q halves
+ * GENERATE, COMBINE - keystream block and its xor with the data in hc128_crypt()
+*/
+enum {
+	HC128_PROFILE_EXPAND_KEY,
+	HC128_PROFILE_EXPAND_W,
+	HC128_PROFILE_XY,
+	HC128_PROFILE_SETUP_P,
+	HC128_PROFILE_SETUP_Q,
+	HC128_PROFILE_GENERATE,
+	HC128_PROFILE_COMBINE,
+	HC128_PROFILE_STAGES
+};
+
+/*
+ * Counters of the calling thread
+ * ticks - rdtsc cycles (nanoseconds if no rdtsc) spent in the stage
+ * count - times the stage ran
+*/
+struct hc128_profile {
+	uint64_t ticks[HC128_PROFILE_STAGES];
+	uint64_t count[HC128_PROFILE_STAGES];
+};
+
+void hc128_profile_get(struct hc128_profile *profile);
+
+void hc128_profile_reset(void);
+#endif
+
+#ifdef HC128_STATS
+// Buckets of the call sizes: 0 bytes, then [2^(i-1), 2^i), the last one is 2^31 and more
+#define HC128_STATS_SIZES	33
+
+/*
+ * Usage statistics of the library (hc128.c compiled with -DHC128_STATS)
+ * bytes - bytes encrypted by the crypt calls
+ * blocks - keystream blocks generated, setup excluded
+ * setups - key setups (every context of hc128_set_key_and_iv_multi())
+ * calls - crypt calls: hc128_crypt(), hc128_crypt_bulk(), hc128_cryptv(), a fanout call once per context
+ * partial - pieces starting on the keystream left unused by the previous call
+ * tails - pieces ending in a partial block, the rest of its keystream kept
+ * (a piece is a crypt or keystream call, a fragment of hc128_cryptv(), a block
+ * of hc128_keystream_blocks() on a stream that is not block aligned)
+ * sizes - histogram of the crypt call sizes
+*/
+struct hc128_stats {
+	uint64_t bytes;
+	uint64_t blocks;
+	uint64_t setups;
+	uint64_t calls;
+	uint64_t partial;
+	uint64_t tails;
+	uint64_t sizes[HC128_STATS_SIZES];
+};
+
+void hc128_stats_snapshot(struct hc128_stats *stats);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
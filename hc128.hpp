@@ -0,0 +1,405 @@
+/*
+ * Header-only C++ engine of the HC-128 algorithm (C++17, std::span with C++20).
+ * Same algorithm and keystream as hc128.c.
+ * The step indices are constexpr tables, blocks of 16 steps and halves
+ * of 512 steps are unrolled by templates, and the output sink is a policy
+ * parameter, so every combination compiles to its own specialized loop:
+ * xor_sink - out = in ^ keystream
+ * keystream_sink - out = keystream
+ * inplace_sink - buf ^= keystream
+ * hc128::stream owns its 4 KB state on the heap: it is move-only, a move
+ * does not copy the state (the moved-from stream must not be used), and
+ * the state is wiped on destruction.
+*/
+
+#ifndef HC128_HPP
+#define HC128_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#if __cplusplus >= 202002L
+#include <span>
+#endif
+
+namespace hc128 {
+
+namespace detail {
+
+constexpr std::uint32_t rotr(std::uint32_t v, unsigned n) { return (v >> n) | (v << (32 - n)); }
+constexpr std::uint32_t rotl(std::uint32_t v, unsigned n) { return (v << n) | (v >> (32 - n)); }
+
+constexpr std::uint32_t f1(std::uint32_t x) { return rotr(x, 7) ^ rotr(x, 18) ^ (x >> 3); }
+constexpr std::uint32_t f2(std::uint32_t x) { return rotr(x, 17) ^ rotr(x, 19) ^ (x >> 10); }
+
+// Indices of x[] (y[]) used by step j of a block: written, g second, g first, h
+struct step_index {
+	unsigned c, d, e, f;
+};
+
+constexpr std::array<step_index, 16> make_steps()
+{
+	std::array<step_index, 16> s{};
+
+	for(unsigned j = 0; j < 16; j++)
+		s[j] = step_index{ j, (j + 6) & 15, (j + 13) & 15, (j + 4) & 15 };
+
+	return s;
+}
+
+inline constexpr std::array<step_index, 16> steps = make_steps();
+
+/*
+ * State of the cipher
+ * w - P[512] followed by Q[512]
+ * x, y - last 16 elements of P and Q
+ * counter - the counter system
+ * stream, remain - unused keystream bytes of the last block
+*/
+struct state {
+	std::uint32_t w[1024];
+	std::uint32_t x[16];
+	std::uint32_t y[16];
+	std::uint32_t counter;
+	std::uint8_t stream[64];
+	std::uint32_t remain;
+};
+
+// Wipe the state before freeing
+struct wipe_delete {
+	void operator()(state *s) const noexcept
+	{
+		volatile std::uint8_t *p = reinterpret_cast<volatile std::uint8_t *>(s);
+
+		for(std::size_t i = 0; i < sizeof(*s); i++)
+			p[i] = 0;
+
+		delete s;
+	}
+};
+
+inline std::uint32_t load32(const std::uint8_t *p)
+{
+	return std::uint32_t(p[0]) | (std::uint32_t(p[1]) << 8) | (std::uint32_t(p[2]) << 16) | (std::uint32_t(p[3]) << 24);
+}
+
+// Word of the keystream in the byte order of the stream (little endian)
+inline std::uint32_t to_le(std::uint32_t v)
+{
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+	return __builtin_bswap32(v);
+#else
+	return v;
+#endif
+}
+
+/*
+ * One step of the half P (or Q) at the position A + J.
+ * Update - setup step, otherwise the keystream word is returned.
+*/
+template <bool P, bool Update, unsigned J>
+inline std::uint32_t step(state &s, unsigned a)
+{
+	constexpr step_index i = steps[J];
+	std::uint32_t *t = P ? s.w : s.w + 512;
+	const std::uint32_t *o = P ? s.w + 512 : s.w;
+	std::uint32_t *xy = P ? s.x : s.y;
+	const unsigned u = a + J;
+	const unsigned v = (J == 15) ? ((a + 16) & 0x1FF) : (a + J + 1);
+	std::uint32_t g, h;
+
+	if constexpr(P)
+		g = (rotr(xy[i.e], 10) ^ rotr(t[v], 23)) + rotr(xy[i.d], 8);
+	else
+		g = (rotl(xy[i.e], 10) ^ rotl(t[v], 23)) + rotl(xy[i.d], 8);
+
+	h = o[xy[i.f] & 0xFF] + o[256 + ((xy[i.f] >> 16) & 0xFF)];
+
+	if constexpr(Update) {
+		t[u] = (t[u] + g) ^ h;
+		xy[i.c] = t[u];
+		return 0;
+	}
+	else {
+		t[u] += g;
+		xy[i.c] = t[u];
+		return to_le(h ^ t[u]);
+	}
+}
+
+// 16 steps of the half P (or Q), the keystream block goes to the sink
+template <bool P, typename Sink, std::size_t... J>
+inline void block(state &s, unsigned a, Sink &sink, std::index_sequence<J...>)
+{
+	std::uint32_t k[16];
+
+	((k[J] = step<P, false, J>(s, a)), ...);
+	sink.block(k);
+}
+
+template <bool P, std::size_t... J>
+inline void update(state &s, unsigned a, std::index_sequence<J...>)
+{
+	(step<P, true, J>(s, a), ...);
+}
+
+// 512 steps of the half P (or Q) with constant positions
+template <bool P, typename Sink, std::size_t... B>
+inline void half(state &s, Sink &sink, std::index_sequence<B...>)
+{
+	(block<P>(s, unsigned(B * 16), sink, std::make_index_sequence<16>{}), ...);
+}
+
+// Next block of the keystream at the position of the counter
+template <typename Sink>
+inline void next_block(state &s, Sink &sink)
+{
+	const unsigned a = s.counter & 0x1FF;
+
+	if(s.counter < 512)
+		block<true>(s, a, sink, std::make_index_sequence<16>{});
+	else
+		block<false>(s, a, sink, std::make_index_sequence<16>{});
+
+	s.counter = (s.counter + 16) & 0x3FF;
+}
+
+// Output sinks of the keystream blocks (64 bytes) and partial bytes
+
+struct xor_sink {
+	const std::uint8_t *in;
+	std::uint8_t *out;
+
+	void block(const std::uint32_t *k)
+	{
+		// Local pointers: the stores could alias the members
+		const std::uint8_t *src = in;
+		std::uint8_t *dst = out;
+		std::uint32_t v[16];
+
+		std::memcpy(v, src, 64);
+
+		for(int i = 0; i < 16; i++)
+			v[i] ^= k[i];
+
+		std::memcpy(dst, v, 64);
+
+		in = src + 64;
+		out = dst + 64;
+	}
+
+	void bytes(const std::uint8_t *k, std::size_t n)
+	{
+		for(std::size_t i = 0; i < n; i++)
+			out[i] = in[i] ^ k[i];
+
+		in += n;
+		out += n;
+	}
+};
+
+struct keystream_sink {
+	std::uint8_t *out;
+
+	void block(const std::uint32_t *k)
+	{
+		std::memcpy(out, k, 64);
+		out += 64;
+	}
+
+	void bytes(const std::uint8_t *k, std::size_t n)
+	{
+		std::memcpy(out, k, n);
+		out += n;
+	}
+};
+
+struct inplace_sink {
+	std::uint8_t *buf;
+
+	void block(const std::uint32_t *k)
+	{
+		std::uint8_t *p = buf;
+		std::uint32_t v[16];
+
+		std::memcpy(v, p, 64);
+
+		for(int i = 0; i < 16; i++)
+			v[i] ^= k[i];
+
+		std::memcpy(p, v, 64);
+
+		buf = p + 64;
+	}
+
+	void bytes(const std::uint8_t *k, std::size_t n)
+	{
+		for(std::size_t i = 0; i < n; i++)
+			buf[i] ^= k[i];
+
+		buf += n;
+	}
+};
+
+// Collects one block for the partial tail
+struct block_sink {
+	std::uint32_t k[16];
+
+	void block(const std::uint32_t *in) { std::memcpy(k, in, 64); }
+};
+
+} // namespace detail
+
+using detail::xor_sink;
+using detail::keystream_sink;
+using detail::inplace_sink;
+
+class stream {
+public:
+	// Key of keylen <= 16 bytes and iv of 0 < ivlen <= 16 bytes, as hc128_set_key_and_iv()
+	stream(const std::uint8_t *key, std::size_t keylen, const std::uint8_t *iv, std::size_t ivlen)
+		: s_(new detail::state)
+	{
+		setup(key, keylen, iv, ivlen);
+	}
+
+#if __cplusplus >= 202002L
+	stream(std::span<const std::uint8_t> key, std::span<const std::uint8_t> iv)
+		: stream(key.data(), key.size(), iv.data(), iv.size())
+	{
+	}
+#endif
+
+	stream(const stream &) = delete;
+	stream &operator=(const stream &) = delete;
+
+	stream(stream &&) noexcept = default;
+	stream &operator=(stream &&) noexcept = default;
+
+	// out = in ^ keystream
+	void crypt(const std::uint8_t *in, std::uint8_t *out, std::size_t len)
+	{
+		run(xor_sink{ in, out }, len);
+	}
+
+	// buf ^= keystream
+	void crypt(std::uint8_t *buf, std::size_t len)
+	{
+		run(inplace_sink{ buf }, len);
+	}
+
+	// out = keystream
+	void keystream(std::uint8_t *out, std::size_t len)
+	{
+		run(keystream_sink{ out }, len);
+	}
+
+#if __cplusplus >= 202002L
+	void crypt(std::span<const std::uint8_t> in, std::span<std::uint8_t> out)
+	{
+		if(out.size() < in.size())
+			throw std::length_error("hc128::stream: output is shorter than input");
+
+		crypt(in.data(), out.data(), in.size());
+	}
+
+	void crypt(std::span<std::uint8_t> buf) { crypt(buf.data(), buf.size()); }
+
+	void keystream(std::span<std::uint8_t> out) { keystream(out.data(), out.size()); }
+#endif
+
+	// Generic entry: any sink with block(const uint32_t *) and bytes(const uint8_t *, size_t)
+	template <typename Sink>
+	void run(Sink sink, std::size_t len)
+	{
+		detail::state &s = *s_;
+
+		if(s.remain) {
+			std::size_t n = (len < s.remain) ? len : s.remain;
+
+			sink.bytes(s.stream + 64 - s.remain, n);
+			s.remain -= std::uint32_t(n);
+			len -= n;
+		}
+
+		while(len >= 64) {
+			// Whole halves with constant positions
+			if(((s.counter & 0x1FF) == 0) && (len >= 2048)) {
+				if(s.counter == 0)
+					detail::half<true>(s, sink, std::make_index_sequence<32>{});
+				else
+					detail::half<false>(s, sink, std::make_index_sequence<32>{});
+
+				s.counter = (s.counter + 512) & 0x3FF;
+				len -= 2048;
+				continue;
+			}
+
+			detail::next_block(s, sink);
+			len -= 64;
+		}
+
+		if(len) {
+			detail::block_sink b;
+
+			detail::next_block(s, b);
+			sink.bytes(reinterpret_cast<const std::uint8_t *>(b.k), len);
+
+			std::memcpy(s.stream + len, reinterpret_cast<const std::uint8_t *>(b.k) + len, 64 - len);
+			s.remain = std::uint32_t(64 - len);
+		}
+	}
+
+private:
+	void setup(const std::uint8_t *key, std::size_t keylen, const std::uint8_t *iv, std::size_t ivlen)
+	{
+		detail::state &s = *s_;
+		std::uint8_t k[16] = {}, v[16] = {};
+
+		if((keylen > 16) || (ivlen == 0) || (ivlen > 16))
+			throw std::invalid_argument("hc128::stream: bad key or iv length");
+
+		std::memcpy(k, key, keylen);
+		std::memcpy(v, iv, ivlen);
+		std::memset(&s, 0, sizeof(s));
+
+		for(int i = 0; i < 8; i++) {
+			s.w[i] = detail::load32(k + (i * 4) % 16);
+			s.w[i + 8] = detail::load32(v + (i * 4) % 16);
+		}
+
+		for(std::uint32_t i = 16; i < 256 + 16; i++)
+			s.w[i] = detail::f2(s.w[i - 2]) + s.w[i - 7] + detail::f1(s.w[i - 15]) + s.w[i - 16] + i;
+
+		for(int i = 0; i < 16; i++)
+			s.w[i] = s.w[256 + i];
+
+		for(std::uint32_t i = 16; i < 1024; i++)
+			s.w[i] = detail::f2(s.w[i - 2]) + s.w[i - 7] + detail::f1(s.w[i - 15]) + s.w[i - 16] + 256 + i;
+
+		for(int i = 0; i < 16; i++) {
+			s.x[i] = s.w[496 + i];
+			s.y[i] = s.w[1008 + i];
+		}
+
+		for(unsigned a = 0; a < 512; a += 16)
+			detail::update<true>(s, a, std::make_index_sequence<16>{});
+
+		for(unsigned a = 0; a < 512; a += 16)
+			detail::update<false>(s, a, std::make_index_sequence<16>{});
+
+		std::memset(k, 0, sizeof(k));
+		std::memset(v, 0, sizeof(v));
+	}
+
+	std::unique_ptr<detail::state, detail::wipe_delete> s_;
+};
+
+} // namespace hc128
+
+#endif
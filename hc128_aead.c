@@ -0,0 +1,381 @@
+/*
+ * Authenticated encryption HC-128 + Poly1305 in one pass.
+ * The data goes in chunks of AEAD_CHUNK bytes: every chunk is encrypted
+ * by hc128_crypt() and authenticated at once, while it is still in L1.
+ * Poly1305 uses 44-bit limbs and 64x64->128 multiplication.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "hc128.h"
+#include "hc128_aead.h"
+
+#define AEAD_CHUNK	512
+
+// Contexts of the batch set up together
+#define AEAD_LANES	4
+
+typedef unsigned __int128 uint128_t;
+
+#define MASK44		0xfffffffffffULL
+#define MASK42		0x3ffffffffffULL
+
+static uint64_t
+load64_le(const uint8_t *p)
+{
+	return ((uint64_t)p[0]) | ((uint64_t)p[1] << 8) | ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24) |
+	       ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) | ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+}
+
+static void
+store64_le(uint8_t *p, uint64_t v)
+{
+	int i;
+
+	for(i = 0; i < 8; i++)
+		p[i] = (uint8_t)(v >> (8 * i));
+}
+
+void
+hc128_poly1305_init(struct hc128_poly1305 *st, const uint8_t key[32])
+{
+	uint64_t t0, t1;
+
+	// r &= 0xffffffc0ffffffc0ffffffc0fffffff
+	t0 = load64_le(key);
+	t1 = load64_le(key + 8);
+
+	st->r[0] = t0 & 0xffc0fffffffULL;
+	st->r[1] = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffffULL;
+	st->r[2] = (t1 >> 24) & 0x00ffffffc0fULL;
+
+	st->h[0] = 0;
+	st->h[1] = 0;
+	st->h[2] = 0;
+
+	st->pad[0] = load64_le(key + 16);
+	st->pad[1] = load64_le(key + 24);
+
+	st->leftover = 0;
+}
+
+// Full 16-byte blocks, hibit - 2^128 of the block (0 for the padded last one)
+static void
+poly1305_blocks(struct hc128_poly1305 *st, const uint8_t *m, size_t len, uint64_t hibit)
+{
+	uint64_t r0 = st->r[0], r1 = st->r[1], r2 = st->r[2];
+	uint64_t h0 = st->h[0], h1 = st->h[1], h2 = st->h[2];
+	uint64_t s1 = r1 * (5 << 2), s2 = r2 * (5 << 2);
+	uint64_t t0, t1, c;
+	uint128_t d0, d1, d2;
+
+	for(; len >= 16; len -= 16, m += 16) {
+		t0 = load64_le(m);
+		t1 = load64_le(m + 8);
+
+		h0 += t0 & MASK44;
+		h1 += ((t0 >> 44) | (t1 << 20)) & MASK44;
+		h2 += ((t1 >> 24) & MASK42) | hibit;
+
+		d0 = (uint128_t)h0 * r0 + (uint128_t)h1 * s2 + (uint128_t)h2 * s1;
+		d1 = (uint128_t)h0 * r1 + (uint128_t)h1 * r0 + (uint128_t)h2 * s2;
+		d2 = (uint128_t)h0 * r2 + (uint128_t)h1 * r1 + (uint128_t)h2 * r0;
+
+		c = (uint64_t)(d0 >> 44);
+		h0 = (uint64_t)d0 & MASK44;
+		d1 += c;
+		c = (uint64_t)(d1 >> 44);
+		h1 = (uint64_t)d1 & MASK44;
+		d2 += c;
+		c = (uint64_t)(d2 >> 42);
+		h2 = (uint64_t)d2 & MASK42;
+		h0 += c * 5;
+		c = h0 >> 44;
+		h0 &= MASK44;
+		h1 += c;
+	}
+
+	st->h[0] = h0;
+	st->h[1] = h1;
+	st->h[2] = h2;
+}
+
+void
+hc128_poly1305_update(struct hc128_poly1305 *st, const uint8_t *m, size_t len)
+{
+	size_t n;
+
+	if(st->leftover) {
+		n = 16 - st->leftover;
+		if(n > len)
+			n = len;
+
+		memcpy(st->buf + st->leftover, m, n);
+		st->leftover += n;
+		m += n;
+		len -= n;
+
+		if(st->leftover < 16)
+			return;
+
+		poly1305_blocks(st, st->buf, 16, 1ULL << 40);
+		st->leftover = 0;
+	}
+
+	if(len >= 16) {
+		n = len & ~(size_t)15;
+		poly1305_blocks(st, m, n, 1ULL << 40);
+		m += n;
+		len -= n;
+	}
+
+	if(len) {
+		memcpy(st->buf, m, len);
+		st->leftover = len;
+	}
+}
+
+void
+hc128_poly1305_finish(struct hc128_poly1305 *st, uint8_t mac[16])
+{
+	uint64_t h0, h1, h2, g0, g1, g2, c, t0, t1;
+
+	if(st->leftover) {
+		st->buf[st->leftover] = 1;
+		memset(st->buf + st->leftover + 1, 0, 16 - st->leftover - 1);
+		poly1305_blocks(st, st->buf, 16, 0);
+	}
+
+	h0 = st->h[0];
+	h1 = st->h[1];
+	h2 = st->h[2];
+
+	// Full carry
+	c = h1 >> 44; h1 &= MASK44;
+	h2 += c; c = h2 >> 42; h2 &= MASK42;
+	h0 += c * 5; c = h0 >> 44; h0 &= MASK44;
+	h1 += c; c = h1 >> 44; h1 &= MASK44;
+	h2 += c; c = h2 >> 42; h2 &= MASK42;
+	h0 += c * 5; c = h0 >> 44; h0 &= MASK44;
+	h1 += c;
+
+	// g = h - p
+	g0 = h0 + 5; c = g0 >> 44; g0 &= MASK44;
+	g1 = h1 + c; c = g1 >> 44; g1 &= MASK44;
+	g2 = h2 + c - (1ULL << 42);
+
+	// h if h < p, otherwise g
+	c = (g2 >> 63) - 1;
+	g0 &= c;
+	g1 &= c;
+	g2 &= c;
+	c = ~c;
+	h0 = (h0 & c) | g0;
+	h1 = (h1 & c) | g1;
+	h2 = (h2 & c) | g2;
+
+	// h + pad mod 2^128
+	t0 = st->pad[0];
+	t1 = st->pad[1];
+
+	h0 += t0 & MASK44; c = h0 >> 44; h0 &= MASK44;
+	h1 += (((t0 >> 44) | (t1 << 20)) & MASK44) + c; c = h1 >> 44; h1 &= MASK44;
+	h2 += ((t1 >> 24) & MASK42) + c; h2 &= MASK42;
+
+	store64_le(mac, h0 | (h1 << 44));
+	store64_le(mac + 8, (h1 >> 20) | (h2 << 24));
+
+	memset(st, 0, sizeof(*st));
+}
+
+// Zero padding up to 16 bytes
+static void
+aead_pad16(struct hc128_poly1305 *st, size_t len)
+{
+	static const uint8_t zero[16];
+
+	if(len & 15)
+		hc128_poly1305_update(st, zero, 16 - (len & 15));
+}
+
+// One-time key from the first keystream block, aad is authenticated
+static void
+aead_begin(struct hc128_context *ctx, struct hc128_poly1305 *st, const uint8_t *aad, size_t aadlen)
+{
+	uint8_t block[64];
+
+	hc128_keystream(ctx, block, sizeof(block));
+	hc128_poly1305_init(st, block);
+	memset(block, 0, sizeof(block));
+
+	hc128_poly1305_update(st, aad, aadlen);
+	aead_pad16(st, aadlen);
+}
+
+static void
+aead_end(struct hc128_poly1305 *st, size_t aadlen, size_t len, uint8_t tag[16])
+{
+	uint8_t lengths[16];
+
+	aead_pad16(st, len);
+	store64_le(lengths, aadlen);
+	store64_le(lengths + 8, len);
+	hc128_poly1305_update(st, lengths, sizeof(lengths));
+	hc128_poly1305_finish(st, tag);
+}
+
+// Encrypt and authenticate the ciphertext chunk by chunk
+static void
+aead_seal_ctx(struct hc128_context *ctx, const uint8_t *aad, size_t aadlen,
+	      const uint8_t *in, size_t len, uint8_t *out, uint8_t *tag)
+{
+	struct hc128_poly1305 st;
+	size_t offset, n;
+
+	aead_begin(ctx, &st, aad, aadlen);
+
+	for(offset = 0; offset < len; offset += n) {
+		n = (len - offset < AEAD_CHUNK) ? len - offset : AEAD_CHUNK;
+
+		hc128_crypt(ctx, in + offset, n, out + offset);
+		hc128_poly1305_update(&st, out + offset, n);
+	}
+
+	aead_end(&st, aadlen, len, tag);
+}
+
+// Authenticate the ciphertext chunk and decrypt it
+// Return value: 0 (if all is well), -1 if the tag is wrong (out is wiped)
+static int
+aead_open_ctx(struct hc128_context *ctx, const uint8_t *aad, size_t aadlen,
+	      const uint8_t *in, size_t len, uint8_t *out, const uint8_t *tag)
+{
+	struct hc128_poly1305 st;
+	uint8_t mac[16], diff = 0;
+	size_t offset, n;
+	int i;
+
+	aead_begin(ctx, &st, aad, aadlen);
+
+	for(offset = 0; offset < len; offset += n) {
+		n = (len - offset < AEAD_CHUNK) ? len - offset : AEAD_CHUNK;
+
+		hc128_poly1305_update(&st, in + offset, n);
+		hc128_crypt(ctx, in + offset, n, out + offset);
+	}
+
+	aead_end(&st, aadlen, len, mac);
+
+	// Constant time comparison
+	for(i = 0; i < 16; i++)
+		diff |= mac[i] ^ tag[i];
+
+	if(diff) {
+		memset(out, 0, len);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Encrypt len bytes and compute the tag of aad and ciphertext.
+ * Return value: 0 (if all is well), -1 id all bad
+*/
+int
+hc128_aead_seal(const uint8_t key[16], const uint8_t iv[16], const uint8_t *aad, size_t aadlen,
+		const uint8_t *in, size_t len, uint8_t *out, uint8_t tag[HC128_AEAD_TAGLEN])
+{
+	struct hc128_context ctx;
+
+	if(hc128_set_key_and_iv(&ctx, key, 16, iv, 16))
+		return -1;
+
+	aead_seal_ctx(&ctx, aad, aadlen, in, len, out, tag);
+	memset(&ctx, 0, sizeof(ctx));
+
+	return 0;
+}
+
+/*
+ * Check the tag and decrypt len bytes.
+ * Return value: 0 (if all is well), -1 if the tag is wrong
+*/
+int
+hc128_aead_open(const uint8_t key[16], const uint8_t iv[16], const uint8_t *aad, size_t aadlen,
+		const uint8_t *in, size_t len, uint8_t *out, const uint8_t tag[HC128_AEAD_TAGLEN])
+{
+	struct hc128_context ctx;
+	int res;
+
+	if(hc128_set_key_and_iv(&ctx, key, 16, iv, 16))
+		return -1;
+
+	res = aead_open_ctx(&ctx, aad, aadlen, in, len, out, tag);
+	memset(&ctx, 0, sizeof(ctx));
+
+	return res;
+}
+
+// Batch of records under one key, AEAD_LANES contexts are set up together
+static int
+aead_batch(const uint8_t key[16], struct hc128_aead_record *rec, int n, int open)
+{
+	struct hc128_context ctx[AEAD_LANES], *pctx[AEAD_LANES];
+	uint8_t iv[AEAD_LANES][16];
+	int i, j, m, res = 0;
+
+	for(j = 0; j < AEAD_LANES; j++)
+		pctx[j] = &ctx[j];
+
+	for(i = 0; i < n; i += m) {
+		m = (n - i < AEAD_LANES) ? n - i : AEAD_LANES;
+
+		for(j = 0; j < m; j++)
+			memcpy(iv[j], rec[i + j].iv, 16);
+
+		if(hc128_set_key_and_iv_multi(pctx, m, key, 16, iv, 16))
+			return -1;
+
+		for(j = 0; j < m; j++) {
+			struct hc128_aead_record *r = &rec[i + j];
+
+			if(open) {
+				r->status = aead_open_ctx(pctx[j], r->aad, r->aadlen, r->in, r->len, r->out, r->tag);
+				if(r->status)
+					res = -1;
+			}
+			else {
+				aead_seal_ctx(pctx[j], r->aad, r->aadlen, r->in, r->len, r->out, r->tag);
+				r->status = 0;
+			}
+		}
+	}
+
+	memset(ctx, 0, sizeof(ctx));
+
+	return res;
+}
+
+/*
+ * Seal n records under one key.
+ * Return value: 0 (if all is well), -1 id all bad
+*/
+int
+hc128_aead_seal_batch(const uint8_t key[16], struct hc128_aead_record *rec, int n)
+{
+	return aead_batch(key, rec, n, 0);
+}
+
+/*
+ * Open n records under one key, status of every record is set.
+ * Return value: 0 (if all is well), -1 if any tag is wrong
+*/
+int
+hc128_aead_open_batch(const uint8_t key[16], struct hc128_aead_record *rec, int n)
+{
+	return aead_batch(key, rec, n, 1);
+}
@@ -0,0 +1,74 @@
+/*
+ * Authenticated encryption HC-128 + Poly1305.
+ * The context is set up with the key and iv (nonce, unique for the key).
+ * Bytes 0..31 of the first keystream block are the Poly1305 one-time key,
+ * bytes 32..63 are dropped, the data is encrypted from byte 64 on.
+ * The tag is Poly1305 of aad | pad16 | ciphertext | pad16 | aadlen | len
+ * (lengths as 64-bit little endian), the layout of RFC 8439.
+*/
+
+#ifndef HC128_AEAD_H
+#define HC128_AEAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HC128_AEAD_TAGLEN	16
+
+/*
+ * Poly1305 state
+ * r - clamped key in 44-bit limbs
+ * h - accumulator in 44-bit limbs
+ * pad - second half of the key
+ * buf, leftover - bytes of an unfinished 16-byte block
+*/
+struct hc128_poly1305 {
+	uint64_t r[3];
+	uint64_t h[3];
+	uint64_t pad[2];
+	uint8_t buf[16];
+	size_t leftover;
+};
+
+/*
+ * Record of the batch
+ * iv - 16-byte iv of the record
+ * tag - output of seal, input of open
+ * status - open: 0 (if all is well), -1 if the tag is wrong
+*/
+struct hc128_aead_record {
+	const uint8_t *iv;
+	const uint8_t *aad;
+	size_t aadlen;
+	const uint8_t *in;
+	size_t len;
+	uint8_t *out;
+	uint8_t *tag;
+	int status;
+};
+
+void hc128_poly1305_init(struct hc128_poly1305 *st, const uint8_t key[32]);
+
+void hc128_poly1305_update(struct hc128_poly1305 *st, const uint8_t *m, size_t len);
+
+void hc128_poly1305_finish(struct hc128_poly1305 *st, uint8_t mac[16]);
+
+int hc128_aead_seal(const uint8_t key[16], const uint8_t iv[16], const uint8_t *aad, size_t aadlen,
+		    const uint8_t *in, size_t len, uint8_t *out, uint8_t tag[HC128_AEAD_TAGLEN]);
+
+int hc128_aead_open(const uint8_t key[16], const uint8_t iv[16], const uint8_t *aad, size_t aadlen,
+		    const uint8_t *in, size_t len, uint8_t *out, const uint8_t tag[HC128_AEAD_TAGLEN]);
+
+int hc128_aead_seal_batch(const uint8_t key[16], struct hc128_aead_record *rec, int n);
+
+int hc128_aead_open_batch(const uint8_t key[16], struct hc128_aead_record *rec, int n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
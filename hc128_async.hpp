@@ -0,0 +1,331 @@
+/*
+ * C++20 coroutine API over hc128::stream (hc128.hpp).
+ *
+ *	hc128::executor pool(4);
+ *	hc128::async_stream s(pool, key, 16, iv, 16);
+ *	auto st = co_await hc128::encrypt_async(s, in, out);
+ *
+ * Small buffers (up to inline_limit bytes) on an idle stream complete
+ * inline, the coroutine is not suspended. Large buffers are handed to the
+ * worker pool, the coroutine is resumed on the worker thread.
+ * Operations of one stream run one at a time in the order of co_await,
+ * the stream state is never shared between threads concurrently.
+ * Backpressure: the pool queue is bounded, when it is full the operation
+ * runs on the calling thread, which slows the producer down.
+ * Cancellation: a std::stop_token requested before the operation starts
+ * completes it with status::cancelled and the stream position unchanged.
+*/
+
+#ifndef HC128_ASYNC_HPP
+#define HC128_ASYNC_HPP
+
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+#include "hc128.hpp"
+
+namespace hc128 {
+
+enum class status {
+	ok,
+	cancelled
+};
+
+namespace detail {
+
+// Intrusive task of the pool, no allocation per operation
+struct task {
+	void (*run)(task *);
+	task *next = nullptr;
+};
+
+} // namespace detail
+
+class executor {
+public:
+	explicit executor(unsigned threads = std::thread::hardware_concurrency(), std::size_t capacity = 1024)
+		: capacity_(capacity)
+	{
+		if(threads == 0)
+			threads = 1;
+
+		for(unsigned i = 0; i < threads; i++)
+			workers_.emplace_back([this] { work(); });
+	}
+
+	executor(const executor &) = delete;
+	executor &operator=(const executor &) = delete;
+
+	~executor()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stop_ = true;
+		}
+
+		cond_.notify_all();
+
+		for(auto &t : workers_)
+			t.join();
+	}
+
+	// false - the queue is full, the caller has to run the task itself
+	bool try_post(detail::task *t)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+
+			if(size_ >= capacity_)
+				return false;
+
+			t->next = nullptr;
+
+			if(tail_)
+				tail_->next = t;
+			else
+				head_ = t;
+
+			tail_ = t;
+			size_++;
+		}
+
+		cond_.notify_one();
+
+		return true;
+	}
+
+private:
+	void work()
+	{
+		for(;;) {
+			detail::task *t;
+
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+
+				cond_.wait(lock, [this] { return stop_ || head_; });
+
+				if(!head_)
+					return;
+
+				t = head_;
+				head_ = t->next;
+				if(!head_)
+					tail_ = nullptr;
+				size_--;
+			}
+
+			t->run(t);
+		}
+	}
+
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	detail::task *head_ = nullptr;
+	detail::task *tail_ = nullptr;
+	std::size_t size_ = 0;
+	std::size_t capacity_;
+	bool stop_ = false;
+	std::vector<std::thread> workers_;
+};
+
+class async_stream;
+
+namespace detail {
+
+// Operation of the stream, lives in the coroutine frame
+struct operation : task {
+	async_stream *owner;
+	const std::uint8_t *in;
+	std::uint8_t *out;
+	std::size_t len;
+	std::stop_token stop;
+	std::coroutine_handle<> handle;
+	status result = status::ok;
+};
+
+} // namespace detail
+
+class async_stream {
+public:
+	static constexpr std::size_t default_inline_limit = 4096;
+
+	async_stream(executor &pool, const std::uint8_t *key, std::size_t keylen, const std::uint8_t *iv, std::size_t ivlen,
+		     std::size_t inline_limit = default_inline_limit)
+		: pool_(pool), stream_(key, keylen, iv, ivlen), inline_limit_(inline_limit)
+	{
+	}
+
+	async_stream(const async_stream &) = delete;
+	async_stream &operator=(const async_stream &) = delete;
+
+	std::size_t inline_limit() const { return inline_limit_; }
+
+private:
+	friend struct encrypt_awaitable;
+
+	// Inline completion: only if the stream is idle
+	bool try_acquire()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		if(busy_ || head_)
+			return false;
+
+		busy_ = true;
+
+		return true;
+	}
+
+	// true - the operation was queued, false - it has to complete on the caller
+	bool submit(detail::operation *op)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+
+			op->next = nullptr;
+
+			if(busy_) {
+				if(tail_)
+					tail_->next = op;
+				else
+					head_ = op;
+
+				tail_ = op;
+				return true;
+			}
+
+			busy_ = true;
+		}
+
+		if(pool_.try_post(op))
+			return true;
+
+		// The pool is full: run here, resume without suspension
+		execute(op);
+		release();
+
+		return false;
+	}
+
+	void execute(detail::operation *op)
+	{
+		if(op->stop.stop_requested())
+			op->result = status::cancelled;
+		else
+			stream_.crypt(op->in, op->out, op->len);
+	}
+
+	// The stream is free: start the next queued operation
+	void release()
+	{
+		detail::operation *next;
+
+		for(;;) {
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+
+				next = static_cast<detail::operation *>(head_);
+
+				if(!next) {
+					busy_ = false;
+					return;
+				}
+
+				head_ = next->next;
+				if(!head_)
+					tail_ = nullptr;
+			}
+
+			if(pool_.try_post(next))
+				return;
+
+			execute(next);
+			next->handle.resume();
+		}
+	}
+
+	static void run(detail::task *t)
+	{
+		auto *op = static_cast<detail::operation *>(t);
+		async_stream *self = op->owner;
+
+		self->execute(op);
+		self->release();
+		op->handle.resume();
+	}
+
+	executor &pool_;
+	stream stream_;
+	std::size_t inline_limit_;
+
+	std::mutex mutex_;
+	bool busy_ = false;
+	detail::task *head_ = nullptr;
+	detail::task *tail_ = nullptr;
+};
+
+struct encrypt_awaitable {
+	async_stream &s;
+	detail::operation op;
+
+	encrypt_awaitable(async_stream &stream, const std::uint8_t *in, std::uint8_t *out, std::size_t len, std::stop_token stop)
+		: s(stream)
+	{
+		op.run = &async_stream::run;
+		op.owner = &stream;
+		op.in = in;
+		op.out = out;
+		op.len = len;
+		op.stop = std::move(stop);
+	}
+
+	bool await_ready()
+	{
+		if((op.len > s.inline_limit_) || !s.try_acquire())
+			return false;
+
+		s.execute(&op);
+		s.release();
+
+		return true;
+	}
+
+	bool await_suspend(std::coroutine_handle<> h)
+	{
+		op.handle = h;
+
+		return s.submit(&op);
+	}
+
+	status await_resume() const { return op.result; }
+};
+
+// out = in ^ keystream of the stream, throws std::length_error if out is shorter than in
+inline encrypt_awaitable
+encrypt_async(async_stream &s, std::span<const std::uint8_t> in, std::span<std::uint8_t> out, std::stop_token stop = {})
+{
+	if(out.size() < in.size())
+		throw std::length_error("hc128::async_stream: output is shorter than input");
+
+	return encrypt_awaitable(s, in.data(), out.data(), in.size(), std::move(stop));
+}
+
+// Decryption is the same operation
+inline encrypt_awaitable
+decrypt_async(async_stream &s, std::span<const std::uint8_t> in, std::span<std::uint8_t> out, std::stop_token stop = {})
+{
+	return encrypt_async(s, in, out, std::move(stop));
+}
+
+} // namespace hc128
+
+#endif
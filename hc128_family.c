@@ -0,0 +1,184 @@
+/*
+ * Families of reproducible HC-128 random streams.
+ * The fill functions advance up to FAMILY_LANES streams together with
+ * hc128_keystream_multi(). Numbers are taken from the keystream in order:
+ * 4 bytes for uint32_t, 8 bytes for uint64_t and double (little endian).
+ * Double in [0, 1) gets the 52 high bits of the number as the mantissa
+ * of [1, 2) minus 1.0, the conversion has no branches and vectorizes.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "hc128.h"
+#include "hc128_family.h"
+
+// Streams advanced together
+#define FAMILY_LANES	8
+
+// Doubles converted per stream at once
+#define FAMILY_CHUNK	256
+
+// Number of blocks of one hc128_keystream_multi() call
+#define FAMILY_BLOCKS	(1 << 20)
+
+static const uint8_t family_iv[16] = "HC-128 family iv";
+
+// Family of the master seed
+void
+hc128_family_init(struct hc128_family *family, uint64_t seed)
+{
+	struct hc128_context ctx;
+	uint8_t key[16];
+	int i;
+
+	memset(key, 0, sizeof(key));
+
+	for(i = 0; i < 8; i++)
+		key[i] = (uint8_t)(seed >> (8 * i));
+
+	hc128_set_key_and_iv(&ctx, key, 16, family_iv, 16);
+	hc128_keystream(&ctx, family->key, 16);
+	hc128_keystream(&ctx, family->iv, 16);
+
+	memset(&ctx, 0, sizeof(ctx));
+}
+
+// Iv of the stream: index xored into iv[0..7] of the family
+static void
+family_stream_iv(const struct hc128_family *family, uint64_t index, uint8_t iv[16])
+{
+	int i;
+
+	memcpy(iv, family->iv, 16);
+
+	for(i = 0; i < 8; i++)
+		iv[i] ^= (uint8_t)(index >> (8 * i));
+}
+
+// Stream index of the family
+// Return value: 0 (if all is well), -1 id all bad
+int
+hc128_family_stream(const struct hc128_family *family, uint64_t index, struct hc128_context *ctx)
+{
+	uint8_t iv[16];
+
+	family_stream_iv(family, index, iv);
+
+	return hc128_set_key_and_iv(ctx, family->key, 16, iv, 16);
+}
+
+// Streams first ... first + n - 1 of the family with the batched key setup
+// Return value: 0 (if all is well), -1 id all bad
+int
+hc128_family_streams(const struct hc128_family *family, uint64_t first, struct hc128_context **ctx, int n)
+{
+	uint8_t iv[FAMILY_LANES][16];
+	int i, j, m;
+
+	for(i = 0; i < n; i += m) {
+		m = (n - i < FAMILY_LANES) ? n - i : FAMILY_LANES;
+
+		for(j = 0; j < m; j++)
+			family_stream_iv(family, first + i + j, iv[j]);
+
+		if(hc128_set_key_and_iv_multi(ctx + i, m, family->key, 16, iv, 16))
+			return -1;
+	}
+
+	return 0;
+}
+
+// len bytes of the keystream into each of n <= FAMILY_LANES outputs
+static void
+family_keystream(struct hc128_context **ctx, int n, uint8_t **out, size_t len)
+{
+	uint8_t *p[FAMILY_LANES];
+	size_t offset = 0, blocks;
+	int j;
+
+	while(len - offset >= 64) {
+		blocks = (len - offset) / 64;
+		if(blocks > FAMILY_BLOCKS)
+			blocks = FAMILY_BLOCKS;
+
+		for(j = 0; j < n; j++)
+			p[j] = out[j] + offset;
+
+		hc128_keystream_multi(ctx, n, p, blocks);
+		offset += blocks * 64;
+	}
+
+	if(offset < len) {
+		for(j = 0; j < n; j++)
+			hc128_keystream(ctx[j], out[j] + offset, len - offset);
+	}
+}
+
+// Fill n arrays of len numbers of size bytes
+static void
+family_fill(struct hc128_context **ctx, int n, void **dst, size_t len, size_t size)
+{
+	int i, m;
+
+	for(i = 0; i < n; i += m) {
+		m = (n - i < FAMILY_LANES) ? n - i : FAMILY_LANES;
+		family_keystream(ctx + i, m, (uint8_t **)(dst + i), len * size);
+	}
+}
+
+void
+hc128_fill_u32(struct hc128_context **ctx, int n, uint32_t **dst, size_t len)
+{
+	family_fill(ctx, n, (void **)dst, len, sizeof(uint32_t));
+}
+
+void
+hc128_fill_u64(struct hc128_context **ctx, int n, uint64_t **dst, size_t len)
+{
+	family_fill(ctx, n, (void **)dst, len, sizeof(uint64_t));
+}
+
+// Numbers to doubles in [0, 1)
+static void
+family_to_double(const uint64_t *bits, double *dst, size_t len)
+{
+	uint64_t v;
+	double d;
+	size_t i;
+
+	for(i = 0; i < len; i++) {
+		v = (bits[i] >> 12) | 0x3FF0000000000000ULL;
+		memcpy(&d, &v, sizeof(d));
+		dst[i] = d - 1.0;
+	}
+}
+
+void
+hc128_fill_double(struct hc128_context **ctx, int n, double **dst, size_t len)
+{
+	uint64_t bits[FAMILY_LANES][FAMILY_CHUNK];
+	uint8_t *p[FAMILY_LANES];
+	size_t offset, m;
+	int i, j, lanes;
+
+	for(j = 0; j < FAMILY_LANES; j++)
+		p[j] = (uint8_t *)bits[j];
+
+	for(i = 0; i < n; i += lanes) {
+		lanes = (n - i < FAMILY_LANES) ? n - i : FAMILY_LANES;
+
+		for(offset = 0; offset < len; offset += m) {
+			m = (len - offset < FAMILY_CHUNK) ? len - offset : FAMILY_CHUNK;
+
+			family_keystream(ctx + i, lanes, p, m * sizeof(uint64_t));
+
+			for(j = 0; j < lanes; j++)
+				family_to_double(bits[j], dst[i + j] + offset, m);
+		}
+	}
+
+	memset(bits, 0, sizeof(bits));
+}
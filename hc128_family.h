@@ -0,0 +1,38 @@
+/*
+ * Families of reproducible HC-128 random streams.
+ * Key of the family is derived from the master seed, stream i uses
+ * the iv of the family with i mixed in. The same seed and index always
+ * give the same sequence, independently of batching and threads.
+*/
+
+#ifndef HC128_FAMILY_H
+#define HC128_FAMILY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Family of the streams
+ * key - key of all streams
+ * iv - base iv of the streams
+*/
+struct hc128_family {
+	uint8_t key[16];
+	uint8_t iv[16];
+};
+
+struct hc128_context;
+
+void hc128_family_init(struct hc128_family *family, uint64_t seed);
+
+int hc128_family_stream(const struct hc128_family *family, uint64_t index, struct hc128_context *ctx);
+
+int hc128_family_streams(const struct hc128_family *family, uint64_t first, struct hc128_context **ctx, int n);
+
+void hc128_fill_u32(struct hc128_context **ctx, int n, uint32_t **dst, size_t len);
+
+void hc128_fill_u64(struct hc128_context **ctx, int n, uint64_t **dst, size_t len);
+
+void hc128_fill_double(struct hc128_context **ctx, int n, double **dst, size_t len);
+
+#endif
@@ -0,0 +1,690 @@
+/*
+ * Encrypted append-only log: group commit writer and checkpointed reader.
+ * Appenders copy the records into the active buffer, the committer swaps
+ * it with the spare one, encrypts it behind the ciphertext of the last
+ * partial 4 KB block and writes the result from the aligned file offset.
+ * The partial block is written again by the next commit.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "hc128.h"
+#include "hc128_log.h"
+
+#define LOG_MAGIC	"HC128LOG"
+#define LOG_VERSION	1
+
+// Entry of the index: file offset and first record of the segment
+#define INDEX_ENTRY	16
+
+/*
+ * Writer
+ * active, active_len - records collected for the next commit
+ * spare - buffer of the commit in progress
+ * wbuf, tail_len - ciphertext from file_off, tail_len bytes of a partial block
+ * appended - records appended, durable - records written (and synced)
+ * segment_bytes - bytes of the current segment
+*/
+struct hc128_log {
+	int fd;
+	int idx_fd;
+	int options;
+	uint8_t key[16];
+	uint8_t iv[16];
+	struct hc128_context ctx;
+	uint64_t checkpoint;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t work;
+	pthread_cond_t done;
+	pthread_t committer;
+
+	uint8_t *active;
+	uint32_t active_len;
+	uint8_t *spare;
+	uint8_t *wbuf;
+	uint32_t tail_len;
+	uint64_t file_off;
+
+	uint64_t segment;
+	uint64_t segment_bytes;
+	uint64_t appended;
+	uint64_t durable;
+	int stop;
+	int error;
+
+	struct hc128_log_stats stats;
+};
+
+/*
+ * Reader
+ * index, entries - segments of the log
+ * buf, pos, len - decrypted bytes, pos - first unused
+ * off - file offset of the next read
+ * next_off - file offset of the next segment
+*/
+struct hc128_log_reader {
+	int fd;
+	uint8_t key[16];
+	uint8_t iv[16];
+	struct hc128_context ctx;
+	uint64_t *index;
+	uint64_t entries;
+	uint64_t segment;
+	uint64_t off;
+	uint64_t next_off;
+	uint64_t end;
+	uint64_t record;
+	uint8_t *buf;
+	uint32_t pos;
+	uint32_t len;
+};
+
+static void
+store32_le(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static uint32_t
+load32_le(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void
+store64_le(uint8_t *p, uint64_t v)
+{
+	store32_le(p, (uint32_t)v);
+	store32_le(p + 4, (uint32_t)(v >> 32));
+}
+
+static uint64_t
+load64_le(const uint8_t *p)
+{
+	return (uint64_t)load32_le(p) | ((uint64_t)load32_le(p + 4) << 32);
+}
+
+// Context of the segment: iv of the log with the segment number in bytes 0..7
+static int
+segment_setup(struct hc128_context *ctx, const uint8_t *key, const uint8_t *iv, uint64_t segment)
+{
+	uint8_t seg_iv[16];
+	int i, res;
+
+	memcpy(seg_iv, iv, 16);
+
+	for(i = 0; i < 8; i++)
+		seg_iv[i] ^= (uint8_t)(segment >> (8 * i));
+
+	res = hc128_set_key_and_iv(ctx, key, 16, seg_iv, 16);
+	memset(seg_iv, 0, sizeof(seg_iv));
+
+	return res;
+}
+
+static int
+write_all(int fd, const uint8_t *buf, size_t len, uint64_t off)
+{
+	ssize_t n;
+
+	while(len) {
+		n = pwrite(fd, buf, len, off);
+
+		if(n < 0) {
+			if(errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		buf += n;
+		len -= n;
+		off += n;
+	}
+
+	return 0;
+}
+
+static char *
+index_path(const char *path)
+{
+	char *p = malloc(strlen(path) + 5);
+
+	if(p)
+		sprintf(p, "%s.idx", path);
+
+	return p;
+}
+
+// Start the segment at the file offset off with the record first
+static int
+log_checkpoint(struct hc128_log *log, uint64_t off, uint64_t first)
+{
+	uint8_t entry[INDEX_ENTRY];
+
+	if(segment_setup(&log->ctx, log->key, log->iv, log->segment))
+		return -1;
+
+	store64_le(entry, off);
+	store64_le(entry + 8, first);
+
+	if(write_all(log->idx_fd, entry, sizeof(entry), log->segment * INDEX_ENTRY))
+		return -1;
+
+	if((log->options & HC128_LOG_SYNC) && fdatasync(log->idx_fd))
+		return -1;
+
+	log->segment_bytes = 0;
+
+	return 0;
+}
+
+// Encrypt and write the batch of len bytes, its first record is first
+// The checkpoints and syncs done are added to *checkpoints and *syncs
+static int
+log_commit(struct hc128_log *log, const uint8_t *batch, uint32_t len, uint64_t first, uint64_t *checkpoints,
+	   uint64_t *syncs)
+{
+	uint32_t total, aligned;
+
+	if(log->segment_bytes >= log->checkpoint) {
+		log->segment++;
+
+		if(log_checkpoint(log, log->file_off + log->tail_len, first))
+			return -1;
+
+		(*checkpoints)++;
+	}
+
+	hc128_crypt(&log->ctx, batch, len, log->wbuf + log->tail_len);
+
+	total = log->tail_len + len;
+
+	if(write_all(log->fd, log->wbuf, total, log->file_off))
+		return -1;
+
+	if(log->options & HC128_LOG_SYNC) {
+		if(fdatasync(log->fd))
+			return -1;
+
+		(*syncs)++;
+	}
+
+	// The partial block stays in front of the buffer
+	aligned = total & ~(HC128_LOG_BLOCK - 1);
+	log->tail_len = total - aligned;
+	memmove(log->wbuf, log->wbuf + aligned, log->tail_len);
+	log->file_off += aligned;
+	log->segment_bytes += len;
+
+	return 0;
+}
+
+static void *
+log_committer(void *arg)
+{
+	struct hc128_log *log = arg;
+	uint8_t *batch;
+	uint32_t len;
+	uint64_t first, last, checkpoints, syncs;
+	int res;
+
+	pthread_mutex_lock(&log->mutex);
+
+	for(;;) {
+		while(!log->active_len && !log->stop)
+			pthread_cond_wait(&log->work, &log->mutex);
+
+		if(!log->active_len)
+			break;
+
+		batch = log->active;
+		len = log->active_len;
+		first = log->durable;
+		last = log->appended;
+
+		log->active = log->spare;
+		log->active_len = 0;
+		log->spare = batch;
+
+		// Appenders waiting for space can fill the other buffer now
+		pthread_cond_broadcast(&log->done);
+		pthread_mutex_unlock(&log->mutex);
+
+		// The stats are read under the mutex, the commit counts in locals
+		checkpoints = 0;
+		syncs = 0;
+		res = log->error ? -1 : log_commit(log, batch, len, first, &checkpoints, &syncs);
+
+		pthread_mutex_lock(&log->mutex);
+
+		if(res)
+			log->error = 1;
+
+		log->durable = last;
+		log->stats.commits++;
+		log->stats.checkpoints += checkpoints;
+		log->stats.syncs += syncs;
+		pthread_cond_broadcast(&log->done);
+	}
+
+	pthread_mutex_unlock(&log->mutex);
+
+	return NULL;
+}
+
+/*
+ * Create the log (an existing one is truncated) and its index.
+ * path - path of the log, the index is <path>.idx
+ * key - 16-byte key, iv - 16-byte iv of the log, never reused with the key
+ * checkpoint - bytes between the checkpoints (0 - HC128_LOG_CHECKPOINT)
+ * options - HC128_LOG_SYNC: fdatasync() after every commit
+ * Return value: pointer on the log, NULL if all bad
+*/
+struct hc128_log *
+hc128_log_open(const char *path, const uint8_t key[16], const uint8_t iv[16], uint64_t checkpoint, int options)
+{
+	struct hc128_log *log;
+	uint8_t *header;
+	char *idx;
+
+	log = calloc(1, sizeof(*log));
+	idx = index_path(path);
+
+	if(!log || !idx)
+		goto fail_alloc;
+
+	log->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	log->idx_fd = open(idx, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+	if((log->fd < 0) || (log->idx_fd < 0))
+		goto fail_open;
+
+	if(posix_memalign((void **)&log->active, HC128_LOG_BLOCK, HC128_LOG_BUFLEN) ||
+	   posix_memalign((void **)&log->spare, HC128_LOG_BLOCK, HC128_LOG_BUFLEN) ||
+	   posix_memalign((void **)&log->wbuf, HC128_LOG_BLOCK, HC128_LOG_BUFLEN + HC128_LOG_BLOCK))
+		goto fail_open;
+
+	memcpy(log->key, key, 16);
+	memcpy(log->iv, iv, 16);
+	log->checkpoint = checkpoint ? checkpoint : HC128_LOG_CHECKPOINT;
+	log->options = options;
+	log->file_off = HC128_LOG_BLOCK;
+
+	header = log->wbuf;
+	memset(header, 0, HC128_LOG_BLOCK);
+	memcpy(header, LOG_MAGIC, 8);
+	store32_le(header + 8, LOG_VERSION);
+	memcpy(header + 16, iv, 16);
+
+	if(write_all(log->fd, header, HC128_LOG_BLOCK, 0) || log_checkpoint(log, HC128_LOG_BLOCK, 0))
+		goto fail_open;
+
+	log->stats.checkpoints = 1;
+
+	pthread_mutex_init(&log->mutex, NULL);
+	pthread_cond_init(&log->work, NULL);
+	pthread_cond_init(&log->done, NULL);
+
+	if(pthread_create(&log->committer, NULL, log_committer, log))
+		goto fail_open;
+
+	free(idx);
+
+	return log;
+
+fail_open:
+	if(log->fd >= 0)
+		close(log->fd);
+	if(log->idx_fd >= 0)
+		close(log->idx_fd);
+	free(log->active);
+	free(log->spare);
+	free(log->wbuf);
+	memset(log, 0, sizeof(*log));
+
+fail_alloc:
+	free(log);
+	free(idx);
+
+	return NULL;
+}
+
+/*
+ * Append the record, it is written by one of the next commits.
+ * Return value: number of the record, -1 if the record is too long or
+ * the log has failed
+*/
+int64_t
+hc128_log_append(struct hc128_log *log, const void *rec, uint32_t len)
+{
+	int64_t record;
+
+	if(len > HC128_LOG_BUFLEN - 4)
+		return -1;
+
+	pthread_mutex_lock(&log->mutex);
+
+	while(!log->error && (log->active_len + 4 + len > HC128_LOG_BUFLEN))
+		pthread_cond_wait(&log->done, &log->mutex);
+
+	if(log->error) {
+		pthread_mutex_unlock(&log->mutex);
+		return -1;
+	}
+
+	store32_le(log->active + log->active_len, len);
+	memcpy(log->active + log->active_len + 4, rec, len);
+
+	if(!log->active_len)
+		pthread_cond_signal(&log->work);
+
+	log->active_len += 4 + len;
+	record = log->appended++;
+
+	log->stats.records++;
+	log->stats.bytes += 4 + len;
+
+	pthread_mutex_unlock(&log->mutex);
+
+	return record;
+}
+
+/*
+ * Wait until the record is written (and synced with HC128_LOG_SYNC).
+ * Return value: 0 (if all is well), -1 id all bad
+*/
+int
+hc128_log_sync(struct hc128_log *log, uint64_t record)
+{
+	int res;
+
+	pthread_mutex_lock(&log->mutex);
+
+	while(!log->error && (log->durable <= record))
+		pthread_cond_wait(&log->done, &log->mutex);
+
+	res = log->error ? -1 : 0;
+
+	pthread_mutex_unlock(&log->mutex);
+
+	return res;
+}
+
+void
+hc128_log_stats(struct hc128_log *log, struct hc128_log_stats *stats)
+{
+	pthread_mutex_lock(&log->mutex);
+	*stats = log->stats;
+	pthread_mutex_unlock(&log->mutex);
+}
+
+/*
+ * Write the rest of the records and close the log.
+ * Return value: 0 (if all is well), -1 id all bad
+*/
+int
+hc128_log_close(struct hc128_log *log)
+{
+	int res;
+
+	pthread_mutex_lock(&log->mutex);
+	log->stop = 1;
+	pthread_cond_signal(&log->work);
+	pthread_mutex_unlock(&log->mutex);
+
+	pthread_join(log->committer, NULL);
+
+	res = log->error ? -1 : 0;
+
+	if(close(log->fd) || close(log->idx_fd))
+		res = -1;
+
+	pthread_mutex_destroy(&log->mutex);
+	pthread_cond_destroy(&log->work);
+	pthread_cond_destroy(&log->done);
+
+	free(log->active);
+	free(log->spare);
+	free(log->wbuf);
+
+	memset(log, 0, sizeof(*log));
+	free(log);
+
+	return res;
+}
+
+// Start reading at the segment
+static int
+reader_segment(struct hc128_log_reader *reader, uint64_t segment)
+{
+	reader->segment = segment;
+	reader->off = reader->index[segment * 2];
+	reader->record = reader->index[segment * 2 + 1];
+	reader->next_off = (segment + 1 < reader->entries) ? reader->index[segment * 2 + 2] : UINT64_MAX;
+	reader->pos = 0;
+	reader->len = 0;
+
+	return segment_setup(&reader->ctx, reader->key, reader->iv, segment);
+}
+
+// At least need bytes decrypted in the buffer
+// Return value: 1 - available, 0 - end of the log, -1 - error
+static int
+reader_fill(struct hc128_log_reader *reader, uint32_t need)
+{
+	uint64_t want;
+	ssize_t n;
+
+	if(reader->len - reader->pos >= need)
+		return 1;
+
+	memmove(reader->buf, reader->buf + reader->pos, reader->len - reader->pos);
+	reader->len -= reader->pos;
+	reader->pos = 0;
+
+	while(reader->len < need) {
+		if(reader->off == reader->next_off) {
+			// Records never cross the segments
+			if(reader->len || reader_segment(reader, reader->segment + 1))
+				return -1;
+		}
+
+		want = HC128_LOG_BUFLEN + HC128_LOG_BLOCK - reader->len;
+
+		if(want > reader->next_off - reader->off)
+			want = reader->next_off - reader->off;
+
+		n = pread(reader->fd, reader->buf + reader->len, want, reader->off);
+
+		if(n < 0)
+			return -1;
+
+		// A partial record at the end is a commit cut by a crash
+		if(n == 0)
+			return 0;
+
+		hc128_crypt(&reader->ctx, reader->buf + reader->len, n, reader->buf + reader->len);
+		reader->len += n;
+		reader->off += n;
+	}
+
+	return 1;
+}
+
+// Next record in the buffer
+// Return value: 1 - record, 0 - end of the log, -1 - error
+static int
+reader_record(struct hc128_log_reader *reader, const uint8_t **rec, uint32_t *len)
+{
+	int res;
+
+	if((res = reader_fill(reader, 4)) != 1)
+		return res;
+
+	*len = load32_le(reader->buf + reader->pos);
+
+	if(*len > HC128_LOG_BUFLEN - 4)
+		return -1;
+
+	if((res = reader_fill(reader, 4 + *len)) != 1)
+		return res;
+
+	*rec = reader->buf + reader->pos + 4;
+	reader->pos += 4 + *len;
+	reader->record++;
+
+	return 1;
+}
+
+/*
+ * Open the log for reading, the index is read once.
+ * Return value: pointer on the reader, NULL if all bad
+*/
+struct hc128_log_reader *
+hc128_log_reader_open(const char *path, const uint8_t key[16])
+{
+	struct hc128_log_reader *reader;
+	uint8_t header[32], *raw = NULL;
+	struct stat st;
+	char *idx;
+	int idx_fd = -1;
+	uint64_t i;
+
+	reader = calloc(1, sizeof(*reader));
+	idx = index_path(path);
+
+	if(reader)
+		reader->fd = -1;
+
+	if(!reader || !idx)
+		goto fail;
+
+	reader->fd = open(path, O_RDONLY);
+	idx_fd = open(idx, O_RDONLY);
+
+	if((reader->fd < 0) || (idx_fd < 0) || fstat(idx_fd, &st))
+		goto fail;
+
+	if((pread(reader->fd, header, sizeof(header), 0) != sizeof(header)) ||
+	   memcmp(header, LOG_MAGIC, 8) || (load32_le(header + 8) != LOG_VERSION))
+		goto fail;
+
+	memcpy(reader->key, key, 16);
+	memcpy(reader->iv, header + 16, 16);
+
+	reader->entries = st.st_size / INDEX_ENTRY;
+	raw = malloc(reader->entries * INDEX_ENTRY);
+	reader->index = malloc(reader->entries * 2 * sizeof(uint64_t));
+	reader->buf = malloc(HC128_LOG_BUFLEN + HC128_LOG_BLOCK);
+
+	if(!reader->entries || !raw || !reader->index || !reader->buf ||
+	   (pread(idx_fd, raw, reader->entries * INDEX_ENTRY, 0) != reader->entries * INDEX_ENTRY))
+		goto fail;
+
+	for(i = 0; i < reader->entries * 2; i++)
+		reader->index[i] = load64_le(raw + i * 8);
+
+	if(reader_segment(reader, 0))
+		goto fail;
+
+	free(raw);
+	free(idx);
+	close(idx_fd);
+
+	return reader;
+
+fail:
+	if(reader) {
+		if(reader->fd >= 0)
+			close(reader->fd);
+		free(reader->index);
+		free(reader->buf);
+		free(reader);
+	}
+
+	if(idx_fd >= 0)
+		close(idx_fd);
+
+	free(raw);
+	free(idx);
+
+	return NULL;
+}
+
+/*
+ * Position the reader on the record: decryption starts at the checkpoint
+ * of its segment and the records before it in the segment are skipped.
+ * Return value: 0 (if all is well), -1 if there is no such record
+*/
+int
+hc128_log_seek(struct hc128_log_reader *reader, uint64_t record)
+{
+	const uint8_t *rec;
+	uint64_t lo = 0, hi = reader->entries - 1, mid;
+	uint32_t len;
+
+	// Last segment with the first record not after record
+	while(lo < hi) {
+		mid = (lo + hi + 1) / 2;
+
+		if(reader->index[mid * 2 + 1] <= record)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	if(reader_segment(reader, lo))
+		return -1;
+
+	while(reader->record < record) {
+		if(reader_record(reader, &rec, &len) != 1)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Read the next record.
+ * buf, size - buffer of the record
+ * len - length of the record
+ * Return value: 1 - record, 0 - end of the log, -1 - error or size too small
+*/
+int
+hc128_log_next(struct hc128_log_reader *reader, void *buf, uint32_t size, uint32_t *len)
+{
+	const uint8_t *rec;
+	int res;
+
+	if((res = reader_record(reader, &rec, len)) != 1)
+		return res;
+
+	if(*len > size)
+		return -1;
+
+	memcpy(buf, rec, *len);
+
+	return 1;
+}
+
+void
+hc128_log_reader_close(struct hc128_log_reader *reader)
+{
+	close(reader->fd);
+	free(reader->index);
+	free(reader->buf);
+	memset(reader, 0, sizeof(*reader));
+	free(reader);
+}
@@ -0,0 +1,69 @@
+/*
+ * Encrypted append-only log.
+ * Records of many threads are collected in a buffer, the committer thread
+ * encrypts the whole batch with one HC-128 stream and writes it with one
+ * write from a 4 KB aligned file offset (group commit), optionally
+ * followed by fdatasync().
+ *
+ * File: 4 KB header (magic, version, iv), then the encrypted records,
+ * every record is a 32-bit little endian length and the data.
+ * Checkpoints: after every checkpoint interval of bytes the next batch
+ * starts a new segment, the stream is set up again with the iv of the
+ * segment (iv of the log with the segment number xored into bytes 0..7).
+ * The file offset and the first record number of every segment are
+ * appended to the index <path>.idx, so a reader starts decrypting at the
+ * segment of the record instead of the head of the log. The index holds
+ * no secret state.
+*/
+
+#ifndef HC128_LOG_H
+#define HC128_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HC128_LOG_BUFLEN	(1 << 20)
+#define HC128_LOG_CHECKPOINT	(16 << 20)
+#define HC128_LOG_BLOCK		4096
+
+// Options of hc128_log_open
+#define HC128_LOG_SYNC		1
+
+/*
+ * Counters of the writer
+ * records - records appended
+ * commits - batches written
+ * syncs - fdatasync() calls
+ * bytes - bytes of the records with the lengths
+ * checkpoints - segments started
+*/
+struct hc128_log_stats {
+	uint64_t records;
+	uint64_t commits;
+	uint64_t syncs;
+	uint64_t bytes;
+	uint64_t checkpoints;
+};
+
+struct hc128_log;
+struct hc128_log_reader;
+
+struct hc128_log *hc128_log_open(const char *path, const uint8_t key[16], const uint8_t iv[16], uint64_t checkpoint, int options);
+
+int64_t hc128_log_append(struct hc128_log *log, const void *rec, uint32_t len);
+
+int hc128_log_sync(struct hc128_log *log, uint64_t record);
+
+void hc128_log_stats(struct hc128_log *log, struct hc128_log_stats *stats);
+
+int hc128_log_close(struct hc128_log *log);
+
+struct hc128_log_reader *hc128_log_reader_open(const char *path, const uint8_t key[16]);
+
+int hc128_log_seek(struct hc128_log_reader *reader, uint64_t record);
+
+int hc128_log_next(struct hc128_log_reader *reader, void *buf, uint32_t size, uint32_t *len);
+
+void hc128_log_reader_close(struct hc128_log_reader *reader);
+
+#endif
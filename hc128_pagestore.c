@@ -0,0 +1,559 @@
+/*
+ * Encrypted page store with the LRU cache of decrypted pages.
+ * Cache: slots of the pages in a hash table (chains of slot numbers) and in
+ * the LRU list, most recently used at the head.
+ * Write-back: the dirty pages of the batch are sorted by the page number,
+ * the generations are written first, then the contexts of the pages are
+ * set up PAGESTORE_LANES at a time and the contiguous runs of encrypted
+ * pages are written with one pwrite() each.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "hc128.h"
+#include "hc128_pagestore.h"
+
+// Contexts set up together at the write-back
+#define PAGESTORE_LANES	8
+
+/*
+ * Slot of the cache
+ * prev, next - LRU list, -1 at the ends
+ * hnext - chain of the hash table
+*/
+struct page_slot {
+	uint64_t page;
+	int32_t prev;
+	int32_t next;
+	int32_t hnext;
+	int dirty;
+};
+
+/*
+ * Store
+ * data - decrypted pages of the slots
+ * scratch - encrypted page read on a miss, before a slot is given up for it
+ * head, tail - most and least recently used slot
+ * gen, npages - generations of the pages in the file
+*/
+struct hc128_pagestore {
+	int fd;
+	int meta_fd;
+	uint8_t key[16];
+
+	uint32_t nslots;
+	uint32_t used;
+	struct page_slot *slots;
+	uint8_t *data;
+	int32_t *buckets;
+	uint32_t mask;
+	int32_t head;
+	int32_t tail;
+
+	uint64_t *gen;
+	uint64_t npages;
+
+	struct hc128_context ctx[PAGESTORE_LANES];
+	uint8_t *batch;
+	uint8_t *scratch;
+
+	struct hc128_pagestore_stats stats;
+};
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+store64_le(uint8_t *p, uint64_t v)
+{
+	int i;
+
+	for(i = 0; i < 8; i++)
+		p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint64_t
+load64_le(const uint8_t *p)
+{
+	uint64_t v = 0;
+	int i;
+
+	for(i = 7; i >= 0; i--)
+		v = (v << 8) | p[i];
+
+	return v;
+}
+
+// iv of the page: page number and generation
+static void
+page_iv(uint8_t *iv, uint64_t page, uint64_t gen)
+{
+	store64_le(iv, page);
+	store64_le(iv + 8, gen);
+}
+
+static uint32_t
+page_hash(const struct hc128_pagestore *ps, uint64_t page)
+{
+	return (uint32_t)((page * 0x9E3779B97F4A7C15ULL) >> 32) & ps->mask;
+}
+
+static int32_t
+cache_lookup(const struct hc128_pagestore *ps, uint64_t page)
+{
+	int32_t i;
+
+	for(i = ps->buckets[page_hash(ps, page)]; i >= 0; i = ps->slots[i].hnext) {
+		if(ps->slots[i].page == page)
+			return i;
+	}
+
+	return -1;
+}
+
+static void
+cache_unhash(struct hc128_pagestore *ps, int32_t slot)
+{
+	int32_t *p = &ps->buckets[page_hash(ps, ps->slots[slot].page)];
+
+	while(*p != slot)
+		p = &ps->slots[*p].hnext;
+
+	*p = ps->slots[slot].hnext;
+}
+
+static void
+lru_unlink(struct hc128_pagestore *ps, int32_t slot)
+{
+	struct page_slot *s = &ps->slots[slot];
+
+	if(s->prev >= 0)
+		ps->slots[s->prev].next = s->next;
+	else
+		ps->head = s->next;
+
+	if(s->next >= 0)
+		ps->slots[s->next].prev = s->prev;
+	else
+		ps->tail = s->prev;
+}
+
+static void
+lru_push(struct hc128_pagestore *ps, int32_t slot)
+{
+	struct page_slot *s = &ps->slots[slot];
+
+	s->prev = -1;
+	s->next = ps->head;
+
+	if(ps->head >= 0)
+		ps->slots[ps->head].prev = slot;
+	else
+		ps->tail = slot;
+
+	ps->head = slot;
+}
+
+static int
+write_all(int fd, const uint8_t *buf, size_t len, uint64_t off)
+{
+	ssize_t n;
+
+	while(len) {
+		n = pwrite(fd, buf, len, off);
+
+		if(n < 0) {
+			if(errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		buf += n;
+		len -= n;
+		off += n;
+	}
+
+	return 0;
+}
+
+// Generations of the pages up to page
+static int
+gen_reserve(struct hc128_pagestore *ps, uint64_t page)
+{
+	uint64_t n, *gen;
+
+	if(page < ps->npages)
+		return 0;
+
+	n = ps->npages ? ps->npages : 1024;
+	while(n <= page)
+		n *= 2;
+
+	gen = realloc(ps->gen, n * sizeof(uint64_t));
+	if(!gen)
+		return -1;
+
+	memset(gen + ps->npages, 0, (n - ps->npages) * sizeof(uint64_t));
+	ps->gen = gen;
+	ps->npages = n;
+
+	return 0;
+}
+
+static int
+slot_cmp(const void *a, const void *b, void *arg)
+{
+	const struct page_slot *slots = arg;
+	uint64_t x = slots[*(const int32_t *)a].page, y = slots[*(const int32_t *)b].page;
+
+	return (x > y) - (x < y);
+}
+
+// Encrypt and write n dirty slots
+static int
+writeback(struct hc128_pagestore *ps, int32_t *slot, int n)
+{
+	struct hc128_context *ctx[PAGESTORE_LANES];
+	uint8_t iv[PAGESTORE_LANES][16], raw[HC128_PAGESTORE_BATCH * 8];
+	uint64_t t = now_ns(), page;
+	int i, j, k, m;
+
+	qsort_r(slot, n, sizeof(*slot), slot_cmp, ps->slots);
+
+	if(gen_reserve(ps, ps->slots[slot[n - 1]].page))
+		goto fail;
+
+	// New generations, synced before any page uses them
+	for(i = 0; i < n; i = j) {
+		page = ps->slots[slot[i]].page;
+
+		for(j = i; (j < n) && (ps->slots[slot[j]].page == page + (j - i)); j++) {
+			ps->gen[page + (j - i)]++;
+			store64_le(raw + (j - i) * 8, ps->gen[page + (j - i)]);
+		}
+
+		if(write_all(ps->meta_fd, raw, (j - i) * 8, page * 8))
+			goto fail;
+	}
+
+	if(fdatasync(ps->meta_fd))
+		goto fail;
+
+	for(k = 0; k < PAGESTORE_LANES; k++)
+		ctx[k] = &ps->ctx[k];
+
+	for(i = 0; i < n; i += m) {
+		m = (n - i < PAGESTORE_LANES) ? n - i : PAGESTORE_LANES;
+
+		for(k = 0; k < m; k++) {
+			page = ps->slots[slot[i + k]].page;
+			page_iv(iv[k], page, ps->gen[page]);
+		}
+
+		if(hc128_set_key_and_iv_multi(ctx, m, ps->key, 16, iv, 16))
+			goto fail;
+
+		for(k = 0; k < m; k++)
+			hc128_crypt(ctx[k], ps->data + (size_t)slot[i + k] * HC128_PAGE_SIZE, HC128_PAGE_SIZE,
+				    ps->batch + (size_t)(i + k) * HC128_PAGE_SIZE);
+	}
+
+	// A run stays dirty until it is written, a failed write-back is redone
+	for(i = 0; i < n; i = j) {
+		page = ps->slots[slot[i]].page;
+
+		for(j = i; (j < n) && (ps->slots[slot[j]].page == page + (j - i)); j++)
+			;
+
+		if(write_all(ps->fd, ps->batch + (size_t)i * HC128_PAGE_SIZE, (size_t)(j - i) * HC128_PAGE_SIZE,
+			     page * HC128_PAGE_SIZE))
+			goto fail;
+
+		for(k = i; k < j; k++)
+			ps->slots[slot[k]].dirty = 0;
+	}
+
+	memset(ps->ctx, 0, sizeof(ps->ctx));
+
+	ps->stats.written += n;
+	ps->stats.batches++;
+	ps->stats.writeback_ns += now_ns() - t;
+
+	return 0;
+
+fail:
+	memset(ps->ctx, 0, sizeof(ps->ctx));
+
+	return -1;
+}
+
+/*
+ * Slot of the page, load - read the page from the file on a miss.
+ * The page is read before the victim is evicted, a failed read or
+ * write-back leaves the cache as it was.
+ * Return value: slot number, -1 if all bad
+*/
+static int32_t
+cache_get(struct hc128_pagestore *ps, uint64_t page, int load)
+{
+	int32_t batch[HC128_PAGESTORE_BATCH], slot, i;
+	uint8_t iv[16], *data;
+	uint32_t h;
+	int n, stored;
+
+	slot = cache_lookup(ps, page);
+
+	if(slot >= 0) {
+		ps->stats.hits++;
+		lru_unlink(ps, slot);
+		lru_push(ps, slot);
+		return slot;
+	}
+
+	ps->stats.misses++;
+
+	stored = load && (page < ps->npages) && ps->gen[page];
+
+	if(stored && (pread(ps->fd, ps->scratch, HC128_PAGE_SIZE, page * HC128_PAGE_SIZE) != HC128_PAGE_SIZE))
+		return -1;
+
+	if(ps->used < ps->nslots)
+		slot = ps->used++;
+	else {
+		slot = ps->tail;
+
+		// A dirty victim takes the dirty pages near the LRU end with it
+		if(ps->slots[slot].dirty) {
+			for(n = 0, i = slot; (i >= 0) && (n < HC128_PAGESTORE_BATCH); i = ps->slots[i].prev) {
+				if(ps->slots[i].dirty)
+					batch[n++] = i;
+			}
+
+			if(writeback(ps, batch, n))
+				return -1;
+		}
+
+		cache_unhash(ps, slot);
+		lru_unlink(ps, slot);
+		ps->stats.evictions++;
+	}
+
+	data = ps->data + (size_t)slot * HC128_PAGE_SIZE;
+
+	if(stored) {
+		page_iv(iv, page, ps->gen[page]);
+		hc128_set_key_and_iv(&ps->ctx[0], ps->key, 16, iv, 16);
+		hc128_crypt(&ps->ctx[0], ps->scratch, HC128_PAGE_SIZE, data);
+		memset(&ps->ctx[0], 0, sizeof(ps->ctx[0]));
+
+		ps->stats.loads++;
+	}
+	else if(load)
+		memset(data, 0, HC128_PAGE_SIZE);
+
+	h = page_hash(ps, page);
+	ps->slots[slot].page = page;
+	ps->slots[slot].dirty = 0;
+	ps->slots[slot].hnext = ps->buckets[h];
+	ps->buckets[h] = slot;
+	lru_push(ps, slot);
+
+	return slot;
+}
+
+/*
+ * Open the store, the file and <path>.meta are created if missing.
+ * path - path of the page file
+ * key - 16-byte key
+ * cache_pages - number of decrypted pages in memory
+ * Return value: pointer on the store, NULL if all bad
+*/
+struct hc128_pagestore *
+hc128_pagestore_open(const char *path, const uint8_t key[16], uint32_t cache_pages)
+{
+	struct hc128_pagestore *ps;
+	struct stat st;
+	uint8_t *raw = NULL;
+	char meta[4096];
+	uint64_t i, n;
+	uint32_t buckets;
+
+	if(!cache_pages || (snprintf(meta, sizeof(meta), "%s.meta", path) >= sizeof(meta)))
+		return NULL;
+
+	ps = calloc(1, sizeof(*ps));
+	if(!ps)
+		return NULL;
+
+	ps->fd = open(path, O_RDWR | O_CREAT, 0600);
+	ps->meta_fd = open(meta, O_RDWR | O_CREAT, 0600);
+
+	if((ps->fd < 0) || (ps->meta_fd < 0) || fstat(ps->meta_fd, &st))
+		goto fail;
+
+	for(buckets = 1; buckets < 2 * cache_pages; buckets *= 2)
+		;
+
+	ps->nslots = cache_pages;
+	ps->mask = buckets - 1;
+	ps->head = ps->tail = -1;
+	ps->slots = calloc(cache_pages, sizeof(*ps->slots));
+	ps->buckets = malloc(buckets * sizeof(*ps->buckets));
+
+	if(!ps->slots || !ps->buckets ||
+	   posix_memalign((void **)&ps->data, HC128_PAGE_SIZE, (size_t)cache_pages * HC128_PAGE_SIZE) ||
+	   posix_memalign((void **)&ps->batch, HC128_PAGE_SIZE, (size_t)HC128_PAGESTORE_BATCH * HC128_PAGE_SIZE) ||
+	   posix_memalign((void **)&ps->scratch, HC128_PAGE_SIZE, HC128_PAGE_SIZE))
+		goto fail;
+
+	memset(ps->buckets, 0xff, buckets * sizeof(*ps->buckets));
+
+	n = st.st_size / 8;
+
+	if(n) {
+		raw = malloc(n * 8);
+
+		if(!raw || gen_reserve(ps, n - 1) || (pread(ps->meta_fd, raw, n * 8, 0) != n * 8))
+			goto fail;
+
+		for(i = 0; i < n; i++)
+			ps->gen[i] = load64_le(raw + i * 8);
+
+		free(raw);
+	}
+
+	memcpy(ps->key, key, 16);
+
+	return ps;
+
+fail:
+	if(ps->fd >= 0)
+		close(ps->fd);
+	if(ps->meta_fd >= 0)
+		close(ps->meta_fd);
+	free(raw);
+	free(ps->slots);
+	free(ps->buckets);
+	free(ps->data);
+	free(ps->batch);
+	free(ps->scratch);
+	free(ps->gen);
+	free(ps);
+
+	return NULL;
+}
+
+/*
+ * Read the page, pages never written are zero.
+ * Return value: 0 (if all is well), -1 id all bad
+*/
+int
+hc128_pagestore_read(struct hc128_pagestore *ps, uint64_t page, uint8_t *buf)
+{
+	int32_t slot = cache_get(ps, page, 1);
+
+	if(slot < 0)
+		return -1;
+
+	memcpy(buf, ps->data + (size_t)slot * HC128_PAGE_SIZE, HC128_PAGE_SIZE);
+
+	return 0;
+}
+
+/*
+ * Write the page into the cache, it goes to the file at the write-back.
+ * Return value: 0 (if all is well), -1 id all bad
+*/
+int
+hc128_pagestore_write(struct hc128_pagestore *ps, uint64_t page, const uint8_t *buf)
+{
+	int32_t slot = cache_get(ps, page, 0);
+
+	if(slot < 0)
+		return -1;
+
+	memcpy(ps->data + (size_t)slot * HC128_PAGE_SIZE, buf, HC128_PAGE_SIZE);
+	ps->slots[slot].dirty = 1;
+
+	return 0;
+}
+
+/*
+ * Write back all dirty pages and sync the file.
+ * Return value: 0 (if all is well), -1 id all bad
+*/
+int
+hc128_pagestore_flush(struct hc128_pagestore *ps)
+{
+	int32_t batch[HC128_PAGESTORE_BATCH];
+	uint32_t i;
+	int n = 0;
+
+	for(i = 0; i < ps->used; i++) {
+		if(!ps->slots[i].dirty)
+			continue;
+
+		batch[n++] = i;
+
+		if(n == HC128_PAGESTORE_BATCH) {
+			if(writeback(ps, batch, n))
+				return -1;
+			n = 0;
+		}
+	}
+
+	if(n && writeback(ps, batch, n))
+		return -1;
+
+	return fdatasync(ps->fd);
+}
+
+void
+hc128_pagestore_stats(struct hc128_pagestore *ps, struct hc128_pagestore_stats *stats)
+{
+	*stats = ps->stats;
+}
+
+/*
+ * Flush and close the store.
+ * Return value: 0 (if all is well), -1 id all bad
+*/
+int
+hc128_pagestore_close(struct hc128_pagestore *ps)
+{
+	int res = hc128_pagestore_flush(ps);
+
+	if(close(ps->fd) || close(ps->meta_fd))
+		res = -1;
+
+	memset(ps->data, 0, (size_t)ps->nslots * HC128_PAGE_SIZE);
+	memset(ps->batch, 0, (size_t)HC128_PAGESTORE_BATCH * HC128_PAGE_SIZE);
+	free(ps->slots);
+	free(ps->buckets);
+	free(ps->data);
+	free(ps->batch);
+	free(ps->scratch);
+	free(ps->gen);
+
+	memset(ps, 0, sizeof(*ps));
+	free(ps);
+
+	return res;
+}
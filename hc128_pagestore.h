@@ -0,0 +1,58 @@
+/*
+ * Encrypted page store.
+ * File of HC128_PAGE_SIZE pages, every page is encrypted on its own with
+ * the iv (page number, generation), both 64-bit little endian. The
+ * generation of the page grows with every write-back, so the keystream of
+ * a page is never used twice; the generations are kept in <path>.meta
+ * and written (and synced) before the pages.
+ * Decrypted pages are kept in an LRU cache, hits are served without the
+ * HC-128 setup. Dirty pages are encrypted and written back in batches on
+ * eviction and by hc128_pagestore_flush().
+ * The store is not thread safe. There is no journal and the pages are
+ * not authenticated: after a crash during the write-back a page may be
+ * read back as garbage without any error, but a keystream is never reused.
+*/
+
+#ifndef HC128_PAGESTORE_H
+#define HC128_PAGESTORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HC128_PAGE_SIZE		4096
+#define HC128_PAGESTORE_BATCH	64
+
+/*
+ * Counters of the store
+ * hits, misses - cache lookups of read and write
+ * loads - pages read from the file and decrypted
+ * evictions - pages dropped from the cache
+ * written - pages encrypted and written back
+ * batches - write-back batches
+ * writeback_ns - time of the write-back
+*/
+struct hc128_pagestore_stats {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t loads;
+	uint64_t evictions;
+	uint64_t written;
+	uint64_t batches;
+	uint64_t writeback_ns;
+};
+
+struct hc128_pagestore;
+
+struct hc128_pagestore *hc128_pagestore_open(const char *path, const uint8_t key[16], uint32_t cache_pages);
+
+int hc128_pagestore_read(struct hc128_pagestore *ps, uint64_t page, uint8_t *buf);
+
+int hc128_pagestore_write(struct hc128_pagestore *ps, uint64_t page, const uint8_t *buf);
+
+int hc128_pagestore_flush(struct hc128_pagestore *ps);
+
+void hc128_pagestore_stats(struct hc128_pagestore *ps, struct hc128_pagestore_stats *stats);
+
+int hc128_pagestore_close(struct hc128_pagestore *ps);
+
+#endif
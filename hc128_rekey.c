@@ -0,0 +1,231 @@
+/*
+ * Stream with the periodic rekeying.
+ * Two contexts: cur encrypts the epoch, next is set up by the helper for
+ * the epoch after it. At the boundary the pointers are swapped and the
+ * helper is asked for the following epoch.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "hc128.h"
+#include "hc128_rekey.h"
+
+/*
+ * Stream
+ * pos - bytes of the epoch already used
+ * ready - epoch of the context in next, or -1 while the helper works
+ * request - epoch the helper has to set up next, or -1
+*/
+struct hc128_rekey {
+	uint8_t key[16];
+	uint8_t iv[16];
+	uint64_t interval;
+	uint64_t epoch;
+	uint64_t pos;
+	int options;
+
+	struct hc128_context ctx[2];
+	struct hc128_context *cur;
+	struct hc128_context *next;
+
+	pthread_t helper;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int64_t ready;
+	int64_t request;
+	int stop;
+
+	struct hc128_rekey_stats stats;
+};
+
+// Context of the epoch
+static void
+epoch_setup(const struct hc128_rekey *rk, struct hc128_context *ctx, uint64_t epoch)
+{
+	uint8_t iv[16];
+	int i;
+
+	memcpy(iv, rk->iv, 16);
+
+	for(i = 0; i < 8; i++)
+		iv[i] ^= (uint8_t)(epoch >> (8 * i));
+
+	hc128_set_key_and_iv(ctx, rk->key, 16, iv, 16);
+	memset(iv, 0, sizeof(iv));
+}
+
+static void *
+rekey_helper(void *arg)
+{
+	struct hc128_rekey *rk = arg;
+	int64_t epoch;
+
+	pthread_mutex_lock(&rk->mutex);
+
+	for(;;) {
+		while((rk->request < 0) && !rk->stop)
+			pthread_cond_wait(&rk->cond, &rk->mutex);
+
+		if(rk->stop)
+			break;
+
+		epoch = rk->request;
+		rk->request = -1;
+
+		// next is not touched by the stream until ready is set
+		pthread_mutex_unlock(&rk->mutex);
+		epoch_setup(rk, rk->next, epoch);
+		pthread_mutex_lock(&rk->mutex);
+
+		rk->ready = epoch;
+		pthread_cond_broadcast(&rk->cond);
+	}
+
+	pthread_mutex_unlock(&rk->mutex);
+
+	return NULL;
+}
+
+// Switch to the next epoch at the boundary
+static void
+rekey_switch(struct hc128_rekey *rk)
+{
+	struct hc128_context *t;
+
+	rk->epoch++;
+	rk->pos = 0;
+	rk->stats.rekeys++;
+
+	if(rk->options & HC128_REKEY_SYNC) {
+		epoch_setup(rk, rk->cur, rk->epoch);
+		return;
+	}
+
+	pthread_mutex_lock(&rk->mutex);
+
+	if(rk->ready != rk->epoch) {
+		rk->stats.waits++;
+
+		while(rk->ready != rk->epoch)
+			pthread_cond_wait(&rk->cond, &rk->mutex);
+	}
+
+	t = rk->cur;
+	rk->cur = rk->next;
+	rk->next = t;
+
+	memset(rk->next, 0, sizeof(*rk->next));
+
+	rk->ready = -1;
+	rk->request = rk->epoch + 1;
+	pthread_cond_broadcast(&rk->cond);
+
+	pthread_mutex_unlock(&rk->mutex);
+}
+
+/*
+ * Create the stream, epoch 0 is set up at once.
+ * key - 16-byte key, iv - 16-byte iv of the stream
+ * interval - bytes of every epoch
+ * options - HC128_REKEY_SYNC: set up the next epoch inline, no helper
+ * Return value: pointer on the stream, NULL if all bad
+*/
+struct hc128_rekey *
+hc128_rekey_create(const uint8_t key[16], const uint8_t iv[16], uint64_t interval, int options)
+{
+	struct hc128_rekey *rk;
+
+	if(!interval || !(rk = calloc(1, sizeof(*rk))))
+		return NULL;
+
+	memcpy(rk->key, key, 16);
+	memcpy(rk->iv, iv, 16);
+	rk->interval = interval;
+	rk->options = options;
+	rk->cur = &rk->ctx[0];
+	rk->next = &rk->ctx[1];
+	rk->ready = -1;
+	rk->request = -1;
+
+	epoch_setup(rk, rk->cur, 0);
+
+	if(options & HC128_REKEY_SYNC)
+		return rk;
+
+	pthread_mutex_init(&rk->mutex, NULL);
+	pthread_cond_init(&rk->cond, NULL);
+	rk->request = 1;
+
+	if(pthread_create(&rk->helper, NULL, rekey_helper, rk)) {
+		pthread_mutex_destroy(&rk->mutex);
+		pthread_cond_destroy(&rk->cond);
+		memset(rk, 0, sizeof(*rk));
+		free(rk);
+		return NULL;
+	}
+
+	return rk;
+}
+
+/*
+ * Crypt of the stream, the epochs are switched inside at their boundaries.
+ * rk - pointer on the stream
+ * buf - pointer on buffer data
+ * buflen - length the data buffer
+ * out - pointer on output array
+*/
+void
+hc128_rekey_crypt(struct hc128_rekey *rk, const uint8_t *buf, size_t buflen, uint8_t *out)
+{
+	uint64_t n;
+
+	while(buflen) {
+		n = rk->interval - rk->pos;
+
+		if(n > buflen)
+			n = buflen;
+
+		if(n > 0x40000000)
+			n = 0x40000000;
+
+		hc128_crypt(rk->cur, buf, n, out);
+
+		buf += n;
+		out += n;
+		buflen -= n;
+		rk->pos += n;
+
+		if(rk->pos == rk->interval)
+			rekey_switch(rk);
+	}
+}
+
+void
+hc128_rekey_stats(struct hc128_rekey *rk, struct hc128_rekey_stats *stats)
+{
+	*stats = rk->stats;
+}
+
+// Stop the helper and wipe the stream
+void
+hc128_rekey_destroy(struct hc128_rekey *rk)
+{
+	if(!(rk->options & HC128_REKEY_SYNC)) {
+		pthread_mutex_lock(&rk->mutex);
+		rk->stop = 1;
+		pthread_cond_broadcast(&rk->cond);
+		pthread_mutex_unlock(&rk->mutex);
+
+		pthread_join(rk->helper, NULL);
+
+		pthread_mutex_destroy(&rk->mutex);
+		pthread_cond_destroy(&rk->cond);
+	}
+
+	memset(rk, 0, sizeof(*rk));
+	free(rk);
+}
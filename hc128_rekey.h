@@ -0,0 +1,40 @@
+/*
+ * Stream with the periodic rekeying.
+ * The stream is cut into epochs of interval bytes, epoch e is encrypted by
+ * the context of (key, iv of the stream with e xored into bytes 0..7).
+ * The helper thread of the stream sets up the context of the next epoch
+ * while the current one is in use, the switch happens exactly at the
+ * epoch boundary. The output is the same as with the setup done inline
+ * (HC128_REKEY_SYNC), whatever the call sizes.
+*/
+
+#ifndef HC128_REKEY_H
+#define HC128_REKEY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Options of hc128_rekey_create
+#define HC128_REKEY_SYNC	1
+
+/*
+ * Counters of the stream
+ * rekeys - epoch switches
+ * waits - switches that had to wait for the helper
+*/
+struct hc128_rekey_stats {
+	uint64_t rekeys;
+	uint64_t waits;
+};
+
+struct hc128_rekey;
+
+struct hc128_rekey *hc128_rekey_create(const uint8_t key[16], const uint8_t iv[16], uint64_t interval, int options);
+
+void hc128_rekey_crypt(struct hc128_rekey *rk, const uint8_t *buf, size_t buflen, uint8_t *out);
+
+void hc128_rekey_stats(struct hc128_rekey *rk, struct hc128_rekey_stats *stats);
+
+void hc128_rekey_destroy(struct hc128_rekey *rk);
+
+#endif
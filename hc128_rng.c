@@ -0,0 +1,334 @@
+/*
+ * Random number generator on the HC-128 keystream.
+ * The generator of the thread is created on the first call, keeps
+ * HC128_RNG_BUFLEN bytes of the keystream and wipes the bytes given out.
+ * Key and iv are taken from getrandom() (or /dev/urandom if the system call
+ * is missing) on creation, after HC128_RNG_RESEED bytes and after fork().
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/random.h>
+
+#include "hc128.h"
+#include "hc128_rng.h"
+
+/*
+ * Generator of the thread
+ * ctx - HC128 context
+ * buf - keystream buffer
+ * pos - first unused byte of buf
+ * generated - number of bytes generated since the last reseed
+ * fork_generation - value of rng_fork_generation at the last reseed
+*/
+struct hc128_rng {
+	struct hc128_context ctx;
+	uint8_t buf[HC128_RNG_BUFLEN];
+	uint32_t pos;
+	uint64_t generated;
+	unsigned long fork_generation;
+};
+
+static __thread struct hc128_rng *rng;
+
+static pthread_once_t rng_once = PTHREAD_ONCE_INIT;
+static pthread_key_t rng_key;
+
+// Incremented in the child process after fork()
+static volatile unsigned long rng_fork_generation;
+
+static _Atomic uint64_t rng_reseed_interval = HC128_RNG_RESEED;
+
+// Fill buf with the bytes of the system random source
+static void
+rng_entropy(uint8_t *buf, size_t len)
+{
+	ssize_t n;
+	int fd;
+
+	while(len > 0) {
+		n = getrandom(buf, len, 0);
+
+		if(n < 0) {
+			if(errno == EINTR)
+				continue;
+			break;
+		}
+
+		buf += n;
+		len -= n;
+	}
+
+	if(len == 0)
+		return;
+
+	// Kernel without getrandom()
+	fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+
+	while((fd >= 0) && (len > 0)) {
+		n = read(fd, buf, len);
+
+		if(n <= 0) {
+			if((n < 0) && (errno == EINTR))
+				continue;
+			break;
+		}
+
+		buf += n;
+		len -= n;
+	}
+
+	if(fd >= 0)
+		close(fd);
+
+	if(len > 0) {
+		printf("HC128 rng: no system random source!\n");
+		exit(1);
+	}
+}
+
+static void
+rng_atfork_child(void)
+{
+	rng_fork_generation++;
+}
+
+// Wipe and free the generator on thread exit
+static void
+rng_destroy(void *p)
+{
+	memset(p, 0, sizeof(struct hc128_rng));
+	free(p);
+}
+
+static void
+rng_once_init(void)
+{
+	pthread_key_create(&rng_key, rng_destroy);
+	pthread_atfork(NULL, NULL, rng_atfork_child);
+}
+
+// New key and iv, the buffered keystream is dropped
+static void
+rng_seed(struct hc128_rng *r)
+{
+	uint8_t seed[32];
+
+	rng_entropy(seed, sizeof(seed));
+	hc128_set_key_and_iv(&r->ctx, seed, 16, seed + 16, 16);
+	memset(seed, 0, sizeof(seed));
+
+	memset(r->buf, 0, sizeof(r->buf));
+	r->pos = HC128_RNG_BUFLEN;
+	r->generated = 0;
+	r->fork_generation = rng_fork_generation;
+}
+
+// Generator of the thread, created on the first call
+static struct hc128_rng *
+rng_get(void)
+{
+	struct hc128_rng *r = rng;
+
+	if(r == NULL) {
+		pthread_once(&rng_once, rng_once_init);
+
+		r = malloc(sizeof(*r));
+
+		if(r == NULL) {
+			printf("Allocates memory error!\n");
+			exit(1);
+		}
+
+		rng_seed(r);
+		pthread_setspecific(rng_key, r);
+		rng = r;
+	}
+	else if(r->fork_generation != rng_fork_generation)
+		rng_seed(r);
+
+	return r;
+}
+
+/*
+ * Reseed before the generation of len bytes that would pass the interval
+ * (also if the interval was lowered below the bytes generated already)
+ * Return value: bytes left until the next reseed, at least len
+*/
+static uint64_t
+rng_budget(struct hc128_rng *r, uint64_t len)
+{
+	uint64_t interval = atomic_load_explicit(&rng_reseed_interval, memory_order_relaxed);
+
+	if((r->generated >= interval) || (interval - r->generated < len))
+		rng_seed(r);
+
+	return interval - r->generated;
+}
+
+// New keystream in buf, the reseed (which wipes buf) comes first
+static void
+rng_refill(struct hc128_rng *r)
+{
+	rng_budget(r, HC128_RNG_BUFLEN);
+
+	hc128_keystream_blocks(&r->ctx, r->buf, HC128_RNG_BUFLEN / 64);
+	r->pos = 0;
+	r->generated += HC128_RNG_BUFLEN;
+}
+
+// Copy len bytes of the buffer and wipe them
+static void
+rng_take(struct hc128_rng *r, uint8_t *out, size_t len)
+{
+	memcpy(out, r->buf + r->pos, len);
+	memset(r->buf + r->pos, 0, len);
+	r->pos += len;
+}
+
+// Random bytes
+void
+hc128_rng_bytes(void *buf, size_t len)
+{
+	struct hc128_rng *r = rng_get();
+	uint8_t *out = buf;
+	uint64_t budget;
+	size_t n;
+
+	while(len > 0) {
+		// Large requests get the keystream directly
+		if((r->pos == HC128_RNG_BUFLEN) && (len >= HC128_RNG_BUFLEN)) {
+			n = len - len % HC128_RNG_BUFLEN;
+			budget = rng_budget(r, HC128_RNG_BUFLEN);
+
+			if(n > budget)
+				n = budget - budget % HC128_RNG_BUFLEN;
+
+			hc128_keystream_blocks(&r->ctx, out, n / 64);
+			r->generated += n;
+
+			out += n;
+			len -= n;
+			continue;
+		}
+
+		if(r->pos == HC128_RNG_BUFLEN)
+			rng_refill(r);
+
+		n = HC128_RNG_BUFLEN - r->pos;
+		if(n > len)
+			n = len;
+
+		rng_take(r, out, n);
+		out += n;
+		len -= n;
+	}
+}
+
+uint32_t
+hc128_rng_u32(void)
+{
+	struct hc128_rng *r = rng_get();
+	uint32_t v;
+
+	if(HC128_RNG_BUFLEN - r->pos < sizeof(v))
+		rng_refill(r);
+
+	rng_take(r, (uint8_t *)&v, sizeof(v));
+
+	return v;
+}
+
+uint64_t
+hc128_rng_u64(void)
+{
+	struct hc128_rng *r = rng_get();
+	uint64_t v;
+
+	if(HC128_RNG_BUFLEN - r->pos < sizeof(v))
+		rng_refill(r);
+
+	rng_take(r, (uint8_t *)&v, sizeof(v));
+
+	return v;
+}
+
+// Uniform number in [0, bound), bound > 0 (Lemire's multiply and reject)
+uint32_t
+hc128_rng_uniform(uint32_t bound)
+{
+	uint64_t m;
+	uint32_t low, threshold;
+
+	m = (uint64_t)hc128_rng_u32() * bound;
+	low = (uint32_t)m;
+
+	if(low < bound) {
+		threshold = -bound % bound;
+
+		while(low < threshold) {
+			m = (uint64_t)hc128_rng_u32() * bound;
+			low = (uint32_t)m;
+		}
+	}
+
+	return m >> 32;
+}
+
+// Uniform number in [0, bound), bound > 0
+uint64_t
+hc128_rng_uniform64(uint64_t bound)
+{
+	uint64_t v, threshold;
+
+	if(bound <= UINT32_MAX)
+		return hc128_rng_uniform((uint32_t)bound);
+
+	threshold = -bound % bound;
+
+	do {
+		v = hc128_rng_u64();
+	} while(v < threshold);
+
+	return v % bound;
+}
+
+// Uniform number in [min, max]
+int64_t
+hc128_rng_range(int64_t min, int64_t max)
+{
+	uint64_t span = (uint64_t)max - (uint64_t)min + 1;
+
+	if(max <= min)
+		return min;
+
+	// The whole range of int64_t
+	if(span == 0)
+		return (int64_t)hc128_rng_u64();
+
+	return (int64_t)((uint64_t)min + hc128_rng_uniform64(span));
+}
+
+// Immediate reseed of the generator of the thread
+void
+hc128_rng_reseed(void)
+{
+	rng_seed(rng_get());
+}
+
+// Number of bytes between two automatic reseeds (for all threads)
+void
+hc128_rng_set_reseed_interval(uint64_t bytes)
+{
+	if(bytes < HC128_RNG_BUFLEN)
+		bytes = HC128_RNG_BUFLEN;
+
+	atomic_store_explicit(&rng_reseed_interval, bytes, memory_order_relaxed);
+}
@@ -0,0 +1,36 @@
+/*
+ * Random number generator on the HC-128 keystream.
+ * Every thread lazily gets its own generator seeded from getrandom().
+ * The generator is reseeded after HC128_RNG_RESEED bytes and in the child
+ * process after fork().
+*/
+
+#ifndef HC128_RNG_H
+#define HC128_RNG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Size of the keystream buffer of the generator in bytes
+#define HC128_RNG_BUFLEN	8192
+
+// Default number of bytes generated between two reseeds
+#define HC128_RNG_RESEED	(1ULL << 30)
+
+uint32_t hc128_rng_u32(void);
+
+uint64_t hc128_rng_u64(void);
+
+void hc128_rng_bytes(void *buf, size_t len);
+
+uint32_t hc128_rng_uniform(uint32_t bound);
+
+uint64_t hc128_rng_uniform64(uint64_t bound);
+
+int64_t hc128_rng_range(int64_t min, int64_t max);
+
+void hc128_rng_reseed(void);
+
+void hc128_rng_set_reseed_interval(uint64_t bytes);
+
+#endif
@@ -0,0 +1,404 @@
+/*
+ * Session store with the hibernation tier.
+ * Arena: context of the session id at id * sizeof(struct hc128_context).
+ * A context spans two or three pages, the pages at its ends are shared
+ * with the neighbours, so a page goes back to the system only when no
+ * resident context touches it.
+ * File: record of the session id at id * HC128_SESSIONS_RECORD, the
+ * serialized context sealed by hc128_aead_seal() under the key of the
+ * store, then the tag. The iv is the id and the number of the hibernation
+ * in the store (both 64-bit little endian), kept in memory: a record
+ * written back from an older copy of the file does not open. The mapping
+ * pages are dropped after every write and read, the data stays in the page
+ * cache and in the file.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+
+#include "hc128.h"
+#include "hc128_aead.h"
+#include "hc128_sessions.h"
+
+#define SESSION_CLOSED		0
+#define SESSION_RESIDENT	1
+#define SESSION_HIBERNATED	2
+
+/*
+ * Session
+ * last_use - time of the last clock pass that found it referenced
+ * seal - number of the hibernation, the iv of the record
+ * len - length of the serialized context in the file
+*/
+struct session {
+	uint64_t last_use;
+	uint64_t seal;
+	uint16_t len;
+	uint8_t state;
+	uint8_t referenced;
+};
+
+struct hc128_sessions {
+	int fd;
+	uint8_t key[16];
+	uint32_t capacity;
+	uint64_t idle;
+	uint64_t now;
+	uint32_t hand;
+	size_t page;
+	struct session *sessions;
+	uint8_t *arena;
+	size_t arena_size;
+	uint8_t *file;
+	size_t file_size;
+	struct hc128_sessions_stats stats;
+};
+
+static struct hc128_context *
+arena_ctx(struct hc128_sessions *s, uint32_t id)
+{
+	return (struct hc128_context *)(s->arena + (size_t)id * sizeof(struct hc128_context));
+}
+
+// Session with a context in the arena
+static int
+is_resident(struct hc128_sessions *s, uint64_t id)
+{
+	return (id < s->capacity) && (s->sessions[id].state == SESSION_RESIDENT);
+}
+
+// Give back the arena pages of the context not shared with a resident neighbour
+static void
+arena_release(struct hc128_sessions *s, uint32_t id)
+{
+	size_t start = (size_t)id * sizeof(struct hc128_context), end = start + sizeof(struct hc128_context);
+	size_t first = start & ~(s->page - 1), last = (end + s->page - 1) & ~(s->page - 1);
+
+	if((first < start) && is_resident(s, (uint64_t)id - 1))
+		first += s->page;
+
+	if((last > end) && is_resident(s, (uint64_t)id + 1))
+		last -= s->page;
+
+	if(last > first)
+		madvise(s->arena + first, last - first, MADV_DONTNEED);
+}
+
+// Drop the mapping pages of the file slot
+static void
+file_release(struct hc128_sessions *s, uint32_t id)
+{
+	size_t start = (size_t)id * HC128_SESSIONS_RECORD;
+	size_t first = start & ~(s->page - 1), last = (start + HC128_SESSIONS_RECORD + s->page - 1) & ~(s->page - 1);
+
+	madvise(s->file + first, last - first, MADV_DONTNEED);
+}
+
+static uint8_t *
+file_record(struct hc128_sessions *s, uint32_t id)
+{
+	return s->file + (size_t)id * HC128_SESSIONS_RECORD;
+}
+
+static void
+record_iv(uint8_t *iv, uint32_t id, uint64_t seal)
+{
+	int i;
+
+	for(i = 0; i < 8; i++) {
+		iv[i] = (uint8_t)((uint64_t)id >> (8 * i));
+		iv[8 + i] = (uint8_t)(seal >> (8 * i));
+	}
+}
+
+// Wipe the record of the hibernated session id
+static void
+record_wipe(struct hc128_sessions *s, uint32_t id)
+{
+	memset(file_record(s, id), 0, s->sessions[id].len + HC128_AEAD_TAGLEN);
+}
+
+// Return value: 0 (if all is well), -1 if the context stays resident
+static int
+hibernate(struct hc128_sessions *s, uint32_t id)
+{
+	struct hc128_context *ctx = arena_ctx(s, id);
+	uint8_t buf[HC128_SERIALIZED_MAX], iv[16], *rec = file_record(s, id);
+	uint32_t len;
+	int res;
+
+	len = hc128_serialize(ctx, buf);
+	record_iv(iv, id, s->stats.hibernations + 1);
+
+	// The plain serialized context never reaches the file
+	res = hc128_aead_seal(s->key, iv, NULL, 0, buf, len, rec, rec + len);
+	memset(buf, 0, sizeof(buf));
+
+	if(res)
+		return -1;
+
+	s->sessions[id].len = len;
+	s->sessions[id].seal = s->stats.hibernations + 1;
+	s->sessions[id].state = SESSION_HIBERNATED;
+
+	memset(ctx, 0, sizeof(*ctx));
+	arena_release(s, id);
+	file_release(s, id);
+
+	s->stats.resident--;
+	s->stats.hibernated++;
+	s->stats.hibernations++;
+
+	return 0;
+}
+
+// Return value: 0 (if all is well), -1 if the record does not open
+static int
+wake(struct hc128_sessions *s, uint32_t id)
+{
+	uint8_t buf[HC128_SERIALIZED_MAX], iv[16], *rec = file_record(s, id);
+	uint32_t len = s->sessions[id].len;
+	int res;
+
+	record_iv(iv, id, s->sessions[id].seal);
+
+	res = hc128_aead_open(s->key, iv, NULL, 0, rec, len, buf, rec + len) ||
+	      hc128_deserialize(arena_ctx(s, id), buf, len);
+	memset(buf, 0, sizeof(buf));
+
+	if(res)
+		return -1;
+
+	record_wipe(s, id);
+	file_release(s, id);
+
+	s->sessions[id].state = SESSION_RESIDENT;
+	s->sessions[id].last_use = s->now;
+
+	s->stats.resident++;
+	s->stats.hibernated--;
+	s->stats.wakeups++;
+
+	return 0;
+}
+
+/*
+ * Create the store and its file (an existing file is truncated),
+ * the key of the store is taken from getrandom().
+ * path - path of the hibernation file
+ * capacity - number of the session ids
+ * idle - idle time before the hibernation, in the units of hc128_sessions_tick()
+ * Return value: pointer on the store, NULL if all bad
+*/
+struct hc128_sessions *
+hc128_sessions_create(const char *path, uint32_t capacity, uint64_t idle)
+{
+	struct hc128_sessions *s;
+
+	if(!capacity || !(s = calloc(1, sizeof(*s))))
+		return NULL;
+
+	s->capacity = capacity;
+	s->idle = idle;
+	s->page = sysconf(_SC_PAGESIZE);
+	s->arena_size = (size_t)capacity * sizeof(struct hc128_context);
+	s->file_size = (size_t)capacity * HC128_SESSIONS_RECORD;
+	s->sessions = calloc(capacity, sizeof(*s->sessions));
+	s->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+
+	if(!s->sessions || (s->fd < 0) || ftruncate(s->fd, s->file_size) ||
+	   (getrandom(s->key, sizeof(s->key), 0) != sizeof(s->key)))
+		goto fail;
+
+	s->arena = mmap(NULL, s->arena_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	s->file = mmap(NULL, s->file_size, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, 0);
+
+	if((s->arena == MAP_FAILED) || (s->file == MAP_FAILED))
+		goto fail;
+
+	return s;
+
+fail:
+	if(s->arena && (s->arena != MAP_FAILED))
+		munmap(s->arena, s->arena_size);
+	if(s->file && (s->file != MAP_FAILED))
+		munmap(s->file, s->file_size);
+	if(s->fd >= 0)
+		close(s->fd);
+	free(s->sessions);
+	memset(s, 0, sizeof(*s));
+	free(s);
+
+	return NULL;
+}
+
+/*
+ * Open the session id with its key and iv, the context is resident.
+ * Return value: 0 (if all is well), -1 id all bad
+*/
+int
+hc128_sessions_open(struct hc128_sessions *s, uint32_t id, const uint8_t *key, int keylen, const uint8_t iv[16], int ivlen)
+{
+	if((id >= s->capacity) || (s->sessions[id].state != SESSION_CLOSED))
+		return -1;
+
+	if(hc128_set_key_and_iv(arena_ctx(s, id), key, keylen, iv, ivlen))
+		return -1;
+
+	s->sessions[id].state = SESSION_RESIDENT;
+	s->sessions[id].referenced = 1;
+	s->sessions[id].last_use = s->now;
+	s->stats.resident++;
+
+	return 0;
+}
+
+/*
+ * Context of the session id, a hibernated one is brought back.
+ * The pointer is valid until the next hc128_sessions_tick() or close.
+ * Return value: pointer on HC128 context, NULL if the session is not open
+*/
+struct hc128_context *
+hc128_sessions_get(struct hc128_sessions *s, uint32_t id)
+{
+	if(id >= s->capacity)
+		return NULL;
+
+	switch(s->sessions[id].state) {
+	case SESSION_HIBERNATED:
+		if(wake(s, id))
+			return NULL;
+		break;
+	case SESSION_CLOSED:
+		return NULL;
+	}
+
+	s->sessions[id].referenced = 1;
+
+	return arena_ctx(s, id);
+}
+
+/*
+ * Start reading the hibernated contexts of the sessions about to wake up,
+ * e.g. of the ready list of epoll, before their hc128_sessions_get().
+*/
+void
+hc128_sessions_prefetch(struct hc128_sessions *s, const uint32_t *id, int n)
+{
+	size_t start, first, last;
+	int i;
+
+	for(i = 0; i < n; i++) {
+		if((id[i] >= s->capacity) || (s->sessions[id[i]].state != SESSION_HIBERNATED))
+			continue;
+
+		start = (size_t)id[i] * HC128_SESSIONS_RECORD;
+		first = start & ~(s->page - 1);
+		last = (start + s->sessions[id[i]].len + HC128_AEAD_TAGLEN + s->page - 1) & ~(s->page - 1);
+
+		madvise(s->file + first, last - first, MADV_WILLNEED);
+	}
+}
+
+// Close the session id, the context is wiped
+void
+hc128_sessions_close(struct hc128_sessions *s, uint32_t id)
+{
+	if(id >= s->capacity)
+		return;
+
+	switch(s->sessions[id].state) {
+	case SESSION_RESIDENT:
+		memset(arena_ctx(s, id), 0, sizeof(struct hc128_context));
+		s->sessions[id].state = SESSION_CLOSED;
+		arena_release(s, id);
+		s->stats.resident--;
+		break;
+	case SESSION_HIBERNATED:
+		record_wipe(s, id);
+		file_release(s, id);
+		s->sessions[id].state = SESSION_CLOSED;
+		s->stats.hibernated--;
+		break;
+	}
+}
+
+/*
+ * Move the clock hand over budget sessions.
+ * now - current time, in the units of idle
+ * Return value: number of sessions hibernated
+*/
+uint32_t
+hc128_sessions_tick(struct hc128_sessions *s, uint64_t now, uint32_t budget)
+{
+	struct session *ss;
+	uint32_t n = 0;
+
+	s->now = now;
+
+	for(; budget; budget--) {
+		ss = &s->sessions[s->hand];
+
+		if(ss->state == SESSION_RESIDENT) {
+			if(ss->referenced) {
+				ss->referenced = 0;
+				ss->last_use = now;
+			}
+			else if((now - ss->last_use >= s->idle) && !hibernate(s, s->hand))
+				n++;
+		}
+
+		if(++s->hand == s->capacity)
+			s->hand = 0;
+	}
+
+	return n;
+}
+
+void
+hc128_sessions_stats(struct hc128_sessions *s, struct hc128_sessions_stats *stats)
+{
+	*stats = s->stats;
+}
+
+/*
+ * Destroy the store, the contexts and the records are wiped, the wiped
+ * records are synced to the file and the file is left empty.
+ * Return value: 0 (if all is well), -1 id all bad
+*/
+int
+hc128_sessions_destroy(struct hc128_sessions *s)
+{
+	uint32_t id;
+	int res = 0;
+
+	for(id = 0; id < s->capacity; id++) {
+		if(s->sessions[id].state == SESSION_RESIDENT)
+			memset(arena_ctx(s, id), 0, sizeof(struct hc128_context));
+		else if(s->sessions[id].state == SESSION_HIBERNATED)
+			record_wipe(s, id);
+	}
+
+	if(msync(s->file, s->file_size, MS_SYNC))
+		res = -1;
+
+	munmap(s->arena, s->arena_size);
+	munmap(s->file, s->file_size);
+
+	if(ftruncate(s->fd, 0) || close(s->fd))
+		res = -1;
+
+	free(s->sessions);
+	memset(s, 0, sizeof(*s));
+	free(s);
+
+	return res;
+}
@@ -0,0 +1,62 @@
+/*
+ * Session store with the hibernation tier.
+ * Session id owns one HC-128 context. Resident contexts live in an
+ * anonymous arena indexed by the id; contexts idle longer than the idle
+ * time are serialized (hc128_serialize()) into the mmap-backed file at the
+ * slot of the id and their arena pages are given back to the system.
+ * hc128_sessions_get() brings a hibernated context back on demand.
+ * Idle sessions are found by the clock: access sets the referenced bit,
+ * the hand of hc128_sessions_tick() clears it and stamps the time, and a
+ * session not referenced for the idle time is hibernated.
+ * The context holds the state of the keystream, so the file never gets it
+ * in the clear: every record is sealed by hc128_aead_seal() under a random
+ * key of the store, which lives only in memory, and is wiped when the
+ * session wakes up, is closed or the store is destroyed. A record changed
+ * in the file does not open, hc128_sessions_get() returns NULL. What the
+ * file still shows: which sessions are hibernated and when.
+ * The store is not thread safe, use one store per thread or shard.
+*/
+
+#ifndef HC128_SESSIONS_H
+#define HC128_SESSIONS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hc128.h"
+
+// Size of the slot of a session in the file: sealed serialized context and the tag
+#define HC128_SESSIONS_RECORD	(HC128_SERIALIZED_MAX + 16)
+
+/*
+ * Counters of the store
+ * resident, hibernated - sessions in memory and in the file
+ * hibernations, wakeups - moves to the file and back
+*/
+struct hc128_sessions_stats {
+	uint32_t resident;
+	uint32_t hibernated;
+	uint64_t hibernations;
+	uint64_t wakeups;
+};
+
+struct hc128_context;
+struct hc128_sessions;
+
+struct hc128_sessions *hc128_sessions_create(const char *path, uint32_t capacity, uint64_t idle);
+
+int hc128_sessions_open(struct hc128_sessions *s, uint32_t id, const uint8_t *key, int keylen, const uint8_t iv[16], int ivlen);
+
+struct hc128_context *hc128_sessions_get(struct hc128_sessions *s, uint32_t id);
+
+void hc128_sessions_prefetch(struct hc128_sessions *s, const uint32_t *id, int n);
+
+void hc128_sessions_close(struct hc128_sessions *s, uint32_t id);
+
+uint32_t hc128_sessions_tick(struct hc128_sessions *s, uint64_t now, uint32_t budget);
+
+void hc128_sessions_stats(struct hc128_sessions *s, struct hc128_sessions_stats *stats);
+
+int hc128_sessions_destroy(struct hc128_sessions *s);
+
+#endif
@@ -20,6 +20,10 @@
 #define ECRYPT_LITTLE_ENDIAN
 #elif defined(__i386)           /* x86 (gcc) */
 #define ECRYPT_LITTLE_ENDIAN
+#elif defined(__x86_64__)       /* x86-64 (gcc) */
+#define ECRYPT_LITTLE_ENDIAN
+#elif defined(__aarch64__) && defined(__AARCH64EL__) /* ARMv8 (gcc) */
+#define ECRYPT_LITTLE_ENDIAN
 #elif defined(_M_IX86)          /* x86 (MSC, Borland) */
 #define ECRYPT_LITTLE_ENDIAN
 #elif defined(_MSC_VER)         /* x86 (surely MSC) */
@@ -72,6 +72,26 @@
  * internal state of your cipher. 
  */
 
+/*
+ * With ECRYPT_HC128_ENGINE defined the API is served by the optimized
+ * engine of ../hc128.c (adapter hc-128-engine.c) instead of the
+ * reference implementation hc-128.c.
+ */
+#ifdef ECRYPT_HC128_ENGINE
+
+#include <stdint.h>
+#include "../hc128.h"
+
+typedef struct
+{
+  struct hc128_context engine;
+  u8 key[16];
+  u32 keysize;       /* key size in bits */
+  u32 ivsize;        /* iv size in bits*/ 
+} ECRYPT_ctx;
+
+#else
+
 typedef struct
 {
   /* 
@@ -97,6 +117,8 @@ void generate_keystream(ECRYPT_ctx* ctx, u32* keystream);
 
 void setup_update(ECRYPT_ctx* ctx);
 
+#endif
+
 /* ------------------------------------------------------------------------- */
 
 /* Mandatory functions */
@@ -245,7 +267,9 @@ void ECRYPT_keystream_bytes(
  * "ecrypt-sync.c". If you want to implement them differently, please
  * undef the ECRYPT_USES_DEFAULT_ALL_IN_ONE flag.
  */
+#ifndef ECRYPT_HC128_ENGINE
 #define ECRYPT_USES_DEFAULT_ALL_IN_ONE        /* [edit] */
+#endif
 
 /*
  * Undef ECRYPT_HAS_SINGLE_PACKET_FUNCTION if you want to provide
@@ -301,7 +325,9 @@ void ECRYPT_decrypt_packet(
 
 #define ECRYPT_BLOCKLENGTH 64                 /* [edit] */
 
+#ifndef ECRYPT_HC128_ENGINE
 #define ECRYPT_USES_DEFAULT_BLOCK_MACROS      /* [edit] */
+#endif
 #ifdef ECRYPT_USES_DEFAULT_BLOCK_MACROS
 
 #define ECRYPT_encrypt_blocks(ctx, plaintext, ciphertext, blocks)  \
@@ -379,7 +405,16 @@ void ECRYPT_keystream_blocks(
  * 10). Note also that all variants should have exactly the same
  * external interface (i.e., the same ECRYPT_BLOCKLENGTH, etc.). 
  */
+/*
+ * Variants of the engine (ECRYPT_HC128_ENGINE):
+ * 1 - scalar kernel, hc128_crypt()
+ * 2 - bulk kernel, hc128_crypt_bulk()
+ */
+#ifdef ECRYPT_HC128_ENGINE
+#define ECRYPT_MAXVARIANT 2                   /* [edit] */
+#else
 #define ECRYPT_MAXVARIANT 1                   /* [edit] */
+#endif
 
 #ifndef ECRYPT_VARIANT
 #define ECRYPT_VARIANT 1
@@ -0,0 +1,97 @@
+/* hc-128-engine.c */
+
+/*
+ * ECRYPT API served by the optimized engine of ../hc128.c.
+ * Build with -DECRYPT_HC128_ENGINE (see ecrypt-sync.h) and select the
+ * kernel with -DECRYPT_VARIANT=1 (scalar) or 2 (bulk). There is no SIMD
+ * kernel: HC-128 has one serial chain of table lookups per stream, so
+ * the bulk kernel (generate, then vectorized combine) takes that place.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "ecrypt-sync.h"
+
+#ifndef ECRYPT_HC128_ENGINE
+#error hc-128-engine.c must be built with -DECRYPT_HC128_ENGINE
+#endif
+
+#if (ECRYPT_VARIANT == 2)
+#define ENGINE_CRYPT hc128_crypt_bulk
+#else
+#define ENGINE_CRYPT hc128_crypt
+#endif
+
+void ECRYPT_init(void)
+{
+}
+
+/* the key is kept until ECRYPT_ivsetup(), the engine sets up both at once */
+void ECRYPT_keysetup(
+  ECRYPT_ctx* ctx,
+  const u8* key,
+  u32 keysize,                /* Key size in bits (128+128*i) */
+  u32 ivsize)                 /* IV size in bits  (128+128*i)*/
+{
+  if (keysize > 128) keysize = 128;
+  if (ivsize > 128) ivsize = 128;
+
+  ctx->keysize = keysize;
+  ctx->ivsize = ivsize;
+
+  memcpy(ctx->key, key, keysize >> 3);
+}
+
+void ECRYPT_ivsetup(ECRYPT_ctx* ctx, const u8* iv)
+{
+  hc128_set_key_and_iv(&ctx->engine, ctx->key, ctx->keysize >> 3, iv, ctx->ivsize >> 3);
+}
+
+void ECRYPT_process_bytes(
+  int action,                 /* 0 = encrypt; 1 = decrypt; */
+  ECRYPT_ctx* ctx,
+  const u8* input,
+  u8* output,
+  u32 msglen)                 /* Message length in bytes. */
+{
+  ENGINE_CRYPT(&ctx->engine, input, msglen, output);
+}
+
+void ECRYPT_keystream_bytes(
+  ECRYPT_ctx* ctx,
+  u8* keystream,
+  u32 length)                 /* Length of keystream in bytes. */
+{
+  hc128_keystream(&ctx->engine, keystream, length);
+}
+
+void ECRYPT_process_packet(
+  int action,                 /* 0 = encrypt; 1 = decrypt; */
+  ECRYPT_ctx* ctx,
+  const u8* iv,
+  const u8* input,
+  u8* output,
+  u32 msglen)
+{
+  hc128_set_key_and_iv(&ctx->engine, ctx->key, ctx->keysize >> 3, iv, ctx->ivsize >> 3);
+  ENGINE_CRYPT(&ctx->engine, input, msglen, output);
+}
+
+void ECRYPT_process_blocks(
+  int action,                 /* 0 = encrypt; 1 = decrypt; */
+  ECRYPT_ctx* ctx,
+  const u8* input,
+  u8* output,
+  u32 blocks)                 /* Message length in blocks. */
+{
+  ENGINE_CRYPT(&ctx->engine, input, blocks * ECRYPT_BLOCKLENGTH, output);
+}
+
+void ECRYPT_keystream_blocks(
+  ECRYPT_ctx* ctx,
+  u8* keystream,
+  u32 blocks)                 /* Keystream length in blocks. */
+{
+  hc128_keystream_blocks(&ctx->engine, keystream, blocks);
+}
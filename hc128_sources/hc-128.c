@@ -294,3 +294,33 @@ void ECRYPT_process_bytes(
   }
 
 }
+
+/*========================================================
+ *  The following defines the keystream generation
+ *========================================================
+ */
+
+void ECRYPT_keystream_bytes(
+  ECRYPT_ctx* ctx,
+  u8* keystream,
+  u32 length)                /* Length of keystream in bytes. */
+{
+  u32 i, stream[16];
+
+  for ( ; length >= 64; length -= 64, keystream += 64)
+  {
+	  generate_keystream(ctx, stream);
+
+	  for (i = 0; i < 16; ++i)
+	      U32TO8_LITTLE(keystream + 4 * i, stream[i]);
+  }
+
+  if (length > 0)
+  {
+      generate_keystream(ctx, stream);
+
+      for (i = 0; i < length; i ++)
+	      keystream[i] = ((u8*)stream)[i];
+  }
+
+}
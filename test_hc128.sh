@@ -1,7 +1,85 @@
 #!/bin/sh
+# Tests of make test: the mains have to run, every kernel must pass the test
+# vectors and the random differential against the ECRYPT code (conformance),
+# the checks of the library modules in the benches must pass,
+# the kernels must not be slower than the baseline of this host (bench/cycles,
+# JSON in bench/baselines).
+# The first run on a host writes the baseline: RUNS runs of the suite, their
+# spread is the noise of the host. HC128_REBASE=1 writes it again after an
+# intended change of the speed.
+# HC128_TOLERANCE - tolerance in percent (10), HC128_SPEED_CHECK=0 - no speed check
+# HC128_FUZZ_ROUNDS, HC128_FUZZ_SEED - random differential rounds (2000) and seed (1)
 
-echo "Run time main"
-./main
-echo "Run time developer"
-cd hc128_sources/
-./main
+run() {
+	echo "Run $1"
+
+	if ! (cd "$2" && "./$3" > /dev/null); then
+		echo "$1 failed!"
+		exit 1
+	fi
+}
+
+run "main" . main
+run "developer main" hc128_sources main
+run "developer API on the optimized engine" hc128_sources main_engine
+
+conformance() {
+	echo "Conformance $1"
+
+	if ! out=$("./$2" -r "${HC128_FUZZ_ROUNDS:-2000}" -s "${HC128_FUZZ_SEED:-1}"); then
+		echo "$out"
+		echo "$1 failed!"
+		exit 1
+	fi
+}
+
+conformance "of the kernels against the reference" conformance
+conformance "of the kernels against the engine" conformance_engine
+conformance "of the C++ engine hc128::stream" conformance_cxx
+
+check() {
+	echo "Check $1"
+
+	if ! out=$("$@"); then
+		echo "$out"
+		echo "Check $1 failed!"
+		exit 1
+	fi
+}
+
+check ./bench/aead -c
+check ./bench/rng -c
+check ./bench/pagestore -c
+check ./bench/sessions -c
+check ./bench/log -c
+check ./bench/rekey -c
+check ./bench/fanout -c
+
+[ "$HC128_SPEED_CHECK" = "0" ] && exit 0
+
+RUNS=3
+dir=bench/baselines/$(hostname)
+
+mkdir -p $dir
+
+if [ ! -f "$dir/$RUNS.json" ] || [ "$HC128_REBASE" = "1" ]; then
+	for i in $(seq $RUNS); do
+		./bench/cycles -j "$dir/$i.json" || exit 1
+	done
+
+	echo "Baseline $dir written"
+	exit 0
+fi
+
+base=""
+for i in $(seq $RUNS); do
+	base="$base -b $dir/$i.json"
+done
+
+# A slower cell is measured again, one noisy run does not fail
+./bench/cycles -t "${HC128_TOLERANCE:-10}" -a 2 -j "$dir/last.json" $base
+rc=$?
+
+[ $rc -eq 2 ] && echo "Speed regression against $dir, see the cells marked SLOWER above"
+
+exit $rc